@@ -0,0 +1,23 @@
+#!/bin/bash
+# Builds copy_module.spv from copy_module.cl. CLANG and LLVM_SPIRV select the tools, e.g. clang-14 and
+# llvm-spirv-14, SPIRV_VAL the validator run on the result when it is installed.
+#
+#   kernels/build_copy_module.sh [OUTPUT]   (kernels/copy_module.spv by default)
+set -euo pipefail
+
+here="$(cd "$(dirname "$0")" && pwd)"
+output="${1:-${here}/copy_module.spv}"
+clang="${CLANG:-clang}"
+llvm_spirv="${LLVM_SPIRV:-llvm-spirv}"
+spirv_val="${SPIRV_VAL:-spirv-val}"
+bitcode="$(mktemp --suffix=.bc)"
+trap 'rm -f "${bitcode}"' EXIT
+
+# cl_intel_subgroups enables copy_block, the specialization constant of copy_unrolled comes from __spirv_SpecConstant
+"${clang}" -cl-std=CL2.0 -target spir64 -Xclang -finclude-default-header -cl-ext=+cl_intel_subgroups -O2 -emit-llvm \
+  -c "${here}/copy_module.cl" -o "${bitcode}"
+"${llvm_spirv}" --spirv-ext=+SPV_INTEL_subgroups "${bitcode}" -o "${output}"
+
+if command -v "${spirv_val}" >/dev/null; then
+  "${spirv_val}" "${output}"
+fi
@@ -6,17 +6,19 @@
  *
  */
 
+// Every kernel spreads its range over all work-items with a grid-stride loop,
+// so any launch size covers the whole copy and the host can size the launch
+// for the device instead of the buffer.
+
 kernel void copy_data(global int *input_buffer, global int *output_buffer,
                       int offset, int size) {
   // copy data from input_buffer to output_buffer starting
   // at offset
 
-  const int xid = get_global_id(0);
+  const int count = size - offset;
 
-  if (xid == 0) {
-    for (int i = 0; i < size - offset; i++) {
-      output_buffer[i + offset] = input_buffer[i];
-    }
+  for (int i = get_global_id(0); i < count; i += get_global_size(0)) {
+    output_buffer[i + offset] = input_buffer[i];
   }
 }
 
@@ -24,13 +26,161 @@ struct copy_data {
   uint *data;
 };
 
+// Dimension 0 selects the buffer, dimension 1 spreads the elements of each
+// buffer. A 1-D launch copies every buffer on a single work-item as before.
 kernel void copy_data_indirect(global struct copy_data *input_buffer,
                                global struct copy_data *output_buffer,
                                int offset, int size) {
 
   const int xid = get_global_id(0);
+  global uint *input = input_buffer[xid].data;
+  global uint *output = output_buffer[xid].data;
+
+  for (int i = get_global_id(1); i < size - offset; i += get_global_size(1)) {
+    output[i + offset] = input[i];
+  }
+}
+
+// One entry of a scatter/gather batch.
+struct copy_descriptor {
+  global uchar *dst;
+  global const uchar *src;
+  ulong bytes;
+};
 
-  for (int i = 0; i < size - offset; i++) {
-    output_buffer[xid].data[i + offset] = input_buffer[xid].data[i];
+// Dimension 0 selects the descriptor, dimension 1 spreads its bytes, so a
+// whole batch of copies of any sizes takes one launch. Entries with dst, src
+// and size 4-byte aligned move uints.
+kernel void copy_batch(global const struct copy_descriptor *copies) {
+  const struct copy_descriptor copy = copies[get_global_id(0)];
+  const size_t lane = get_global_id(1);
+  const size_t stride = get_global_size(1);
+
+  if ((((ulong)copy.dst | (ulong)copy.src | copy.bytes) & 3) == 0) {
+    global uint *d = (global uint *)copy.dst;
+    global const uint *s = (global const uint *)copy.src;
+    for (size_t i = lane; i < copy.bytes / 4; i += stride) {
+      d[i] = s[i];
+    }
+  } else {
+    for (size_t i = lane; i < copy.bytes; i += stride) {
+      copy.dst[i] = copy.src[i];
+    }
+  }
+}
+
+// Element-wise copies of count elements.
+#define COPY_TYPED(name, type)                                                 \
+  kernel void name(global const type *src, global type *dst, ulong count) {   \
+    for (size_t i = get_global_id(0); i < count; i += get_global_size(0)) {    \
+      dst[i] = src[i];                                                         \
+    }                                                                          \
+  }
+
+COPY_TYPED(copy_u8, uchar)
+COPY_TYPED(copy_u16, ushort)
+COPY_TYPED(copy_u32, uint)
+COPY_TYPED(copy_u64, ulong)
+
+// Copies bytes with 16-byte vector loads at any alignment of src and dst.
+kernel void copy_unaligned(global const uchar *src, global uchar *dst,
+                           ulong bytes) {
+  const size_t gid = get_global_id(0);
+  const size_t stride = get_global_size(0);
+  const ulong vectors = bytes / 16;
+
+  for (size_t i = gid; i < vectors; i += stride) {
+    vstore16(vload16(i, src), i, dst);
+  }
+  const ulong tail = vectors * 16;
+  if (gid < bytes - tail) {
+    dst[tail + gid] = src[tail + gid];
+  }
+}
+
+// Vector copies for src and dst with the same misalignment modulo the vector
+// size. The unaligned head and the tail are copied byte by byte, everything in
+// between with aligned vector loads and stores.
+#define COPY_VECTOR(name, vector, width)                                       \
+  kernel void name(global const uchar *src, global uchar *dst, ulong bytes) {  \
+    const size_t gid = get_global_id(0);                                       \
+    const size_t stride = get_global_size(0);                                  \
+    const ulong head = min(bytes, (ulong)((width - ((ulong)dst % width)) %     \
+                                          width));                             \
+    const ulong vectors = (bytes - head) / width;                              \
+    const ulong tail = head + vectors * width;                                 \
+    global const vector *s = (global const vector *)(src + head);              \
+    global vector *d = (global vector *)(dst + head);                          \
+                                                                               \
+    if (gid < head) {                                                          \
+      dst[gid] = src[gid];                                                     \
+    }                                                                          \
+    for (size_t i = gid; i < vectors; i += stride) {                           \
+      d[i] = s[i];                                                             \
+    }                                                                          \
+    if (gid < bytes - tail) {                                                  \
+      dst[tail + gid] = src[tail + gid];                                       \
+    }                                                                          \
+  }
+
+COPY_VECTOR(copy_x16, uint4, 16)
+COPY_VECTOR(copy_x32, uint8, 32)
+
+// llvm-spirv turns calls of this built-in into OpSpecConstant, whose value the
+// host sets when it builds the module.
+uint __spirv_SpecConstant(int id, uint default_value);
+
+// Element-wise copy of count elements where each work-item copies runs of
+// unroll consecutive elements. unroll is specialization constant 0, default 1,
+// so the compiler sees it as a constant in every specialized build.
+kernel void copy_unrolled(global const uint *src, global uint *dst,
+                          ulong count) {
+  const ulong unroll = __spirv_SpecConstant(0, 1);
+  const size_t stride = get_global_size(0) * unroll;
+
+  for (size_t i = get_global_id(0) * unroll; i < count; i += stride) {
+    for (size_t j = i; j < min(i + unroll, count); j++) {
+      dst[j] = src[j];
+    }
+  }
+}
+
+#ifdef cl_intel_subgroups
+#pragma OPENCL EXTENSION cl_intel_subgroups : enable
+
+// Whole sub-groups move contiguous blocks with block reads and writes. Same
+// rules as copy_x16: src and dst share their misalignment modulo 16.
+kernel void copy_block(global const uchar *src, global uchar *dst,
+                       ulong bytes) {
+  const size_t gid = get_global_id(0);
+  const size_t stride = get_global_size(0);
+  const ulong head = min(bytes, (ulong)((16 - ((ulong)dst % 16)) % 16));
+  const ulong words = (bytes - head) / 4;
+  global const uint *s = (global const uint *)(src + head);
+  global uint *d = (global uint *)(dst + head);
+
+  // Each sub-group moves 4 uints per lane per step
+  const uint lanes = get_sub_group_size();
+  const ulong block = 4 * lanes;
+  const ulong blocks = words / block;
+  const size_t sub_group = get_group_id(0) * get_num_sub_groups() +
+                           get_sub_group_id();
+  const size_t sub_groups = get_num_groups(0) * get_num_sub_groups();
+  for (ulong b = sub_group; b < blocks; b += sub_groups) {
+    uint4 value = intel_sub_group_block_read4(s + b * block);
+    intel_sub_group_block_write4(d + b * block, value);
+  }
+
+  // Words after the last whole block, then the bytes at both ends
+  for (ulong i = blocks * block + gid; i < words; i += stride) {
+    d[i] = s[i];
+  }
+  const ulong tail = head + words * 4;
+  if (gid < head) {
+    dst[gid] = src[gid];
+  }
+  if (gid < bytes - tail) {
+    dst[tail + gid] = src[tail + gid];
   }
 }
+#endif
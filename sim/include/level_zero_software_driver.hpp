@@ -0,0 +1,55 @@
+// Copyright 2020 Intel Corporation
+#ifndef SIM_INCLUDE_LEVEL_ZERO_SOFTWARE_DRIVER_HPP_
+#define SIM_INCLUDE_LEVEL_ZERO_SOFTWARE_DRIVER_HPP_
+
+#include <string.h>
+#ifdef USE_LOCAL_LEVEL_ZERO
+#include <level_zero/ze_api.h>
+#else
+#include <ze_api.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Software implementation of the Level Zero entry points used by lzu, linked instead of ze_loader when the build
+// selects it. Memory is host memory, every command queue is a worker thread that runs its command lists in order, and
+// events carry timestamps taken from the host clock in nanoseconds.
+//
+// Modules are SPIR-V. Only the entry point names are read from them, so zeKernelCreate accepts exactly the kernels the
+// module defines. A launch runs the host function registered under the kernel name, or does nothing when there is
+// none, which is what host overhead measurements want. lzu registers its host kernels (level_zero_host_kernels.hpp)
+// when its DeviceRegistry discovers the devices.
+//
+// Environment:
+//   LZU_SOFTWARE_DEVICES  number of devices to expose, 1 by default, 0 for a machine without any
+namespace lzu {
+namespace software {
+
+struct KernelInvocation {
+  std::string name;
+  std::vector<std::vector<uint8_t>> arguments;  // Raw argument values in index order, empty for local memory
+  std::array<uint32_t, 3> group_size = {{1, 1, 1}};
+  ze_group_count_t group_count = {};
+
+  template <typename T>
+  T argument(uint32_t index) const {
+    T value;
+    const std::vector<uint8_t>& bytes = arguments.at(index);
+    memcpy(&value, bytes.data(), std::min(bytes.size(), sizeof(T)));
+    return value;
+  }
+};
+
+typedef std::function<void(const KernelInvocation&)> KernelFunction;
+
+// Host implementation for kernels of this name in every module. Kernels created before the call keep the old one.
+void register_kernel(const std::string& name, const KernelFunction& function);
+
+}  // namespace software
+}  // namespace lzu
+
+#endif  // SIM_INCLUDE_LEVEL_ZERO_SOFTWARE_DRIVER_HPP_
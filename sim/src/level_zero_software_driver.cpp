@@ -0,0 +1,990 @@
+// Copyright 2020 Intel Corporation
+
+#include "level_zero_software_driver.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace lzu {
+namespace software {
+
+static std::mutex& kernel_functions_mutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+static std::map<std::string, KernelFunction>& kernel_functions() {
+  static std::map<std::string, KernelFunction> functions;
+  return functions;
+}
+
+void register_kernel(const std::string& name, const KernelFunction& function) {
+  std::lock_guard<std::mutex> lock(kernel_functions_mutex());
+  kernel_functions()[name] = function;
+}
+
+static KernelFunction find_kernel_function(const std::string& name) {
+  std::lock_guard<std::mutex> lock(kernel_functions_mutex());
+  auto it = kernel_functions().find(name);
+  return it == kernel_functions().end() ? KernelFunction() : it->second;
+}
+
+// Host clock in nanoseconds, the synthetic device timestamp
+static uint64_t now_ns() {
+  static const std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+  return static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count());
+}
+
+// Wait on a condition variable with a Level Zero timeout: 0 polls, UINT64_MAX waits forever, otherwise nanoseconds.
+template <typename Predicate>
+static bool wait_for(std::unique_lock<std::mutex>& lock, std::condition_variable& cv, uint64_t timeout,
+                     Predicate done) {
+  if (timeout == UINT64_MAX) {
+    cv.wait(lock, done);
+    return true;
+  }
+  return cv.wait_for(lock, std::chrono::nanoseconds(timeout), done);
+}
+
+static const uint32_t kQueueGroupCount = 2;  // Ordinal 0 computes and copies, ordinal 1 only copies
+static const uint32_t kMaxTotalGroupSize = 256;
+
+}  // namespace software
+}  // namespace lzu
+
+using lzu::software::now_ns;
+using lzu::software::wait_for;
+
+struct _ze_device_handle_t {
+  ze_driver_handle_t driver = nullptr;
+  uint32_t index = 0;
+};
+
+struct _ze_driver_handle_t {
+  std::vector<std::unique_ptr<_ze_device_handle_t>> devices;
+};
+
+struct Allocation {
+  size_t size = 0;
+  ze_memory_type_t type = ZE_MEMORY_TYPE_UNKNOWN;
+  ze_device_handle_t device = nullptr;
+  uint64_t id = 0;
+};
+
+struct _ze_context_handle_t {
+  ze_driver_handle_t driver = nullptr;
+  std::mutex mutex;
+  std::map<uintptr_t, Allocation> allocations;  // By base address
+  uint64_t next_id = 1;
+};
+
+struct _ze_event_pool_handle_t {
+  ze_context_handle_t context = nullptr;
+  ze_event_pool_flags_t flags = 0;
+  uint32_t count = 0;
+};
+
+struct _ze_event_handle_t {
+  ze_event_pool_handle_t pool = nullptr;
+  uint32_t index = 0;
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool signaled = false;
+  uint64_t start = 0;
+  uint64_t end = 0;
+
+  void signal(uint64_t start_ns, uint64_t end_ns) {
+    std::lock_guard<std::mutex> lock(mutex);
+    start = start_ns;
+    end = end_ns;
+    signaled = true;
+    cv.notify_all();
+  }
+
+  void reset() {
+    std::lock_guard<std::mutex> lock(mutex);
+    signaled = false;
+    start = end = 0;
+  }
+
+  bool wait(uint64_t timeout) {
+    std::unique_lock<std::mutex> lock(mutex);
+    return wait_for(lock, cv, timeout, [this] { return signaled; });
+  }
+};
+
+struct _ze_fence_handle_t {
+  ze_command_queue_handle_t queue = nullptr;
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool signaled = false;
+};
+
+struct _ze_module_build_log_handle_t {
+  std::string log;
+};
+
+struct EntryPoint {
+  uint32_t id = 0;
+  uint32_t num_arguments = 0;
+};
+
+struct _ze_module_handle_t {
+  ze_device_handle_t device = nullptr;
+  std::vector<uint8_t> binary;
+  std::map<std::string, EntryPoint> entry_points;
+};
+
+struct _ze_kernel_handle_t {
+  ze_module_handle_t module = nullptr;
+  lzu::software::KernelInvocation invocation;
+  lzu::software::KernelFunction function;
+  uint32_t num_arguments = 0;
+};
+
+struct Command {
+  enum class Kind { Copy, Launch, Barrier, Signal, Wait, Reset, Nop } kind = Kind::Nop;
+  void* dst = nullptr;
+  const void* src = nullptr;
+  size_t size = 0;
+  lzu::software::KernelInvocation invocation;
+  lzu::software::KernelFunction function;
+  ze_event_handle_t signal = nullptr;
+  std::vector<ze_event_handle_t> waits;
+};
+
+struct _ze_command_list_handle_t {
+  ze_context_handle_t context = nullptr;
+  ze_device_handle_t device = nullptr;
+  uint32_t ordinal = 0;
+  bool closed = false;
+  std::vector<Command> commands;
+};
+
+struct _ze_command_queue_handle_t {
+  struct Submission {
+    std::vector<ze_command_list_handle_t> lists;
+    ze_fence_handle_t fence = nullptr;
+  };
+
+  ze_context_handle_t context = nullptr;
+  ze_device_handle_t device = nullptr;
+  uint32_t ordinal = 0;
+  std::mutex mutex;
+  std::condition_variable work_cv;
+  std::condition_variable idle_cv;
+  std::deque<Submission> pending;
+  bool busy = false;
+  bool stop = false;
+  std::thread worker;
+
+  void run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+      work_cv.wait(lock, [this] { return stop || !pending.empty(); });
+      if (pending.empty()) return;
+      Submission submission = pending.front();
+      pending.pop_front();
+      busy = true;
+      lock.unlock();
+
+      for (auto list : submission.lists) {
+        for (auto& command : list->commands) execute(command);
+      }
+      if (submission.fence) {
+        std::lock_guard<std::mutex> fence_lock(submission.fence->mutex);
+        submission.fence->signaled = true;
+        submission.fence->cv.notify_all();
+      }
+
+      lock.lock();
+      busy = false;
+      if (pending.empty()) idle_cv.notify_all();
+    }
+  }
+
+  // Commands of one queue run in order, so only explicit waits need handling
+  static void execute(const Command& command) {
+    for (auto event : command.waits) event->wait(UINT64_MAX);
+    uint64_t start = now_ns();
+    switch (command.kind) {
+      case Command::Kind::Copy:
+        memmove(command.dst, command.src, command.size);
+        break;
+      case Command::Kind::Launch:
+        if (command.function) command.function(command.invocation);
+        break;
+      case Command::Kind::Reset:
+        command.signal->reset();
+        return;
+      default:
+        break;
+    }
+    if (command.signal) command.signal->signal(start, now_ns());
+  }
+};
+
+namespace {
+
+std::mutex g_init_mutex;
+std::unique_ptr<_ze_driver_handle_t> g_driver;
+
+bool initialized() {
+  std::lock_guard<std::mutex> lock(g_init_mutex);
+  return g_driver != nullptr;
+}
+
+uint32_t group_count_total(const ze_group_count_t& count) {
+  return count.groupCountX * count.groupCountY * count.groupCountZ;
+}
+
+// Entry point names and parameter counts from a SPIR-V binary
+bool parse_spirv(const std::vector<uint8_t>& binary, std::map<std::string, EntryPoint>* entry_points) {
+  const uint32_t kMagic = 0x07230203;
+  const uint32_t kOpEntryPoint = 15;
+  const uint32_t kOpFunction = 54;
+  const uint32_t kOpFunctionParameter = 55;
+  if (binary.size() < 20 || binary.size() % 4 != 0) return false;
+  std::vector<uint32_t> words(binary.size() / 4);
+  memcpy(words.data(), binary.data(), binary.size());
+  if (words[0] != kMagic) {
+    if (__builtin_bswap32(words[0]) != kMagic) return false;
+    for (auto& word : words) word = __builtin_bswap32(word);
+  }
+
+  std::map<uint32_t, std::string> names;
+  uint32_t current_function = 0;
+  std::map<uint32_t, uint32_t> parameters;
+  for (size_t i = 5; i < words.size();) {
+    uint32_t count = words[i] >> 16;
+    uint32_t opcode = words[i] & 0xffff;
+    if (count == 0 || i + count > words.size()) return false;
+    if (opcode == kOpEntryPoint && count > 3) {
+      const char* name = reinterpret_cast<const char*>(&words[i + 3]);
+      names[words[i + 2]] = std::string(name, strnlen(name, (count - 3) * 4));
+    } else if (opcode == kOpFunction && count > 2) {
+      current_function = words[i + 2];
+      parameters[current_function] = 0;
+    } else if (opcode == kOpFunctionParameter) {
+      parameters[current_function]++;
+    }
+    i += count;
+  }
+  for (auto& entry : names) {
+    EntryPoint entry_point;
+    entry_point.id = entry.first;
+    entry_point.num_arguments = parameters[entry.first];
+    (*entry_points)[entry.second] = entry_point;
+  }
+  return true;
+}
+
+ze_result_t append(ze_command_list_handle_t list, Command command, ze_event_handle_t signal, uint32_t num_waits,
+                   ze_event_handle_t* waits) {
+  if (list == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  if (list->closed) return ZE_RESULT_ERROR_INVALID_ARGUMENT;
+  if (num_waits > 0 && waits == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_POINTER;
+  command.signal = signal;
+  command.waits.assign(waits, waits + num_waits);
+  list->commands.push_back(std::move(command));
+  return ZE_RESULT_SUCCESS;
+}
+
+}  // namespace
+
+// Driver and device
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeInit(ze_init_flags_t /*flags*/) {
+  std::lock_guard<std::mutex> lock(g_init_mutex);
+  if (g_driver) return ZE_RESULT_SUCCESS;
+  uint32_t count = 1;
+  const char* devices = getenv("LZU_SOFTWARE_DEVICES");
+  if (devices) count = static_cast<uint32_t>(std::max(0, atoi(devices)));
+  g_driver.reset(new _ze_driver_handle_t());
+  for (uint32_t i = 0; i < count; i++) {
+    std::unique_ptr<_ze_device_handle_t> device(new _ze_device_handle_t());
+    device->driver = g_driver.get();
+    device->index = i;
+    g_driver->devices.push_back(std::move(device));
+  }
+  return ZE_RESULT_SUCCESS;
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeDriverGet(uint32_t* pCount, ze_driver_handle_t* phDrivers) {
+  if (!initialized()) return ZE_RESULT_ERROR_UNINITIALIZED;
+  if (pCount == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_POINTER;
+  if (*pCount == 0 || phDrivers == nullptr) {
+    *pCount = 1;
+    return ZE_RESULT_SUCCESS;
+  }
+  *pCount = 1;
+  phDrivers[0] = g_driver.get();
+  return ZE_RESULT_SUCCESS;
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeDriverGetApiVersion(ze_driver_handle_t hDriver, ze_api_version_t* version) {
+  if (hDriver == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  *version = ZE_API_VERSION_CURRENT;
+  return ZE_RESULT_SUCCESS;
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeDriverGetProperties(ze_driver_handle_t hDriver,
+                                                          ze_driver_properties_t* pDriverProperties) {
+  if (hDriver == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  if (pDriverProperties == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_POINTER;
+  memset(&pDriverProperties->uuid, 0, sizeof(pDriverProperties->uuid));
+  memcpy(pDriverProperties->uuid.id, "lzu-software", 12);
+  pDriverProperties->driverVersion = 1;
+  return ZE_RESULT_SUCCESS;
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeDeviceGet(ze_driver_handle_t hDriver, uint32_t* pCount,
+                                                ze_device_handle_t* phDevices) {
+  if (hDriver == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  if (pCount == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_POINTER;
+  uint32_t available = static_cast<uint32_t>(hDriver->devices.size());
+  if (*pCount == 0 || phDevices == nullptr) {
+    *pCount = available;
+    return ZE_RESULT_SUCCESS;
+  }
+  *pCount = std::min(*pCount, available);
+  for (uint32_t i = 0; i < *pCount; i++) phDevices[i] = hDriver->devices[i].get();
+  return ZE_RESULT_SUCCESS;
+}
+
+// Software devices are not partitioned
+ZE_APIEXPORT ze_result_t ZE_APICALL zeDeviceGetSubDevices(ze_device_handle_t hDevice, uint32_t* pCount,
+                                                          ze_device_handle_t* /*phSubdevices*/) {
+  if (hDevice == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  if (pCount == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_POINTER;
+  *pCount = 0;
+  return ZE_RESULT_SUCCESS;
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeDeviceGetProperties(ze_device_handle_t hDevice,
+                                                          ze_device_properties_t* pDeviceProperties) {
+  if (hDevice == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  if (pDeviceProperties == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_POINTER;
+  ze_device_properties_t& p = *pDeviceProperties;
+  p.type = ZE_DEVICE_TYPE_GPU;
+  p.vendorId = 0;
+  p.deviceId = hDevice->index;
+  p.flags = ZE_DEVICE_PROPERTY_FLAG_INTEGRATED;
+  p.subdeviceId = 0;
+  p.coreClockRate = 1000;
+  p.maxMemAllocSize = uint64_t(4) << 30;
+  p.maxHardwareContexts = 64;
+  p.maxCommandQueuePriority = 0;
+  p.numThreadsPerEU = 1;
+  p.physicalEUSimdWidth = 8;
+  p.numEUsPerSubslice = 1;
+  p.numSubslicesPerSlice = 1;
+  p.numSlices = 1;
+  p.timerResolution = 1;  // Nanoseconds per tick
+  p.timestampValidBits = 64;
+  p.kernelTimestampValidBits = 64;
+  memset(&p.uuid, 0, sizeof(p.uuid));
+  memcpy(p.uuid.id, "lzu-software", 12);
+  memcpy(p.uuid.id + 12, &hDevice->index, sizeof(uint32_t));
+  snprintf(p.name, sizeof(p.name), "lzu software device %u", hDevice->index);
+  return ZE_RESULT_SUCCESS;
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeDeviceGetComputeProperties(ze_device_handle_t hDevice,
+                                                                 ze_device_compute_properties_t* p) {
+  if (hDevice == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  if (p == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_POINTER;
+  p->maxTotalGroupSize = lzu::software::kMaxTotalGroupSize;
+  p->maxGroupSizeX = p->maxGroupSizeY = p->maxGroupSizeZ = lzu::software::kMaxTotalGroupSize;
+  p->maxGroupCountX = p->maxGroupCountY = p->maxGroupCountZ = UINT32_MAX;
+  p->maxSharedLocalMemory = 64 << 10;
+  p->numSubGroupSizes = 1;
+  p->subGroupSizes[0] = 8;
+  return ZE_RESULT_SUCCESS;
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeDeviceGetMemoryProperties(ze_device_handle_t hDevice, uint32_t* pCount,
+                                                                ze_device_memory_properties_t* p) {
+  if (hDevice == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  if (pCount == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_POINTER;
+  if (*pCount == 0 || p == nullptr) {
+    *pCount = 1;
+    return ZE_RESULT_SUCCESS;
+  }
+  // One memory, the host's
+  *pCount = 1;
+  p->flags = 0;
+  p->maxClockRate = 0;
+  p->maxBusWidth = 64;
+  p->totalSize = static_cast<uint64_t>(sysconf(_SC_PHYS_PAGES)) * sysconf(_SC_PAGESIZE);
+  snprintf(p->name, sizeof(p->name), "host memory");
+  return ZE_RESULT_SUCCESS;
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeDeviceGetCommandQueueGroupProperties(ze_device_handle_t hDevice,
+                                                                           uint32_t* pCount,
+                                                                           ze_command_queue_group_properties_t* p) {
+  if (hDevice == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  if (pCount == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_POINTER;
+  if (*pCount == 0 || p == nullptr) {
+    *pCount = lzu::software::kQueueGroupCount;
+    return ZE_RESULT_SUCCESS;
+  }
+  *pCount = std::min(*pCount, lzu::software::kQueueGroupCount);
+  for (uint32_t i = 0; i < *pCount; i++) {
+    p[i].flags = (i == 0) ? (ZE_COMMAND_QUEUE_GROUP_PROPERTY_FLAG_COMPUTE | ZE_COMMAND_QUEUE_GROUP_PROPERTY_FLAG_COPY)
+                          : ZE_COMMAND_QUEUE_GROUP_PROPERTY_FLAG_COPY;
+    p[i].maxMemoryFillPatternSize = 0;
+    p[i].numQueues = 1;
+  }
+  return ZE_RESULT_SUCCESS;
+}
+
+// Context and memory
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeContextCreate(ze_driver_handle_t hDriver, const ze_context_desc_t* desc,
+                                                    ze_context_handle_t* phContext) {
+  if (hDriver == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  if (desc == nullptr || phContext == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_POINTER;
+  *phContext = new _ze_context_handle_t();
+  (*phContext)->driver = hDriver;
+  return ZE_RESULT_SUCCESS;
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeContextDestroy(ze_context_handle_t hContext) {
+  if (hContext == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  {
+    // Same lock as zeMemAlloc* and zeMemFree, so a racing call finishes before the map is walked
+    std::lock_guard<std::mutex> lock(hContext->mutex);
+    for (auto& entry : hContext->allocations) free(reinterpret_cast<void*>(entry.first));
+    hContext->allocations.clear();
+  }
+  delete hContext;
+  return ZE_RESULT_SUCCESS;
+}
+
+static ze_result_t allocate(ze_context_handle_t context, size_t size, size_t alignment, ze_memory_type_t type,
+                            ze_device_handle_t device, void** pptr) {
+  if (context == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  if (pptr == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_POINTER;
+  if (size == 0) return ZE_RESULT_ERROR_UNSUPPORTED_SIZE;
+  if (alignment & (alignment - 1)) return ZE_RESULT_ERROR_UNSUPPORTED_ALIGNMENT;
+  void* memory = nullptr;
+  if (posix_memalign(&memory, std::max<size_t>(alignment, 64), size) != 0) {
+    return ZE_RESULT_ERROR_OUT_OF_DEVICE_MEMORY;
+  }
+  std::lock_guard<std::mutex> lock(context->mutex);
+  Allocation& allocation = context->allocations[reinterpret_cast<uintptr_t>(memory)];
+  allocation.size = size;
+  allocation.type = type;
+  allocation.device = device;
+  allocation.id = context->next_id++;
+  *pptr = memory;
+  return ZE_RESULT_SUCCESS;
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeMemAllocShared(ze_context_handle_t hContext,
+                                                     const ze_device_mem_alloc_desc_t* /*device_desc*/,
+                                                     const ze_host_mem_alloc_desc_t* /*host_desc*/, size_t size,
+                                                     size_t alignment, ze_device_handle_t hDevice, void** pptr) {
+  return allocate(hContext, size, alignment, ZE_MEMORY_TYPE_SHARED, hDevice, pptr);
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeMemAllocDevice(ze_context_handle_t hContext,
+                                                     const ze_device_mem_alloc_desc_t* /*device_desc*/, size_t size,
+                                                     size_t alignment, ze_device_handle_t hDevice, void** pptr) {
+  if (hDevice == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  return allocate(hContext, size, alignment, ZE_MEMORY_TYPE_DEVICE, hDevice, pptr);
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeMemAllocHost(ze_context_handle_t hContext,
+                                                   const ze_host_mem_alloc_desc_t* /*host_desc*/, size_t size,
+                                                   size_t alignment, void** pptr) {
+  return allocate(hContext, size, alignment, ZE_MEMORY_TYPE_HOST, nullptr, pptr);
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeMemFree(ze_context_handle_t hContext, void* ptr) {
+  if (hContext == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  if (ptr == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_POINTER;
+  std::lock_guard<std::mutex> lock(hContext->mutex);
+  auto it = hContext->allocations.find(reinterpret_cast<uintptr_t>(ptr));
+  if (it == hContext->allocations.end()) return ZE_RESULT_ERROR_INVALID_ARGUMENT;
+  hContext->allocations.erase(it);
+  free(ptr);
+  return ZE_RESULT_SUCCESS;
+}
+
+// Allocation containing ptr, or end()
+static std::map<uintptr_t, Allocation>::iterator find_allocation(ze_context_handle_t context, const void* ptr) {
+  uintptr_t address = reinterpret_cast<uintptr_t>(ptr);
+  auto it = context->allocations.upper_bound(address);
+  if (it == context->allocations.begin()) return context->allocations.end();
+  --it;
+  return (address < it->first + it->second.size) ? it : context->allocations.end();
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeMemGetAllocProperties(ze_context_handle_t hContext, const void* ptr,
+                                                            ze_memory_allocation_properties_t* pMemAllocProperties,
+                                                            ze_device_handle_t* phDevice) {
+  if (hContext == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  if (pMemAllocProperties == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_POINTER;
+  std::lock_guard<std::mutex> lock(hContext->mutex);
+  auto it = find_allocation(hContext, ptr);
+  bool found = it != hContext->allocations.end();
+  pMemAllocProperties->type = found ? it->second.type : ZE_MEMORY_TYPE_UNKNOWN;
+  pMemAllocProperties->id = found ? it->second.id : 0;
+  pMemAllocProperties->pageSize = found ? 4096 : 0;
+  if (phDevice) *phDevice = found ? it->second.device : nullptr;
+  return ZE_RESULT_SUCCESS;
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeMemGetAddressRange(ze_context_handle_t hContext, const void* ptr, void** pBase,
+                                                         size_t* pSize) {
+  if (hContext == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  std::lock_guard<std::mutex> lock(hContext->mutex);
+  auto it = find_allocation(hContext, ptr);
+  if (it == hContext->allocations.end()) return ZE_RESULT_ERROR_INVALID_ARGUMENT;
+  if (pBase) *pBase = reinterpret_cast<void*>(it->first);
+  if (pSize) *pSize = it->second.size;
+  return ZE_RESULT_SUCCESS;
+}
+
+// Module and kernel
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeModuleCreate(ze_context_handle_t hContext, ze_device_handle_t hDevice,
+                                                   const ze_module_desc_t* desc, ze_module_handle_t* phModule,
+                                                   ze_module_build_log_handle_t* phBuildLog) {
+  if (hContext == nullptr || hDevice == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  if (desc == nullptr || phModule == nullptr || desc->pInputModule == nullptr) {
+    return ZE_RESULT_ERROR_INVALID_NULL_POINTER;
+  }
+  std::unique_ptr<_ze_module_handle_t> module(new _ze_module_handle_t());
+  module->device = hDevice;
+  module->binary.assign(desc->pInputModule, desc->pInputModule + desc->inputSize);
+  // The native binary of this driver is the SPIR-V itself
+  bool valid = parse_spirv(module->binary, &module->entry_points);
+  if (phBuildLog) {
+    *phBuildLog = new _ze_module_build_log_handle_t();
+    if (!valid) (*phBuildLog)->log = "lzu software driver: input is not a SPIR-V module";
+  }
+  if (!valid) {
+    return desc->format == ZE_MODULE_FORMAT_NATIVE ? ZE_RESULT_ERROR_INVALID_NATIVE_BINARY
+                                                   : ZE_RESULT_ERROR_MODULE_BUILD_FAILURE;
+  }
+  *phModule = module.release();
+  return ZE_RESULT_SUCCESS;
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeModuleDestroy(ze_module_handle_t hModule) {
+  if (hModule == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  delete hModule;
+  return ZE_RESULT_SUCCESS;
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeModuleBuildLogDestroy(ze_module_build_log_handle_t hModuleBuildLog) {
+  if (hModuleBuildLog == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  delete hModuleBuildLog;
+  return ZE_RESULT_SUCCESS;
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeModuleBuildLogGetString(ze_module_build_log_handle_t hModuleBuildLog,
+                                                              size_t* pSize, char* pBuildLog) {
+  if (hModuleBuildLog == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  if (pSize == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_POINTER;
+  const std::string& log = hModuleBuildLog->log;
+  if (pBuildLog) {
+    size_t copied = std::min(*pSize, log.size() + 1);
+    memcpy(pBuildLog, log.c_str(), copied);
+  }
+  *pSize = log.size() + 1;
+  return ZE_RESULT_SUCCESS;
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeModuleGetNativeBinary(ze_module_handle_t hModule, size_t* pSize,
+                                                            uint8_t* pModuleNativeBinary) {
+  if (hModule == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  if (pSize == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_POINTER;
+  if (pModuleNativeBinary) {
+    memcpy(pModuleNativeBinary, hModule->binary.data(), std::min(*pSize, hModule->binary.size()));
+  }
+  *pSize = hModule->binary.size();
+  return ZE_RESULT_SUCCESS;
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeKernelCreate(ze_module_handle_t hModule, const ze_kernel_desc_t* desc,
+                                                   ze_kernel_handle_t* phKernel) {
+  if (hModule == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  if (desc == nullptr || desc->pKernelName == nullptr || phKernel == nullptr) {
+    return ZE_RESULT_ERROR_INVALID_NULL_POINTER;
+  }
+  auto it = hModule->entry_points.find(desc->pKernelName);
+  if (it == hModule->entry_points.end()) return ZE_RESULT_ERROR_INVALID_KERNEL_NAME;
+  ze_kernel_handle_t kernel = new _ze_kernel_handle_t();
+  kernel->module = hModule;
+  kernel->num_arguments = it->second.num_arguments;
+  kernel->invocation.name = it->first;
+  kernel->invocation.arguments.resize(kernel->num_arguments);
+  kernel->function = lzu::software::find_kernel_function(it->first);
+  *phKernel = kernel;
+  return ZE_RESULT_SUCCESS;
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeKernelDestroy(ze_kernel_handle_t hKernel) {
+  if (hKernel == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  delete hKernel;
+  return ZE_RESULT_SUCCESS;
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeKernelSetGroupSize(ze_kernel_handle_t hKernel, uint32_t groupSizeX,
+                                                         uint32_t groupSizeY, uint32_t groupSizeZ) {
+  if (hKernel == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  if (groupSizeX == 0 || groupSizeY == 0 || groupSizeZ == 0 ||
+      uint64_t(groupSizeX) * groupSizeY * groupSizeZ > lzu::software::kMaxTotalGroupSize) {
+    return ZE_RESULT_ERROR_INVALID_GROUP_SIZE_DIMENSION;
+  }
+  hKernel->invocation.group_size = {{groupSizeX, groupSizeY, groupSizeZ}};
+  return ZE_RESULT_SUCCESS;
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeKernelSuggestGroupSize(ze_kernel_handle_t hKernel, uint32_t globalSizeX,
+                                                             uint32_t globalSizeY, uint32_t globalSizeZ,
+                                                             uint32_t* groupSizeX, uint32_t* groupSizeY,
+                                                             uint32_t* groupSizeZ) {
+  if (hKernel == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  if (groupSizeX == nullptr || groupSizeY == nullptr || groupSizeZ == nullptr) {
+    return ZE_RESULT_ERROR_INVALID_NULL_POINTER;
+  }
+  // Largest divisor of each global size that still fits, X first
+  uint32_t budget = lzu::software::kMaxTotalGroupSize;
+  uint32_t* outputs[3] = {groupSizeX, groupSizeY, groupSizeZ};
+  uint32_t globals[3] = {globalSizeX, globalSizeY, globalSizeZ};
+  for (int d = 0; d < 3; d++) {
+    uint32_t size = std::max<uint32_t>(1, std::min(budget, globals[d]));
+    while (size > 1 && globals[d] % size != 0) size--;
+    *outputs[d] = size;
+    budget /= size;
+  }
+  return ZE_RESULT_SUCCESS;
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeKernelSetArgumentValue(ze_kernel_handle_t hKernel, uint32_t argIndex,
+                                                             size_t argSize, const void* pArgValue) {
+  if (hKernel == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  if (argIndex >= hKernel->num_arguments) return ZE_RESULT_ERROR_INVALID_KERNEL_ARGUMENT_INDEX;
+  std::vector<uint8_t>& value = hKernel->invocation.arguments[argIndex];
+  if (pArgValue == nullptr) {
+    value.clear();
+  } else {
+    const uint8_t* bytes = static_cast<const uint8_t*>(pArgValue);
+    value.assign(bytes, bytes + argSize);
+  }
+  return ZE_RESULT_SUCCESS;
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeKernelGetProperties(ze_kernel_handle_t hKernel,
+                                                          ze_kernel_properties_t* pKernelProperties) {
+  if (hKernel == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  if (pKernelProperties == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_POINTER;
+  ze_kernel_properties_t& p = *pKernelProperties;
+  p.numKernelArgs = hKernel->num_arguments;
+  p.requiredGroupSizeX = p.requiredGroupSizeY = p.requiredGroupSizeZ = 0;
+  p.requiredNumSubGroups = 0;
+  p.requiredSubgroupSize = 0;
+  p.maxSubgroupSize = 8;
+  p.maxNumSubgroups = lzu::software::kMaxTotalGroupSize / 8;
+  p.localMemSize = 0;
+  p.privateMemSize = 0;
+  p.spillMemSize = 0;
+  memset(&p.uuid, 0, sizeof(p.uuid));
+  return ZE_RESULT_SUCCESS;
+}
+
+// Command lists
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeCommandListCreate(ze_context_handle_t hContext, ze_device_handle_t hDevice,
+                                                        const ze_command_list_desc_t* desc,
+                                                        ze_command_list_handle_t* phCommandList) {
+  if (hContext == nullptr || hDevice == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  if (desc == nullptr || phCommandList == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_POINTER;
+  if (desc->commandQueueGroupOrdinal >= lzu::software::kQueueGroupCount) return ZE_RESULT_ERROR_INVALID_ARGUMENT;
+  ze_command_list_handle_t list = new _ze_command_list_handle_t();
+  list->context = hContext;
+  list->device = hDevice;
+  list->ordinal = desc->commandQueueGroupOrdinal;
+  *phCommandList = list;
+  return ZE_RESULT_SUCCESS;
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeCommandListDestroy(ze_command_list_handle_t hCommandList) {
+  if (hCommandList == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  delete hCommandList;
+  return ZE_RESULT_SUCCESS;
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeCommandListClose(ze_command_list_handle_t hCommandList) {
+  if (hCommandList == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  hCommandList->closed = true;
+  return ZE_RESULT_SUCCESS;
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeCommandListReset(ze_command_list_handle_t hCommandList) {
+  if (hCommandList == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  hCommandList->commands.clear();
+  hCommandList->closed = false;
+  return ZE_RESULT_SUCCESS;
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeCommandListAppendBarrier(ze_command_list_handle_t hCommandList,
+                                                               ze_event_handle_t hSignalEvent, uint32_t numWaitEvents,
+                                                               ze_event_handle_t* phWaitEvents) {
+  Command command;
+  command.kind = Command::Kind::Barrier;
+  return append(hCommandList, std::move(command), hSignalEvent, numWaitEvents, phWaitEvents);
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeCommandListAppendMemoryCopy(ze_command_list_handle_t hCommandList,
+                                                                  void* dstptr, const void* srcptr, size_t size,
+                                                                  ze_event_handle_t hSignalEvent,
+                                                                  uint32_t numWaitEvents,
+                                                                  ze_event_handle_t* phWaitEvents) {
+  if (dstptr == nullptr || srcptr == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_POINTER;
+  Command command;
+  command.kind = Command::Kind::Copy;
+  command.dst = dstptr;
+  command.src = srcptr;
+  command.size = size;
+  return append(hCommandList, std::move(command), hSignalEvent, numWaitEvents, phWaitEvents);
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeCommandListAppendMemoryPrefetch(ze_command_list_handle_t hCommandList,
+                                                                      const void* /*ptr*/, size_t /*size*/) {
+  // All memory is host memory, there is nothing to migrate
+  return append(hCommandList, Command(), nullptr, 0, nullptr);
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeCommandListAppendMemAdvise(ze_command_list_handle_t hCommandList,
+                                                                 ze_device_handle_t /*hDevice*/, const void* /*ptr*/,
+                                                                 size_t /*size*/, ze_memory_advice_t /*advice*/) {
+  // Advice only steers migration, which host memory never needs
+  return append(hCommandList, Command(), nullptr, 0, nullptr);
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeCommandListAppendLaunchKernel(ze_command_list_handle_t hCommandList,
+                                                                    ze_kernel_handle_t hKernel,
+                                                                    const ze_group_count_t* pLaunchFuncArgs,
+                                                                    ze_event_handle_t hSignalEvent,
+                                                                    uint32_t numWaitEvents,
+                                                                    ze_event_handle_t* phWaitEvents) {
+  if (hKernel == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  if (pLaunchFuncArgs == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_POINTER;
+  if (hCommandList && hCommandList->ordinal != 0) return ZE_RESULT_ERROR_INVALID_COMMAND_LIST_TYPE;
+  if (group_count_total(*pLaunchFuncArgs) == 0) return ZE_RESULT_ERROR_INVALID_ARGUMENT;
+  Command command;
+  command.kind = Command::Kind::Launch;
+  // Arguments are captured at append time like on a real device
+  command.invocation = hKernel->invocation;
+  command.invocation.group_count = *pLaunchFuncArgs;
+  command.function = hKernel->function;
+  return append(hCommandList, std::move(command), hSignalEvent, numWaitEvents, phWaitEvents);
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeCommandListAppendSignalEvent(ze_command_list_handle_t hCommandList,
+                                                                   ze_event_handle_t hEvent) {
+  if (hEvent == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  Command command;
+  command.kind = Command::Kind::Signal;
+  return append(hCommandList, std::move(command), hEvent, 0, nullptr);
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeCommandListAppendWaitOnEvents(ze_command_list_handle_t hCommandList,
+                                                                    uint32_t numEvents, ze_event_handle_t* phEvents) {
+  Command command;
+  command.kind = Command::Kind::Wait;
+  return append(hCommandList, std::move(command), nullptr, numEvents, phEvents);
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeCommandListAppendEventReset(ze_command_list_handle_t hCommandList,
+                                                                  ze_event_handle_t hEvent) {
+  if (hEvent == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  Command command;
+  command.kind = Command::Kind::Reset;
+  return append(hCommandList, std::move(command), hEvent, 0, nullptr);
+}
+
+// Command queues and fences
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeCommandQueueCreate(ze_context_handle_t hContext, ze_device_handle_t hDevice,
+                                                         const ze_command_queue_desc_t* desc,
+                                                         ze_command_queue_handle_t* phCommandQueue) {
+  if (hContext == nullptr || hDevice == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  if (desc == nullptr || phCommandQueue == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_POINTER;
+  if (desc->ordinal >= lzu::software::kQueueGroupCount) return ZE_RESULT_ERROR_INVALID_ARGUMENT;
+  ze_command_queue_handle_t queue = new _ze_command_queue_handle_t();
+  queue->context = hContext;
+  queue->device = hDevice;
+  queue->ordinal = desc->ordinal;
+  queue->worker = std::thread([queue] { queue->run(); });
+  *phCommandQueue = queue;
+  return ZE_RESULT_SUCCESS;
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeCommandQueueDestroy(ze_command_queue_handle_t hCommandQueue) {
+  if (hCommandQueue == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  {
+    // Outstanding work is finished before the worker exits
+    std::lock_guard<std::mutex> lock(hCommandQueue->mutex);
+    hCommandQueue->stop = true;
+    hCommandQueue->work_cv.notify_all();
+  }
+  hCommandQueue->worker.join();
+  delete hCommandQueue;
+  return ZE_RESULT_SUCCESS;
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeCommandQueueExecuteCommandLists(ze_command_queue_handle_t hCommandQueue,
+                                                                      uint32_t numCommandLists,
+                                                                      ze_command_list_handle_t* phCommandLists,
+                                                                      ze_fence_handle_t hFence) {
+  if (hCommandQueue == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  if (numCommandLists == 0 || phCommandLists == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_POINTER;
+  _ze_command_queue_handle_t::Submission submission;
+  for (uint32_t i = 0; i < numCommandLists; i++) {
+    ze_command_list_handle_t list = phCommandLists[i];
+    if (list == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+    if (!list->closed || list->ordinal != hCommandQueue->ordinal) return ZE_RESULT_ERROR_INVALID_ARGUMENT;
+    submission.lists.push_back(list);
+  }
+  submission.fence = hFence;
+  std::lock_guard<std::mutex> lock(hCommandQueue->mutex);
+  hCommandQueue->pending.push_back(submission);
+  hCommandQueue->work_cv.notify_one();
+  return ZE_RESULT_SUCCESS;
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeCommandQueueSynchronize(ze_command_queue_handle_t hCommandQueue,
+                                                              uint64_t timeout) {
+  if (hCommandQueue == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  std::unique_lock<std::mutex> lock(hCommandQueue->mutex);
+  bool idle = wait_for(lock, hCommandQueue->idle_cv, timeout,
+                       [hCommandQueue] { return hCommandQueue->pending.empty() && !hCommandQueue->busy; });
+  return idle ? ZE_RESULT_SUCCESS : ZE_RESULT_NOT_READY;
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeFenceCreate(ze_command_queue_handle_t hCommandQueue, const ze_fence_desc_t* desc,
+                                                  ze_fence_handle_t* phFence) {
+  if (hCommandQueue == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  if (desc == nullptr || phFence == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_POINTER;
+  ze_fence_handle_t fence = new _ze_fence_handle_t();
+  fence->queue = hCommandQueue;
+  fence->signaled = (desc->flags & ZE_FENCE_FLAG_SIGNALED) != 0;
+  *phFence = fence;
+  return ZE_RESULT_SUCCESS;
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeFenceDestroy(ze_fence_handle_t hFence) {
+  if (hFence == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  delete hFence;
+  return ZE_RESULT_SUCCESS;
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeFenceHostSynchronize(ze_fence_handle_t hFence, uint64_t timeout) {
+  if (hFence == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  std::unique_lock<std::mutex> lock(hFence->mutex);
+  return wait_for(lock, hFence->cv, timeout, [hFence] { return hFence->signaled; }) ? ZE_RESULT_SUCCESS
+                                                                                   : ZE_RESULT_NOT_READY;
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeFenceQueryStatus(ze_fence_handle_t hFence) {
+  return zeFenceHostSynchronize(hFence, 0);
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeFenceReset(ze_fence_handle_t hFence) {
+  if (hFence == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  std::lock_guard<std::mutex> lock(hFence->mutex);
+  hFence->signaled = false;
+  return ZE_RESULT_SUCCESS;
+}
+
+// Events
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeEventPoolCreate(ze_context_handle_t hContext, const ze_event_pool_desc_t* desc,
+                                                      uint32_t /*numDevices*/, ze_device_handle_t* /*phDevices*/,
+                                                      ze_event_pool_handle_t* phEventPool) {
+  if (hContext == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  if (desc == nullptr || phEventPool == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_POINTER;
+  if (desc->count == 0) return ZE_RESULT_ERROR_INVALID_SIZE;
+  ze_event_pool_handle_t pool = new _ze_event_pool_handle_t();
+  pool->context = hContext;
+  pool->flags = desc->flags;
+  pool->count = desc->count;
+  *phEventPool = pool;
+  return ZE_RESULT_SUCCESS;
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeEventPoolDestroy(ze_event_pool_handle_t hEventPool) {
+  if (hEventPool == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  delete hEventPool;
+  return ZE_RESULT_SUCCESS;
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeEventCreate(ze_event_pool_handle_t hEventPool, const ze_event_desc_t* desc,
+                                                  ze_event_handle_t* phEvent) {
+  if (hEventPool == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  if (desc == nullptr || phEvent == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_POINTER;
+  if (desc->index >= hEventPool->count) return ZE_RESULT_ERROR_INVALID_ARGUMENT;
+  ze_event_handle_t event = new _ze_event_handle_t();
+  event->pool = hEventPool;
+  event->index = desc->index;
+  *phEvent = event;
+  return ZE_RESULT_SUCCESS;
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeEventDestroy(ze_event_handle_t hEvent) {
+  if (hEvent == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  delete hEvent;
+  return ZE_RESULT_SUCCESS;
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeEventHostSignal(ze_event_handle_t hEvent) {
+  if (hEvent == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  uint64_t now = now_ns();
+  hEvent->signal(now, now);
+  return ZE_RESULT_SUCCESS;
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeEventHostSynchronize(ze_event_handle_t hEvent, uint64_t timeout) {
+  if (hEvent == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  return hEvent->wait(timeout) ? ZE_RESULT_SUCCESS : ZE_RESULT_NOT_READY;
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeEventQueryStatus(ze_event_handle_t hEvent) {
+  return zeEventHostSynchronize(hEvent, 0);
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeEventHostReset(ze_event_handle_t hEvent) {
+  if (hEvent == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  hEvent->reset();
+  return ZE_RESULT_SUCCESS;
+}
+
+ZE_APIEXPORT ze_result_t ZE_APICALL zeEventQueryKernelTimestamp(ze_event_handle_t hEvent,
+                                                                ze_kernel_timestamp_result_t* dstptr) {
+  if (hEvent == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_HANDLE;
+  if (dstptr == nullptr) return ZE_RESULT_ERROR_INVALID_NULL_POINTER;
+  if (!(hEvent->pool->flags & ZE_EVENT_POOL_FLAG_KERNEL_TIMESTAMP)) return ZE_RESULT_ERROR_INVALID_ARGUMENT;
+  std::lock_guard<std::mutex> lock(hEvent->mutex);
+  if (!hEvent->signaled) return ZE_RESULT_NOT_READY;
+  dstptr->global.kernelStart = dstptr->context.kernelStart = hEvent->start;
+  dstptr->global.kernelEnd = dstptr->context.kernelEnd = hEvent->end;
+  return ZE_RESULT_SUCCESS;
+}
@@ -0,0 +1,1188 @@
+// Copyright 2020 Intel Corporation
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "level_zero_async.hpp"
+#include "level_zero_copy.hpp"
+#include "level_zero_device_registry.hpp"
+#include "level_zero_executor.hpp"
+#include "level_zero_migration.hpp"
+#include "level_zero_module_builder.hpp"
+#include "level_zero_module_variants.hpp"
+#include "level_zero_offload.hpp"
+#include "level_zero_profiler.hpp"
+#include "level_zero_queues.hpp"
+#include "level_zero_recording.hpp"
+#include "level_zero_ring.hpp"
+#include "level_zero_stream.hpp"
+#include "level_zero_submission.hpp"
+#include "level_zero_utils.hpp"
+
+// Microbenchmarks of the wrapper and the driver underneath it. Results go to stdout, or --output, as JSON.
+//
+//   level_zero_benchmark [--output FILE] [--repetitions N] [--min-size BYTES] [--max-size BYTES] [--max-threads N]
+
+namespace {
+
+// An OpenCL kernel with no arguments and an empty body, assembled by hand so the benchmark needs no kernel file:
+//   OpCapability Addresses, OpCapability Kernel, OpMemoryModel Physical64 OpenCL,
+//   OpEntryPoint Kernel %1 "empty", %2 = OpTypeVoid, %3 = OpTypeFunction %2,
+//   %1 = OpFunction %2 None %3, %4 = OpLabel, OpReturn, OpFunctionEnd
+const uint32_t kEmptyKernelSpirv[] = {
+    0x07230203, 0x00010000, 0, 5, 0,           // Header, id bound 5
+    0x00020011, 4,                             // OpCapability Addresses
+    0x00020011, 6,                             // OpCapability Kernel
+    0x0003000e, 2, 2,                          // OpMemoryModel Physical64 OpenCL
+    0x0005000f, 6, 1, 0x74706d65, 0x00000079,  // OpEntryPoint Kernel %1 "empty"
+    0x00020013, 2,                             // OpTypeVoid
+    0x00030021, 3, 2,                          // OpTypeFunction
+    0x00050036, 2, 1, 0, 3,                    // OpFunction
+    0x000200f8, 4,                             // OpLabel
+    0x000100fd,                                // OpReturn
+    0x00010038,                                // OpFunctionEnd
+};
+
+typedef std::chrono::steady_clock Clock;
+
+double elapsed_ns(Clock::time_point start) {
+  return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+struct Statistics {
+  size_t samples = 0;
+  double mean = 0;
+  double median = 0;
+  double min = 0;
+  double max = 0;
+  double stddev = 0;
+};
+
+Statistics summarize(std::vector<double> samples) {
+  Statistics s;
+  if (samples.empty()) return s;
+  std::sort(samples.begin(), samples.end());
+  s.samples = samples.size();
+  s.min = samples.front();
+  s.max = samples.back();
+  size_t middle = samples.size() / 2;
+  s.median = (samples.size() % 2) ? samples[middle] : (samples[middle - 1] + samples[middle]) / 2;
+  for (auto sample : samples) s.mean += sample;
+  s.mean /= samples.size();
+  for (auto sample : samples) s.stddev += (sample - s.mean) * (sample - s.mean);
+  s.stddev = samples.size() > 1 ? std::sqrt(s.stddev / (samples.size() - 1)) : 0;
+  return s;
+}
+
+std::string json(const Statistics& s) {
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(1) << "{\"samples\":" << s.samples << ",\"mean\":" << s.mean
+      << ",\"median\":" << s.median << ",\"min\":" << s.min << ",\"max\":" << s.max << ",\"stddev\":" << s.stddev
+      << "}";
+  return out.str();
+}
+
+const char* memory_name(ze_memory_type_t type) {
+  switch (type) {
+    case ZE_MEMORY_TYPE_HOST:
+      return "host";
+    case ZE_MEMORY_TYPE_DEVICE:
+      return "device";
+    case ZE_MEMORY_TYPE_SHARED:
+      return "shared";
+    default:
+      return "unknown";
+  }
+}
+
+struct Options {
+  std::string output;
+  uint32_t repetitions = 10;
+  uint32_t warmup = 2;
+  size_t min_size = 64;
+  size_t max_size = size_t(1) << 30;
+  uint32_t max_threads = std::min(16u, std::max(1u, std::thread::hardware_concurrency()));
+  std::string copy_module = "copy_module.spv";
+};
+
+// A queue and a command list on one engine, with one timestamp event
+class Engine {
+ public:
+  Engine(ze_context_handle_t context, ze_device_handle_t device, uint32_t ordinal, const char* name,
+         lzu::zeEventPool* events)
+      : name_(name), events_(events) {
+    queue_ = lzu::create_command_queue(context, device, 0, ZE_COMMAND_QUEUE_MODE_DEFAULT,
+                                       ZE_COMMAND_QUEUE_PRIORITY_NORMAL, ordinal, 0);
+    list_ = lzu::create_command_list(context, device, 0, ordinal);
+    events_->create_event(&event_);
+  }
+
+  ~Engine() {
+    try {
+      events_->destroy_event(event_);
+      lzu::destroy_command_list(list_);
+      lzu::destroy_command_queue(queue_);
+    } catch (std::exception& e) {
+      std::cout << "Failed to destroy benchmark engine: " << e.what() << std::endl;
+    }
+  }
+
+  const char* name() const { return name_; }
+  ze_command_list_handle_t list() const { return list_; }
+  ze_event_handle_t event() const { return event_; }
+
+  // One sample: submit the closed list and wait for it
+  void run_once() {
+    zeEventHostReset(event_);
+    lzu::execute_command_lists(queue_, 1, &list_, nullptr);
+    lzu::synchronize(queue_, UINT64_MAX);
+  }
+
+  ze_command_queue_handle_t queue() const { return queue_; }
+
+ private:
+  const char* name_;
+  lzu::zeEventPool* events_;
+  ze_command_queue_handle_t queue_ = nullptr;
+  ze_command_list_handle_t list_ = nullptr;
+  ze_event_handle_t event_ = nullptr;
+};
+
+class Benchmark {
+ public:
+  Benchmark(ze_context_handle_t context, ze_device_handle_t device, const Options& options)
+      : context_(context), device_(device), options_(options), converter_(lzu::get_device_properties(device)) {
+    events_.InitEventPool(context, 16);
+    lzu::QueueGroups groups = lzu::discover_queue_groups(device);
+    engines_.emplace_back(new Engine(context, device, groups.compute_ordinal, "compute", &events_));
+    if (groups.has_copy_engine) {
+      engines_.emplace_back(new Engine(context, device, groups.copy_ordinal, "copy", &events_));
+    }
+  }
+
+  void copies();
+  void launch_latency();
+  void event_cost();
+  void submission_throughput();
+  void concurrent_submission();
+  void async_completion();
+  void ring_pipelining();
+  void streaming();
+  void batched_copy();
+  void offload_policy();
+  void module_build();
+  void module_variants();
+  void shared_prefetch();
+  void copy_kernels();
+  void multi_device();
+  void recording_replay();
+
+  std::string results() const {
+    std::ostringstream out;
+    for (size_t i = 0; i < results_.size(); i++) out << (i ? ",\n    " : "\n    ") << results_[i];
+    return out.str();
+  }
+
+ private:
+  // Repeat one sample, dropping the warmup runs
+  template <typename F>
+  std::vector<double> repeat(F sample) {
+    std::vector<double> samples;
+    for (uint32_t i = 0; i < options_.warmup + options_.repetitions; i++) {
+      measuring_ = i >= options_.warmup;
+      double value = sample();
+      if (measuring_) samples.push_back(value);
+    }
+    return samples;
+  }
+
+  // Submit the engine's list and return host round-trip ns, collecting device ns on the side
+  double timed_run(Engine& engine, std::vector<double>* device_samples) {
+    Clock::time_point start = Clock::now();
+    engine.run_once();
+    double host = elapsed_ns(start);
+    ze_kernel_timestamp_result_t timestamp = {};
+    if (measuring_ && zeEventQueryKernelTimestamp(engine.event(), &timestamp) == ZE_RESULT_SUCCESS) {
+      device_samples->push_back(converter_.elapsed_ns(timestamp.global.kernelStart, timestamp.global.kernelEnd));
+    }
+    return host;
+  }
+
+  void* allocate(ze_memory_type_t type, size_t size) {
+    switch (type) {
+      case ZE_MEMORY_TYPE_HOST:
+        return lzu::allocate_host_memory(size, 64, context_);
+      case ZE_MEMORY_TYPE_DEVICE:
+        return lzu::allocate_device_memory(size, 64, 0, 0, device_, context_);
+      default:
+        return lzu::allocate_shared_memory(size, 64, 0, 0, device_, context_);
+    }
+  }
+
+  ze_context_handle_t context_;
+  ze_device_handle_t device_;
+  Options options_;
+  lzu::TimestampConverter converter_;
+  lzu::zeEventPool events_;
+  std::vector<std::unique_ptr<Engine>> engines_;
+  std::vector<std::string> results_;
+  bool measuring_ = false;  // False during warmup runs
+};
+
+void Benchmark::copies() {
+  const ze_memory_type_t types[] = {ZE_MEMORY_TYPE_HOST, ZE_MEMORY_TYPE_DEVICE, ZE_MEMORY_TYPE_SHARED};
+  for (size_t size = options_.min_size; size <= options_.max_size; size *= 4) {
+    for (auto src_type : types) {
+      for (auto dst_type : types) {
+        void* src = nullptr;
+        void* dst = nullptr;
+        try {
+          src = allocate(src_type, size);
+          dst = allocate(dst_type, size);
+        } catch (std::exception& e) {
+          // Large device or shared allocations may not fit, the other pairs and sizes still run
+          std::cerr << "Skipping " << size << " byte " << memory_name(src_type) << " to " << memory_name(dst_type)
+                    << " copies: " << e.what() << std::endl;
+          if (src) lzu::free_memory(context_, src);
+          std::ostringstream out;
+          out << "{\"benchmark\":\"copy\",\"src\":\"" << memory_name(src_type) << "\",\"dst\":\""
+              << memory_name(dst_type) << "\",\"bytes\":" << size << ",\"skipped\":true}";
+          results_.push_back(out.str());
+          continue;
+        }
+        for (auto& engine : engines_) {
+          lzu::reset_command_list(engine->list());
+          lzu::append_memory_copy(engine->list(), dst, src, size, engine->event(), 0, nullptr);
+          lzu::close_command_list(engine->list());
+          std::vector<double> device;
+          std::vector<double> host = repeat([&] { return timed_run(*engine, &device); });
+          Statistics device_stats = summarize(device);
+          std::ostringstream out;
+          out << std::fixed << std::setprecision(3) << "{\"benchmark\":\"copy\",\"src\":\"" << memory_name(src_type)
+              << "\",\"dst\":\"" << memory_name(dst_type) << "\",\"engine\":\"" << engine->name()
+              << "\",\"bytes\":" << size << ",\"host_ns\":" << json(summarize(host))
+              << ",\"device_ns\":" << json(device_stats) << ",\"gb_per_s\":"
+              << (device_stats.median > 0 ? size / device_stats.median : 0) << "}";
+          results_.push_back(out.str());
+        }
+        lzu::free_memory(context_, src);
+        lzu::free_memory(context_, dst);
+      }
+    }
+  }
+}
+
+void Benchmark::launch_latency() {
+  const uint8_t* spirv = reinterpret_cast<const uint8_t*>(kEmptyKernelSpirv);
+  ze_module_handle_t module =
+      lzu::create_module(context_, device_, spirv, sizeof(kEmptyKernelSpirv), ZE_MODULE_FORMAT_IL_SPIRV, "", nullptr);
+  ze_kernel_handle_t kernel = lzu::create_function(module, 0, "empty");
+  lzu::set_group_size(kernel, 1, 1, 1);
+  ze_group_count_t group_count = {1, 1, 1};
+  Engine& engine = *engines_.front();
+
+  // Host cost of appending alone, per launch
+  const uint32_t kAppends = 1000;
+  std::vector<double> append = repeat([&] {
+    lzu::reset_command_list(engine.list());
+    Clock::time_point start = Clock::now();
+    for (uint32_t i = 0; i < kAppends; i++) {
+      lzu::append_launch_function(engine.list(), kernel, &group_count, nullptr, 0, nullptr);
+    }
+    return elapsed_ns(start) / kAppends;
+  });
+
+  // Submit and wait for a single launch
+  lzu::reset_command_list(engine.list());
+  lzu::append_launch_function(engine.list(), kernel, &group_count, engine.event(), 0, nullptr);
+  lzu::close_command_list(engine.list());
+  std::vector<double> device;
+  std::vector<double> round_trip = repeat([&] { return timed_run(engine, &device); });
+
+  std::ostringstream out;
+  out << "{\"benchmark\":\"empty_kernel_launch\",\"engine\":\"" << engine.name()
+      << "\",\"append_ns\":" << json(summarize(append)) << ",\"round_trip_ns\":" << json(summarize(round_trip))
+      << ",\"device_ns\":" << json(summarize(device)) << "}";
+  results_.push_back(out.str());
+
+  lzu::destroy_function(kernel);
+  lzu::destroy_module(module);
+}
+
+void Benchmark::event_cost() {
+  const uint32_t kEvents = 1000;
+  std::vector<ze_event_handle_t> events(kEvents);
+
+  // A fresh pool has to grow to fit every event
+  std::vector<double> cold = repeat([&] {
+    lzu::zeEventPool pool;
+    pool.InitEventPool(context_, 1);
+    Clock::time_point start = Clock::now();
+    for (auto& event : events) pool.create_event(&event);
+    for (auto event : events) pool.destroy_event(event);
+    return elapsed_ns(start) / kEvents;
+  });
+
+  // A warm pool recycles the events it already has
+  lzu::zeEventPool pool;
+  pool.InitEventPool(context_, kEvents);
+  std::vector<double> warm = repeat([&] {
+    Clock::time_point start = Clock::now();
+    for (auto& event : events) pool.create_event(&event);
+    for (auto event : events) pool.destroy_event(event);
+    return elapsed_ns(start) / kEvents;
+  });
+
+  std::ostringstream out;
+  out << "{\"benchmark\":\"event_create_destroy\",\"events\":" << kEvents << ",\"cold_ns\":" << json(summarize(cold))
+      << ",\"warm_ns\":" << json(summarize(warm)) << "}";
+  results_.push_back(out.str());
+}
+
+void Benchmark::submission_throughput() {
+  const uint32_t kSubmissions = 100;
+  for (auto& engine : engines_) {
+    lzu::reset_command_list(engine->list());
+    lzu::append_barrier(engine->list(), nullptr, 0, nullptr);
+    lzu::close_command_list(engine->list());
+
+    // Wait after every submission
+    std::vector<double> synchronous = repeat([&] {
+      Clock::time_point start = Clock::now();
+      for (uint32_t i = 0; i < kSubmissions; i++) {
+        ze_command_list_handle_t list = engine->list();
+        lzu::execute_command_lists(engine->queue(), 1, &list, nullptr);
+        lzu::synchronize(engine->queue(), UINT64_MAX);
+      }
+      return elapsed_ns(start) / kSubmissions;
+    });
+
+    // Wait once after all of them
+    std::vector<double> pipelined = repeat([&] {
+      Clock::time_point start = Clock::now();
+      for (uint32_t i = 0; i < kSubmissions; i++) {
+        ze_command_list_handle_t list = engine->list();
+        lzu::execute_command_lists(engine->queue(), 1, &list, nullptr);
+      }
+      lzu::synchronize(engine->queue(), UINT64_MAX);
+      return elapsed_ns(start) / kSubmissions;
+    });
+
+    Statistics sync_stats = summarize(synchronous);
+    Statistics pipe_stats = summarize(pipelined);
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1) << "{\"benchmark\":\"execute_synchronize\",\"engine\":\""
+        << engine->name() << "\",\"submissions\":" << kSubmissions << ",\"synchronous_ns\":" << json(sync_stats)
+        << ",\"pipelined_ns\":" << json(pipe_stats) << ",\"synchronous_per_s\":"
+        << (sync_stats.median > 0 ? 1e9 / sync_stats.median : 0)
+        << ",\"pipelined_per_s\":" << (pipe_stats.median > 0 ? 1e9 / pipe_stats.median : 0) << "}";
+    results_.push_back(out.str());
+  }
+}
+
+// Request threads that each record a list, submit it and wait for it, the way a service handles requests. "merged"
+// goes through ConcurrentSubmitter, which batches the lists of all threads into one execute call. "locked" is the
+// naive alternative: every thread executes its own list and synchronizes the queue under a global lock.
+void Benchmark::concurrent_submission() {
+  const uint32_t kPerThread = 200;
+  const uint32_t ordinal = lzu::discover_queue_groups(device_).compute_ordinal;
+  for (uint32_t threads = 1; threads <= options_.max_threads; threads *= 2) {
+    lzu::ShardedEventPool events(context_, threads);
+
+    lzu::ConcurrentSubmitter submitter(context_, device_, ordinal);
+    std::vector<double> merged = repeat([&] {
+      Clock::time_point start = Clock::now();
+      std::vector<std::thread> workers;
+      for (uint32_t t = 0; t < threads; t++) {
+        workers.emplace_back([&] {
+          for (uint32_t i = 0; i < kPerThread; i++) {
+            lzu::ShardedEventPool::Event event = events.create_event();
+            lzu::append_barrier(submitter.command_list(), event.handle, 0, nullptr);
+            submitter.wait(submitter.submit());
+            events.destroy_event(event);
+          }
+        });
+      }
+      for (auto& worker : workers) worker.join();
+      return elapsed_ns(start) / (threads * kPerThread);
+    });
+    lzu::SubmitterStats stats = submitter.get_stats();
+
+    ze_command_queue_handle_t queue = lzu::create_command_queue(
+        context_, device_, 0, ZE_COMMAND_QUEUE_MODE_DEFAULT, ZE_COMMAND_QUEUE_PRIORITY_NORMAL, ordinal, 0);
+    std::mutex queue_mutex;
+    std::vector<double> locked = repeat([&] {
+      Clock::time_point start = Clock::now();
+      std::vector<std::thread> workers;
+      for (uint32_t t = 0; t < threads; t++) {
+        workers.emplace_back([&] {
+          ze_command_list_handle_t list = lzu::create_command_list(context_, device_, 0, ordinal);
+          for (uint32_t i = 0; i < kPerThread; i++) {
+            lzu::ShardedEventPool::Event event = events.create_event();
+            lzu::reset_command_list(list);
+            lzu::append_barrier(list, event.handle, 0, nullptr);
+            lzu::close_command_list(list);
+            {
+              std::lock_guard<std::mutex> lock(queue_mutex);
+              lzu::execute_command_lists(queue, 1, &list, nullptr);
+              lzu::synchronize(queue, UINT64_MAX);
+            }
+            events.destroy_event(event);
+          }
+          lzu::destroy_command_list(list);
+        });
+      }
+      for (auto& worker : workers) worker.join();
+      return elapsed_ns(start) / (threads * kPerThread);
+    });
+    lzu::destroy_command_queue(queue);
+
+    Statistics merged_stats = summarize(merged);
+    Statistics locked_stats = summarize(locked);
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1) << "{\"benchmark\":\"concurrent_submission\",\"threads\":" << threads
+        << ",\"submissions_per_thread\":" << kPerThread << ",\"merged_ns\":" << json(merged_stats)
+        << ",\"locked_ns\":" << json(locked_stats)
+        << ",\"merged_per_s\":" << (merged_stats.median > 0 ? 1e9 / merged_stats.median : 0)
+        << ",\"locked_per_s\":" << (locked_stats.median > 0 ? 1e9 / locked_stats.median : 0)
+        << ",\"lists_per_batch\":" << stats.lists_per_batch() << ",\"largest_batch\":" << stats.largest_batch
+        << ",\"lists_created\":" << stats.lists_created << "}";
+    results_.push_back(out.str());
+  }
+}
+
+// One host thread keeps up to kMaxInFlight submissions in flight. "blocking" waits on each submission's event before
+// the next one, "reactor" submits all of them and collects completions as futures from the completion reactor.
+void Benchmark::async_completion() {
+  const uint32_t kMaxInFlight = 256;
+  const uint32_t ordinal = lzu::discover_queue_groups(device_).compute_ordinal;
+  ze_command_queue_handle_t queue = lzu::create_command_queue(context_, device_, 0, ZE_COMMAND_QUEUE_MODE_ASYNCHRONOUS,
+                                                              ZE_COMMAND_QUEUE_PRIORITY_NORMAL, ordinal, 0);
+  lzu::zeEventPool pool;
+  pool.InitEventPool(context_, kMaxInFlight);
+  std::vector<ze_event_handle_t> events(kMaxInFlight);
+  std::vector<ze_command_list_handle_t> lists(kMaxInFlight);
+  for (uint32_t i = 0; i < kMaxInFlight; i++) {
+    pool.create_event(&events[i]);
+    lists[i] = lzu::create_command_list(context_, device_, 0, ordinal);
+    lzu::append_barrier(lists[i], events[i], 0, nullptr);
+    lzu::close_command_list(lists[i]);
+  }
+
+  lzu::CompletionReactor& reactor = lzu::CompletionReactor::get();
+  for (uint32_t in_flight = 1; in_flight <= kMaxInFlight; in_flight *= 4) {
+    std::vector<double> blocking = repeat([&] {
+      Clock::time_point start = Clock::now();
+      for (uint32_t i = 0; i < in_flight; i++) {
+        zeEventHostReset(events[i]);
+        lzu::execute_command_lists(queue, 1, &lists[i], nullptr);
+        zeEventHostSynchronize(events[i], UINT64_MAX);
+      }
+      return elapsed_ns(start) / in_flight;
+    });
+
+    std::vector<double> reactor_ns = repeat([&] {
+      Clock::time_point start = Clock::now();
+      std::vector<std::future<void>> done;
+      for (uint32_t i = 0; i < in_flight; i++) {
+        zeEventHostReset(events[i]);
+        lzu::execute_command_lists(queue, 1, &lists[i], nullptr);
+        done.push_back(reactor.when_event(events[i]));
+      }
+      for (auto& future : done) future.get();
+      return elapsed_ns(start) / in_flight;
+    });
+
+    std::ostringstream out;
+    out << "{\"benchmark\":\"async_completion\",\"in_flight\":" << in_flight
+        << ",\"blocking_ns\":" << json(summarize(blocking)) << ",\"reactor_ns\":" << json(summarize(reactor_ns))
+        << "}";
+    results_.push_back(out.str());
+  }
+
+  for (uint32_t i = 0; i < kMaxInFlight; i++) {
+    lzu::destroy_command_list(lists[i]);
+    pool.destroy_event(events[i]);
+  }
+  lzu::destroy_command_queue(queue);
+}
+
+// Batches of one 1 MB copy recorded and submitted through a SubmissionRing. Depth 1 is the old execute, synchronize,
+// reuse cycle, deeper rings let the host record while earlier batches run.
+void Benchmark::ring_pipelining() {
+  const uint32_t kBatches = 200;
+  const size_t kBytes = 1 << 20;
+  const uint32_t ordinal = lzu::discover_queue_groups(device_).compute_ordinal;
+  void* src = allocate(ZE_MEMORY_TYPE_HOST, kBytes);
+  void* dst = allocate(ZE_MEMORY_TYPE_DEVICE, kBytes);
+  for (uint32_t depth = 1; depth <= 4; depth++) {
+    lzu::SubmissionRing ring(context_, device_, ordinal, depth);
+    std::vector<double> batch = repeat([&] {
+      Clock::time_point start = Clock::now();
+      for (uint32_t i = 0; i < kBatches; i++) {
+        lzu::append_memory_copy(ring.acquire(), dst, src, kBytes, nullptr, 0, nullptr);
+        ring.submit();
+      }
+      ring.wait_all();
+      return elapsed_ns(start) / kBatches;
+    });
+
+    const lzu::RingStats& stats = ring.stats();
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3) << "{\"benchmark\":\"ring_pipelining\",\"depth\":" << depth
+        << ",\"bytes\":" << kBytes << ",\"batch_ns\":" << json(summarize(batch))
+        << ",\"stalls\":" << stats.stalls << ",\"stall_ms\":" << stats.stall_ms
+        << ",\"mean_occupancy\":" << stats.mean_occupancy() << ",\"max_occupancy\":" << stats.max_occupancy << "}";
+    results_.push_back(out.str());
+  }
+  lzu::free_memory(context_, src);
+  lzu::free_memory(context_, dst);
+}
+
+// 32 MB streamed through a StreamingPipeline with a device-side copy standing in for the kernel, for double and
+// triple buffering at a few chunk sizes. The output is checked against the input.
+void Benchmark::streaming() {
+  const size_t kTotal = 32 << 20;
+  std::vector<uint8_t> input(kTotal);
+  for (size_t i = 0; i < kTotal; i++) input[i] = static_cast<uint8_t>(i * 131 + 7);
+  lzu::ChunkKernel kernel = [](ze_command_list_handle_t list, const void* in, void* out, size_t bytes) {
+    lzu::append_memory_copy(list, out, in, bytes, nullptr, 0, nullptr);
+    return bytes;
+  };
+
+  for (size_t chunk : {size_t(1) << 20, size_t(4) << 20, size_t(16) << 20}) {
+    for (uint32_t buffers = 2; buffers <= 3; buffers++) {
+      lzu::StreamOptions stream_options;
+      stream_options.chunk_bytes = chunk;
+      stream_options.buffers = buffers;
+      lzu::StreamingPipeline pipeline(context_, device_, stream_options);
+      lzu::StreamStats stats;
+      bool matches = true;
+      std::vector<double> total = repeat([&] {
+        std::vector<uint8_t> output;
+        output.reserve(kTotal);
+        Clock::time_point start = Clock::now();
+        stats = pipeline.run(lzu::memory_source(input.data(), kTotal), kernel, lzu::memory_sink(&output));
+        double ns = elapsed_ns(start);
+        matches = matches && output == input;
+        return ns;
+      });
+
+      Statistics s = summarize(total);
+      std::ostringstream out;
+      out << std::fixed << std::setprecision(3) << "{\"benchmark\":\"streaming\",\"bytes\":" << kTotal
+          << ",\"chunk_bytes\":" << chunk << ",\"buffers\":" << buffers
+          << ",\"copy_engine\":" << (pipeline.has_copy_engine() ? "true" : "false") << ",\"total_ns\":" << json(s)
+          << ",\"mb_per_s\":" << (s.median > 0 ? kTotal / (s.median / 1e9) / 1e6 : 0)
+          << ",\"chunks\":" << stats.chunks << ",\"stall_ms\":" << stats.stall_ms
+          << ",\"matches\":" << (matches ? "true" : "false") << "}";
+      results_.push_back(out.str());
+    }
+  }
+}
+
+// 72-byte copies between separate host allocations, the shape of the uploads and readbacks in main.cpp, appended
+// with one command and event each and as one batch. The batch runs through copy_module when it can be loaded and as
+// driver copies otherwise.
+void Benchmark::batched_copy() {
+  const size_t kBytes = 72;
+  ze_module_handle_t module = nullptr;
+  try {
+    lzu::BinaryView binary = lzu::map_binary_file(options_.copy_module);
+    module = lzu::create_module(context_, device_, binary.data(), binary.size(), ZE_MODULE_FORMAT_IL_SPIRV, "",
+                                nullptr);
+  } catch (std::exception& e) {
+    module = nullptr;
+  }
+
+  {
+    // Every pointer below is a host allocation, the per-pointer check is skipped
+    lzu::BatchCopier copier(context_, device_, module, /*check_pointers*/ false);
+    for (uint32_t count : {1u, 3u, 8u, 32u, 128u}) {
+      std::vector<lzu::CopyDescriptor> copies;
+      for (uint32_t i = 0; i < count; i++) {
+        void* src = allocate(ZE_MEMORY_TYPE_HOST, kBytes);
+        void* dst = allocate(ZE_MEMORY_TYPE_HOST, kBytes);
+        copies.push_back(lzu::CopyDescriptor{dst, src, kBytes});
+      }
+      lzu::BatchCopyReport report = copier.compare(copies, options_.repetitions);
+      for (auto& copy : copies) {
+        lzu::free_memory(context_, copy.dst);
+        lzu::free_memory(context_, const_cast<void*>(copy.src));
+      }
+
+      std::ostringstream out;
+      out << std::fixed << std::setprecision(1) << "{\"benchmark\":\"batched_copy\",\"copies\":" << count
+          << ",\"bytes\":" << report.bytes << ",\"method\":\"" << lzu::to_string(report.method)
+          << "\",\"individual_ns\":" << report.individual_ns << ",\"batched_ns\":" << report.batched_ns
+          << ",\"speedup\":" << std::setprecision(2) << report.speedup()
+          << ",\"pays_off\":" << (report.pays_off() ? "true" : "false") << "}";
+      results_.push_back(out.str());
+    }
+  }
+  if (module) lzu::destroy_module(module);
+}
+
+// Copies between host allocations from 64 B to 4 MB, each timed on the host thread pool, as a device round trip and
+// through an OffloadPolicy calibrated for this device. "correct" says whether the policy picked the faster side.
+void Benchmark::offload_policy() {
+  const uint32_t ordinal = lzu::discover_queue_groups(device_).compute_ordinal;
+  lzu::ThreadPool& pool = lzu::ThreadPool::get();
+  lzu::OffloadPolicy policy(context_, device_, lzu::calibrate_offload(context_, device_, &pool), &pool);
+  ze_command_queue_handle_t queue = lzu::create_command_queue(context_, device_, 0, ZE_COMMAND_QUEUE_MODE_DEFAULT,
+                                                              ZE_COMMAND_QUEUE_PRIORITY_NORMAL, ordinal, 0);
+  ze_command_list_handle_t list = lzu::create_command_list(context_, device_, 0, ordinal);
+
+  for (size_t size = 64; size <= (size_t(4) << 20); size *= 16) {
+    uint8_t* src = static_cast<uint8_t*>(allocate(ZE_MEMORY_TYPE_HOST, size));
+    uint8_t* dst = static_cast<uint8_t*>(allocate(ZE_MEMORY_TYPE_HOST, size));
+    // Untouched pages all map the zero page, reading them would never leave the cache
+    memset(src, 1, size);
+    memset(dst, 0, size);
+    // append() returns whether it put anything on the list
+    auto round_trip = [&](const std::function<bool()>& append) {
+      return repeat([&] {
+        Clock::time_point start = Clock::now();
+        lzu::reset_command_list(list);
+        policy.reset(list);
+        if (append()) {
+          lzu::close_command_list(list);
+          lzu::execute_command_lists(queue, 1, &list, nullptr);
+          lzu::synchronize(queue, UINT64_MAX);
+        }
+        return elapsed_ns(start);
+      });
+    };
+    Statistics host = summarize(repeat([&] {
+      Clock::time_point start = Clock::now();
+      pool.parallel_for(size, [&](size_t begin, size_t end) { memcpy(dst + begin, src + begin, end - begin); },
+                        256 << 10);
+      return elapsed_ns(start);
+    }));
+    Statistics device =
+        summarize(round_trip([&] {
+          lzu::append_memory_copy(list, dst, src, size, nullptr, 0, nullptr);
+          return true;
+        }));
+    lzu::OffloadTarget target = lzu::OffloadTarget::Device;
+    Statistics chosen = summarize(round_trip([&] {
+      target = policy.copy(list, dst, src, size);
+      return target == lzu::OffloadTarget::Device;
+    }));
+    const lzu::OffloadTarget faster = host.median < device.median ? lzu::OffloadTarget::Host
+                                                                   : lzu::OffloadTarget::Device;
+    lzu::free_memory(context_, src);
+    lzu::free_memory(context_, dst);
+
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1) << "{\"benchmark\":\"offload_policy\",\"bytes\":" << size
+        << ",\"host_ns\":" << host.median << ",\"device_ns\":" << device.median << ",\"policy_ns\":" << chosen.median
+        << ",\"predicted_host_ns\":" << policy.host_cost(lzu::OffloadKind::Copy, size)
+        << ",\"predicted_device_ns\":" << policy.device_cost(lzu::OffloadKind::Copy, size, false)
+        << ",\"decision\":\"" << lzu::to_string(target) << "\",\"correct\":" << (target == faster ? "true" : "false")
+        << "}";
+    results_.push_back(out.str());
+  }
+  lzu::destroy_command_list(list);
+  lzu::destroy_command_queue(queue);
+}
+
+// Builds of 16 copies of --copy-module one after another and through a ModuleBuilder, with the module cache out of
+// the way, plus one rejected binary whose build log has to come back.
+void Benchmark::module_build() {
+  const uint32_t kModules = 16;
+  lzu::BinaryView binary = lzu::map_binary_file(options_.copy_module);
+  if (binary.empty()) return;
+  const uint32_t kInvalid = 0xdeadbeef;
+
+  Statistics serial = summarize(repeat([&] {
+    Clock::time_point start = Clock::now();
+    std::vector<ze_module_handle_t> modules;
+    for (uint32_t i = 0; i < kModules; i++) {
+      modules.push_back(lzu::create_module(context_, device_, binary.data(), binary.size(), ZE_MODULE_FORMAT_IL_SPIRV,
+                                           "", nullptr));
+    }
+    double ns = elapsed_ns(start);
+    for (auto module : modules) lzu::destroy_module(module);
+    return ns;
+  }));
+
+  bool log_collected = false;
+  Statistics parallel = summarize(repeat([&] {
+    Clock::time_point start = Clock::now();
+    lzu::ModuleBuilder builder(context_, &lzu::ThreadPool::get(), nullptr);
+    std::vector<lzu::ModuleBuildRequest> requests(kModules + 1);
+    for (uint32_t i = 0; i < requests.size(); i++) {
+      requests[i].name = "module_" + std::to_string(i);
+      requests[i].device = device_;
+      requests[i].data = i < kModules ? binary.data() : reinterpret_cast<const uint8_t*>(&kInvalid);
+      requests[i].bytes = i < kModules ? binary.size() : sizeof(kInvalid);
+    }
+    builder.submit(requests);
+    std::vector<lzu::ModuleBuildError> failures = builder.wait_all();
+    double ns = elapsed_ns(start);
+    log_collected = failures.size() == 1 && !failures[0].build_log().empty();
+    return ns;
+  }));
+
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(1) << "{\"benchmark\":\"module_build\",\"modules\":" << kModules
+      << ",\"threads\":" << lzu::ThreadPool::get().size() << ",\"serial_ns\":" << json(serial)
+      << ",\"parallel_ns\":" << json(parallel) << ",\"speedup\":" << std::setprecision(2)
+      << serial.median / parallel.median << ",\"build_log\":" << (log_collected ? "true" : "false") << "}";
+  results_.push_back(out.str());
+}
+
+// Variant lookups of --copy-module: a build for constants not seen before against a hit on a variant in the cache.
+// Then copy_unrolled of 4 MB from the variants specialized for each unroll factor, its specialization constant 0.
+void Benchmark::module_variants() {
+  const uint32_t kUnrolls[] = {1, 2, 4, 8};
+  const uint32_t kItems = 1 << 20;
+  const uint32_t kGroupSize = 64;
+  lzu::BinaryView binary = lzu::map_binary_file(options_.copy_module);
+  if (binary.empty()) return;
+  lzu::ModuleVariants variants(context_, device_, binary.data(), binary.size(), "", 4, nullptr);
+  // Unroll factors past the ones launched below, each one a build of its own
+  uint32_t unroll = 16;
+
+  Statistics miss = summarize(repeat([&] {
+    lzu::SpecializationConstants constants;
+    constants.set(0, unroll++);
+    Clock::time_point start = Clock::now();
+    variants.get(constants);
+    return elapsed_ns(start);
+  }));
+  lzu::SpecializationConstants hot;
+  hot.set(0, unroll);
+  variants.get(hot);
+  Statistics hit = summarize(repeat([&] {
+    Clock::time_point start = Clock::now();
+    variants.get(hot);
+    return elapsed_ns(start);
+  }));
+
+  lzu::ModuleVariantStats stats = variants.get_stats();
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(1) << "{\"benchmark\":\"module_variants\",\"max_variants\":"
+      << variants.max_variants() << ",\"miss_ns\":" << json(miss) << ",\"hit_ns\":" << json(hit)
+      << ",\"builds\":" << stats.builds << ",\"evictions\":" << stats.evictions << "}";
+  results_.push_back(out.str());
+
+  uint32_t* src = static_cast<uint32_t*>(allocate(ZE_MEMORY_TYPE_SHARED, kItems * sizeof(uint32_t)));
+  uint32_t* dst = static_cast<uint32_t*>(allocate(ZE_MEMORY_TYPE_SHARED, kItems * sizeof(uint32_t)));
+  for (uint32_t i = 0; i < kItems; i++) src[i] = i * 11 + 3;
+  Engine& engine = *engines_[0];
+  try {
+    for (uint32_t factor : kUnrolls) {
+      lzu::SpecializationConstants constants;
+      constants.set(0, factor);
+      std::shared_ptr<lzu::ModuleVariant> variant = variants.get(constants);
+      lzu::KernelLaunch* kernel = variant->kernels().find("copy_unrolled");
+      if (!kernel) {
+        throw std::runtime_error(options_.copy_module + " has no copy_unrolled, rebuild it from copy_module.cl");
+      }
+      memset(dst, 0, kItems * sizeof(uint32_t));
+      const ze_group_count_t group_count = {kItems / factor / kGroupSize, 1, 1};
+      kernel->set_argument(0, src);
+      kernel->set_argument(1, dst);
+      kernel->set_argument(2, static_cast<uint64_t>(kItems));
+      kernel->set_group_size(kGroupSize, 1, 1);
+      lzu::reset_command_list(engine.list());
+      kernel->append(engine.list(), &group_count, engine.event(), 0, nullptr);
+      lzu::close_command_list(engine.list());
+      std::vector<double> device;
+      std::vector<double> host = repeat([&] { return timed_run(engine, &device); });
+      const bool correct = memcmp(dst, src, kItems * sizeof(uint32_t)) == 0;
+      Statistics device_stats = summarize(device);
+      std::ostringstream variant_out;
+      variant_out << std::fixed << std::setprecision(3) << "{\"benchmark\":\"module_variant_kernel\",\"unroll\":"
+                  << factor << ",\"bytes\":" << kItems * sizeof(uint32_t) << ",\"host_ns\":" << json(summarize(host))
+                  << ",\"device_ns\":" << json(device_stats) << ",\"gb_per_s\":"
+                  << (device_stats.median > 0 ? kItems * sizeof(uint32_t) / device_stats.median : 0)
+                  << ",\"correct\":" << (correct ? "true" : "false") << "}";
+      results_.push_back(variant_out.str());
+    }
+  } catch (...) {
+    lzu::free_memory(context_, src);
+    lzu::free_memory(context_, dst);
+    throw;
+  }
+  lzu::free_memory(context_, src);
+  lzu::free_memory(context_, dst);
+}
+
+// copy_data of --copy-module between 4 MB shared buffers whose source the host rewrites before every launch, with
+// pages migrating on demand against a MigrationPolicy that prefetches the source.
+void Benchmark::shared_prefetch() {
+  const size_t kBytes = 4 << 20;
+  lzu::BinaryView binary = lzu::map_binary_file(options_.copy_module);
+  if (binary.empty()) return;
+  ze_module_handle_t module = lzu::create_module(context_, device_, binary.data(), binary.size(),
+                                                 ZE_MODULE_FORMAT_IL_SPIRV, "", nullptr);
+  const uint32_t ordinal = lzu::discover_queue_groups(device_).compute_ordinal;
+  ze_command_queue_handle_t queue = lzu::create_command_queue(context_, device_, 0, ZE_COMMAND_QUEUE_MODE_DEFAULT,
+                                                              ZE_COMMAND_QUEUE_PRIORITY_NORMAL, ordinal, 0);
+  ze_command_list_handle_t list = lzu::create_command_list(context_, device_, 0, ordinal);
+  uint8_t* src = static_cast<uint8_t*>(allocate(ZE_MEMORY_TYPE_SHARED, kBytes));
+  uint8_t* dst = static_cast<uint8_t*>(allocate(ZE_MEMORY_TYPE_SHARED, kBytes));
+  lzu::MigrationPolicy policy(device_);
+
+  {
+    lzu::KernelRegistry kernels(module);
+    lzu::KernelLaunch& kernel = kernels.launch("copy_data");
+    kernel.set_group_size(256, 1, 1);
+    kernel.set_argument(0, src);
+    kernel.set_argument(1, dst);
+    kernel.set_argument(2, 0);
+    kernel.set_argument(3, static_cast<int>(kBytes / 4));
+    const ze_group_count_t groups = {64, 1, 1};
+    const std::vector<lzu::MigrationPolicy::Access> buffers = {{src, lzu::BufferAccess::Read},
+                                                               {dst, lzu::BufferAccess::Write}};
+
+    auto run = [&](bool hinted) {
+      return summarize(repeat([&] {
+        memset(src, measuring_ ? 1 : 0, kBytes);
+        policy.host_access(src, lzu::BufferAccess::Write);
+        Clock::time_point start = Clock::now();
+        lzu::reset_command_list(list);
+        if (hinted) {
+          policy.launch(list, kernel, groups, buffers);
+        } else {
+          kernel.append(list, &groups, nullptr, 0, nullptr);
+        }
+        lzu::close_command_list(list);
+        lzu::execute_command_lists(queue, 1, &list, nullptr);
+        lzu::synchronize(queue, UINT64_MAX);
+        return elapsed_ns(start);
+      }));
+    };
+    Statistics on_demand = run(false);
+    lzu::reset_command_list(list);
+    policy.track(list, src, kBytes, lzu::BufferAdvice(), "src");
+    policy.track(list, dst, kBytes, lzu::BufferAdvice(), "dst");
+    lzu::close_command_list(list);
+    lzu::execute_command_lists(queue, 1, &list, nullptr);
+    lzu::synchronize(queue, UINT64_MAX);
+    Statistics prefetched = run(true);
+
+    lzu::MigrationStats stats = policy.get_stats(src);
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1) << "{\"benchmark\":\"shared_prefetch\",\"bytes\":" << kBytes
+        << ",\"on_demand_ns\":" << json(on_demand) << ",\"prefetched_ns\":" << json(prefetched)
+        << ",\"prefetches\":" << stats.prefetches << ",\"host_migrations\":" << stats.host_migrations << "}";
+    results_.push_back(out.str());
+  }
+  lzu::free_memory(context_, src);
+  lzu::free_memory(context_, dst);
+  lzu::destroy_command_list(list);
+  lzu::destroy_command_queue(queue);
+  lzu::destroy_module(module);
+}
+
+// CopyKernels copies between shared allocations, with src and dst aligned, equally misaligned and misaligned against
+// each other, checked byte for byte. A module without any of the copy kernels of copy_module.cl fails the benchmark
+// instead of timing driver copies under the kernels' name.
+void Benchmark::copy_kernels() {
+  const size_t kOffsets[][2] = {{0, 0}, {1, 1}, {1, 3}};
+  lzu::BinaryView binary = lzu::map_binary_file(options_.copy_module);
+  if (binary.empty()) return;
+  ze_module_handle_t module = lzu::create_module(context_, device_, binary.data(), binary.size(),
+                                                 ZE_MODULE_FORMAT_IL_SPIRV, "", nullptr);
+  Engine& engine = *engines_[0];
+  try {
+    lzu::CopyKernels kernels(module, device_);
+    bool any = false;
+    for (size_t i = 0; i < static_cast<size_t>(lzu::CopyVariant::Count); i++) {
+      lzu::CopyVariant variant = static_cast<lzu::CopyVariant>(i);
+      any = any || (variant != lzu::CopyVariant::Driver && kernels.available(variant));
+    }
+    if (!any) {
+      throw std::runtime_error(options_.copy_module + " has none of the copy kernels, rebuild it from copy_module.cl");
+    }
+
+    for (size_t size = options_.min_size; size <= options_.max_size; size *= 4) {
+      uint8_t* src = static_cast<uint8_t*>(allocate(ZE_MEMORY_TYPE_SHARED, size + 64));
+      uint8_t* dst = static_cast<uint8_t*>(allocate(ZE_MEMORY_TYPE_SHARED, size + 64));
+      for (auto& offset : kOffsets) {
+        for (size_t i = 0; i < size; i++) src[offset[0] + i] = static_cast<uint8_t>(i * 7 + 1);
+        memset(dst, 0, size + 64);
+        lzu::reset_command_list(engine.list());
+        lzu::CopyVariant variant =
+            kernels.append_copy(engine.list(), dst + offset[1], src + offset[0], size, engine.event());
+        lzu::close_command_list(engine.list());
+        std::vector<double> device;
+        std::vector<double> host = repeat([&] { return timed_run(engine, &device); });
+        const bool correct = memcmp(dst + offset[1], src + offset[0], size) == 0;
+        Statistics device_stats = summarize(device);
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(3) << "{\"benchmark\":\"copy_kernel\",\"variant\":\""
+            << lzu::to_string(variant) << "\",\"src_offset\":" << offset[0] << ",\"dst_offset\":" << offset[1]
+            << ",\"bytes\":" << size << ",\"host_ns\":" << json(summarize(host))
+            << ",\"device_ns\":" << json(device_stats)
+            << ",\"gb_per_s\":" << (device_stats.median > 0 ? size / device_stats.median : 0)
+            << ",\"correct\":" << (correct ? "true" : "false") << "}";
+        results_.push_back(out.str());
+      }
+      lzu::free_memory(context_, src);
+      lzu::free_memory(context_, dst);
+    }
+  } catch (...) {
+    lzu::destroy_module(module);
+    throw;
+  }
+  lzu::destroy_module(module);
+}
+
+// copy_u32 of --copy-module sharded over every supported device by a MultiDeviceExecutor, one result per run with
+// the groups and kernel time of each shard, to follow how the weights settle.
+void Benchmark::multi_device() {
+  const uint32_t kGroupSize = 64;
+  const uint32_t kItems = 1 << 20;
+  lzu::BinaryView binary = lzu::map_binary_file(options_.copy_module);
+  if (binary.empty()) return;
+  lzu::MultiDeviceExecutor executor;
+  executor.load_module(binary.data(), binary.size(), ZE_MODULE_FORMAT_IL_SPIRV, "");
+  if (!executor.device(0).kernels->find("copy_u32")) {
+    throw std::runtime_error(options_.copy_module + " has no copy_u32, rebuild it from copy_module.cl");
+  }
+
+  // Host memory of each context, every device of it reads and writes its own range
+  std::map<ze_context_handle_t, std::pair<uint32_t*, uint32_t*>> buffers;
+  for (size_t i = 0; i < executor.device_count(); i++) {
+    ze_context_handle_t context = executor.device(i).context;
+    if (buffers.count(context)) continue;
+    uint32_t* src = static_cast<uint32_t*>(lzu::allocate_host_memory(kItems * sizeof(uint32_t), 64, context));
+    uint32_t* dst = static_cast<uint32_t*>(lzu::allocate_host_memory(kItems * sizeof(uint32_t), 64, context));
+    for (uint32_t item = 0; item < kItems; item++) src[item] = item * 3 + 1;
+    buffers[context] = std::make_pair(src, dst);
+  }
+
+  try {
+    for (uint32_t run = 0; run < options_.warmup + options_.repetitions; run++) {
+      for (auto& buffer : buffers) memset(buffer.second.second, 0, kItems * sizeof(uint32_t));
+      auto prepare = [&](const lzu::Shard& shard, lzu::ExecutorDevice& device, lzu::KernelLaunch& kernel) {
+        const std::pair<uint32_t*, uint32_t*>& buffer = buffers[device.context];
+        kernel.set_argument(0, buffer.first + shard.offset[0]);
+        kernel.set_argument(1, buffer.second + shard.offset[0]);
+        kernel.set_argument(2, static_cast<uint64_t>(shard.size[0]));
+      };
+      std::vector<lzu::Shard> shards = executor.run("copy_u32", {{kItems, 1, 1}}, {{kGroupSize, 1, 1}}, prepare,
+                                                    lzu::MultiDeviceExecutor::FinishFunction());
+      bool correct = true;
+      std::ostringstream shard_list;
+      for (size_t i = 0; i < shards.size(); i++) {
+        const lzu::Shard& shard = shards[i];
+        const std::pair<uint32_t*, uint32_t*>& buffer = buffers[executor.device(shard.device_index).context];
+        correct = correct && memcmp(buffer.second + shard.offset[0], buffer.first + shard.offset[0],
+                                    shard.size[0] * sizeof(uint32_t)) == 0;
+        shard_list << (i ? "," : "") << "{\"device\":" << shard.device_index
+                   << ",\"groups\":" << shard.group_count.groupCountX << ",\"kernel_ms\":" << shard.kernel_ms << "}";
+      }
+      if (run < options_.warmup) continue;
+      std::ostringstream out;
+      out << std::fixed << std::setprecision(3) << "{\"benchmark\":\"multi_device\",\"run\":" << run - options_.warmup
+          << ",\"devices\":" << executor.device_count() << ",\"items\":" << kItems << ",\"shards\":["
+          << shard_list.str() << "],\"correct\":" << (correct ? "true" : "false") << "}";
+      results_.push_back(out.str());
+    }
+  } catch (...) {
+    for (auto& buffer : buffers) {
+      lzu::free_memory(buffer.first, buffer.second.first);
+      lzu::free_memory(buffer.first, buffer.second.second);
+    }
+    throw;
+  }
+  for (auto& buffer : buffers) {
+    lzu::free_memory(buffer.first, buffer.second.first);
+    lzu::free_memory(buffer.first, buffer.second.second);
+  }
+}
+
+// An upload, copy_u32 of --copy-module and a readback of 256 KB recorded once and replayed, against appending the same
+// commands into a reset list every time. back_to_back replays without synchronizing in between, each replay waits
+// for the previous run of the list on its fence.
+void Benchmark::recording_replay() {
+  const uint32_t kItems = 64 << 10;
+  const size_t kBytes = kItems * sizeof(uint32_t);
+  lzu::BinaryView binary = lzu::map_binary_file(options_.copy_module);
+  if (binary.empty()) return;
+  ze_module_handle_t module = lzu::create_module(context_, device_, binary.data(), binary.size(),
+                                                 ZE_MODULE_FORMAT_IL_SPIRV, "", nullptr);
+  uint32_t* input = static_cast<uint32_t*>(allocate(ZE_MEMORY_TYPE_HOST, kBytes));
+  uint32_t* output = static_cast<uint32_t*>(allocate(ZE_MEMORY_TYPE_HOST, kBytes));
+  void* src = allocate(ZE_MEMORY_TYPE_DEVICE, kBytes);
+  void* dst = allocate(ZE_MEMORY_TYPE_DEVICE, kBytes);
+  Engine& engine = *engines_[0];
+  auto release = [&] {
+    lzu::free_memory(context_, input);
+    lzu::free_memory(context_, output);
+    lzu::free_memory(context_, src);
+    lzu::free_memory(context_, dst);
+  };
+  try {
+    lzu::KernelRegistry kernels(module);
+    lzu::KernelLaunch* kernel = kernels.find("copy_u32");
+    if (!kernel) {
+      throw std::runtime_error(options_.copy_module + " has no copy_u32, rebuild it from copy_module.cl");
+    }
+    for (uint32_t i = 0; i < kItems; i++) input[i] = i * 5 + 2;
+    memset(output, 0, kBytes);
+    const ze_group_count_t group_count = {kItems / 64, 1, 1};
+
+    lzu::CommandRecording recording(context_, device_, lzu::discover_queue_groups(device_).compute_ordinal);
+    lzu::CommandRecording::Slot input_slot = recording.add_slot<void*>(input);
+    lzu::CommandRecording::Slot output_slot = recording.add_slot<void*>(output);
+    lzu::CommandRecording::Slot src_slot = recording.add_slot(src);
+    lzu::CommandRecording::Slot dst_slot = recording.add_slot(dst);
+    // add_slot(size_t) declares the size, the count is set separately
+    lzu::CommandRecording::Slot count_slot = recording.add_slot(sizeof(uint64_t));
+    recording.set(count_slot, static_cast<uint64_t>(kItems));
+    lzu::CommandRecording::Op upload = recording.record_copy(src_slot, input_slot, kBytes);
+    lzu::CommandRecording::Op launch =
+        recording.record_launch(*kernel, {src_slot, dst_slot, count_slot}, {{64, 1, 1}}, group_count, {upload});
+    recording.record_copy(output_slot, dst_slot, kBytes, {launch});
+
+    Statistics replay = summarize(repeat([&] {
+      Clock::time_point start = Clock::now();
+      recording.replay(engine.queue());
+      lzu::synchronize(engine.queue(), UINT64_MAX);
+      return elapsed_ns(start);
+    }));
+    const bool correct = memcmp(output, input, kBytes) == 0;
+    Statistics back_to_back = summarize(repeat([&] {
+      Clock::time_point start = Clock::now();
+      recording.replay(engine.queue());
+      return elapsed_ns(start);
+    }));
+    lzu::synchronize(engine.queue(), UINT64_MAX);
+    ze_command_list_handle_t list = engine.list();
+    Statistics append = summarize(repeat([&] {
+      Clock::time_point start = Clock::now();
+      lzu::reset_command_list(list);
+      lzu::append_memory_copy(list, src, input, kBytes, nullptr, 0, nullptr);
+      lzu::append_barrier(list, nullptr, 0, nullptr);
+      kernel->set_argument(0, src);
+      kernel->set_argument(1, dst);
+      kernel->set_argument(2, static_cast<uint64_t>(kItems));
+      kernel->set_group_size(64, 1, 1);
+      kernel->append(list, &group_count, nullptr, 0, nullptr);
+      lzu::append_barrier(list, nullptr, 0, nullptr);
+      lzu::append_memory_copy(list, output, dst, kBytes, nullptr, 0, nullptr);
+      lzu::close_command_list(list);
+      lzu::execute_command_lists(engine.queue(), 1, &list, nullptr);
+      lzu::synchronize(engine.queue(), UINT64_MAX);
+      return elapsed_ns(start);
+    }));
+
+    const lzu::CommandRecordingStats& stats = recording.stats();
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1) << "{\"benchmark\":\"recording\",\"bytes\":" << kBytes
+        << ",\"replay_ns\":" << json(replay) << ",\"back_to_back_ns\":" << json(back_to_back)
+        << ",\"append_ns\":" << json(append) << ",\"replays\":" << stats.replays
+        << ",\"instantiations\":" << stats.instantiations << ",\"waits\":" << stats.waits
+        << ",\"correct\":" << (correct ? "true" : "false") << "}";
+    results_.push_back(out.str());
+  } catch (...) {
+    release();
+    lzu::destroy_module(module);
+    throw;
+  }
+  release();
+  lzu::destroy_module(module);
+}
+
+bool parse_options(int argc, char** argv, Options* options) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) return false;
+    if (arg == "--output") {
+      options->output = argv[++i];
+    } else if (arg == "--repetitions") {
+      options->repetitions = static_cast<uint32_t>(std::max(1, atoi(argv[++i])));
+    } else if (arg == "--min-size") {
+      options->min_size = std::max<size_t>(1, strtoull(argv[++i], nullptr, 0));
+    } else if (arg == "--max-size") {
+      options->max_size = strtoull(argv[++i], nullptr, 0);
+    } else if (arg == "--max-threads") {
+      options->max_threads = static_cast<uint32_t>(std::max(1, atoi(argv[++i])));
+    } else if (arg == "--copy-module") {
+      options->copy_module = argv[++i];
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  if (!parse_options(argc, argv, &options)) {
+    std::cerr << "Usage: " << argv[0]
+              << " [--output FILE] [--repetitions N] [--min-size BYTES] [--max-size BYTES] [--max-threads N]"
+                 " [--copy-module FILE]"
+              << std::endl;
+    return -1;
+  }
+
+  ze_result_t result = zeInit(0);
+  if (result != ZE_RESULT_SUCCESS) {
+    std::cerr << "Function zeInit failed with result: " << lzu::to_string(result) << std::endl;
+    return -1;
+  }
+  std::vector<std::pair<ze_driver_handle_t, ze_device_handle_t>> supportedDevices = lzu::cached::getSupportedDevices();
+  if (supportedDevices.empty()) {
+    std::cerr << "No supported level zero devices available" << std::endl;
+    return -2;
+  }
+
+  ze_driver_handle_t driver = supportedDevices[0].first;
+  ze_device_handle_t device = supportedDevices[0].second;
+  ze_context_handle_t context = lzu::get_context(driver);
+  std::ostringstream out;
+  try {
+    Benchmark benchmark(context, device, options);
+    benchmark.launch_latency();
+    benchmark.event_cost();
+    benchmark.submission_throughput();
+    benchmark.concurrent_submission();
+    benchmark.async_completion();
+    benchmark.ring_pipelining();
+    benchmark.streaming();
+    benchmark.batched_copy();
+    benchmark.offload_policy();
+    benchmark.module_build();
+    benchmark.module_variants();
+    benchmark.shared_prefetch();
+    benchmark.copy_kernels();
+    benchmark.multi_device();
+    benchmark.recording_replay();
+    benchmark.copies();
+
+    out << "{\n  \"device\": \"" << lzu::get_device_properties(device).name << "\",\n  \"driver_version\": "
+        << lzu::get_driver_properties(driver).driverVersion << ",\n  \"repetitions\": " << options.repetitions
+        << ",\n  \"warmup\": " << options.warmup << ",\n  \"results\": [" << benchmark.results() << "\n  ]\n}\n";
+  } catch (std::exception& e) {
+    std::cerr << "Benchmark failed: " << e.what() << std::endl;
+    lzu::destroy_context(context);
+    return -3;
+  }
+  lzu::destroy_context(context);
+
+  if (options.output.empty()) {
+    std::cout << out.str();
+  } else {
+    std::ofstream file(options.output);
+    file << out.str();
+  }
+  return 0;
+}
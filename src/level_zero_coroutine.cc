@@ -0,0 +1,108 @@
+// Copyright 2020 Intel Corporation
+// C++20 user of the CompletionReactor awaitables. Copies a buffer through the device and back, once waiting on an
+// event and once on a fence, with co_await instead of a blocked host thread. The first copy waits on a gate event the
+// host signals only after the coroutine suspended, so the awaitables really go through the reactor.
+
+#include "level_zero_async.hpp"
+#include "level_zero_device_registry.hpp"
+#include "level_zero_queues.hpp"
+#include "level_zero_utils.hpp"
+#include <exception>
+#include <future>
+#include <iostream>
+#include <vector>
+
+#ifndef LZU_HAS_COROUTINES
+#error "level_zero_coroutine needs C++20 coroutines"
+#endif
+
+namespace {
+
+// Eagerly started coroutine that reports its outcome through a std::future.
+struct Task {
+  struct promise_type {
+    std::promise<bool> done;
+
+    Task get_return_object() { return Task{done.get_future()}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_value(bool value) { done.set_value(value); }
+    void unhandled_exception() { done.set_exception(std::current_exception()); }
+  };
+
+  std::future<bool> result;
+};
+
+Task copy_twice(ze_context_handle_t context, ze_device_handle_t device, ze_event_handle_t gate, ze_event_handle_t event,
+                const std::vector<uint32_t>& input, std::vector<uint32_t>* output) {
+  const size_t bytes = input.size() * sizeof(uint32_t);
+  const uint32_t ordinal = lzu::discover_queue_groups(device).compute_ordinal;
+  lzu::CompletionReactor& reactor = lzu::CompletionReactor::get();
+  ze_command_queue_handle_t queue = lzu::create_command_queue(context, device, 0, ZE_COMMAND_QUEUE_MODE_ASYNCHRONOUS,
+                                                              ZE_COMMAND_QUEUE_PRIORITY_NORMAL, ordinal, 0);
+  ze_command_list_handle_t list = lzu::create_command_list(context, device, 0, ordinal);
+  ze_fence_handle_t fence = lzu::create_fence(queue);
+  void* staging = lzu::allocate_device_memory(bytes, 64, 0, 0, device, context);
+
+  // Host to device once the gate opens, resumed by the event
+  lzu::append_memory_copy(list, staging, input.data(), bytes, event, 1, &gate);
+  lzu::close_command_list(list);
+  lzu::execute_command_lists(queue, 1, &list, nullptr);
+  ze_result_t to_device = co_await reactor.event(event);
+
+  // Device to host, resumed by the fence. From here on the coroutine runs on the reactor thread.
+  lzu::reset_command_list(list);
+  lzu::append_memory_copy(list, output->data(), staging, bytes, nullptr, 0, nullptr);
+  lzu::close_command_list(list);
+  lzu::execute_command_lists(queue, 1, &list, fence);
+  ze_result_t to_host = co_await reactor.fence(fence);
+
+  lzu::free_memory(context, staging);
+  lzu::destroy_fence(fence);
+  lzu::destroy_command_list(list);
+  lzu::destroy_command_queue(queue);
+  co_return to_device == ZE_RESULT_SUCCESS && to_host == ZE_RESULT_SUCCESS && *output == input;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  try {
+    ze_result_t result = zeInit(0);
+    if (result != ZE_RESULT_SUCCESS) {
+      std::cout << "Function zeInit failed with result: " << lzu::to_string(result) << std::endl;
+      return -1;
+    }
+    lzu::get_all_driver_handles();
+    std::vector<std::pair<ze_driver_handle_t, ze_device_handle_t>> devices = lzu::cached::getSupportedDevices();
+    if (devices.empty()) {
+      std::cout << "No supported level zero devices available" << std::endl;
+      return -4;
+    }
+    ze_context_handle_t context = lzu::cached::get_context(devices[0].first);
+
+    std::vector<uint32_t> input(1 << 16);
+    for (size_t i = 0; i < input.size(); i++) input[i] = static_cast<uint32_t>(i * 2654435761u);
+    std::vector<uint32_t> output(input.size(), 0);
+    lzu::zeEventPool pool;
+    pool.InitEventPool(context, 2);
+    ze_event_handle_t gate = nullptr;
+    ze_event_handle_t event = nullptr;
+    pool.create_event(&gate);
+    pool.create_event(&event);
+
+    // Returns at the first co_await, the rest of the coroutine runs on the reactor thread
+    Task task = copy_twice(context, devices[0].second, gate, event, input, &output);
+    zeEventHostSignal(gate);
+    bool passed = task.result.get();
+    pool.destroy_event(event);
+    pool.destroy_event(gate);
+    lzu::ReactorStats stats = lzu::CompletionReactor::get().get_stats();
+    std::cout << "Coroutine copy: " << (passed ? "passed" : "failed") << ", " << stats.watches << " watches, "
+              << stats.completions << " completions" << std::endl;
+    return passed ? 0 : -5;
+  } catch (std::exception& e) {
+    std::cout << "Coroutine copy crashed with info: " << e.what() << std::endl;
+    return -2;
+  }
+}
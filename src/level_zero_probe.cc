@@ -1,5 +1,6 @@
 // Copyright 2020 Intel Corporation
 
+#include "level_zero_device_registry.hpp"
 #include "level_zero_utils.hpp"
 #include <iostream>
 #include <vector>
@@ -24,15 +25,20 @@ int main(int argc, char** argv) {
     std::cout << "Get level zero driver handle crashed with info: " << e.what() << std::endl;
     return -3;
   }
-  std::vector<std::pair<ze_driver_handle_t, ze_device_handle_t>> supportedDevices = lzu::getSupportedDevices();
-  if (supportedDevices.empty()) {
+  const lzu::DeviceRegistry& registry = lzu::DeviceRegistry::get();
+  std::cout << "Device discovery took " << registry.discovery_ms() << "ms for " << registry.drivers().size()
+            << " drivers" << std::endl;
+  if (registry.devices().empty()) {
     std::cout << "No supported level zero devices available" << std::endl;
     return -4;
   }
 
-  std::cout << "Available level zero devices count: " << supportedDevices.size() << std::endl;
-  for (auto& target : supportedDevices) {
-    std::cout << "Device: " << lzu::get_device_properties(target.second).name << std::endl;
+  std::cout << "Available level zero devices count: " << registry.devices().size() << std::endl;
+  for (auto& device : registry.devices()) {
+    uint64_t memory = 0;
+    for (auto& properties : device.memory_properties) memory += properties.totalSize;
+    std::cout << "Device: " << device.properties.name << ", " << device.queue_groups.size() << " queue groups, "
+              << (memory >> 20) << " MB memory" << std::endl;
   }
   return 0;
 }
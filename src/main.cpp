@@ -1,7 +1,20 @@
+#include <stdlib.h>
+#include <string.h>
+
 #include <array>
 #include <chrono>
 #include <iostream>
 
+#include "level_zero_allocator.hpp"
+#include "level_zero_async.hpp"
+#include "level_zero_autotune.hpp"
+#include "level_zero_device_registry.hpp"
+#include "level_zero_host_kernels.hpp"
+#include "level_zero_kernel.hpp"
+#include "level_zero_module_cache.hpp"
+#include "level_zero_profiler.hpp"
+#include "level_zero_queues.hpp"
+#include "level_zero_task_graph.hpp"
 #include "level_zero_utils.hpp"
 
 const size_t size = 9;
@@ -10,6 +23,17 @@ struct copy_data {
   uint32_t* data;
 };
 
+// main_kernel on the host thread pool: the reference for the device result, and the fallback without a device
+void run_on_host(const int64_t* input, const int64_t* input1, int64_t* output) {
+  lzu::HostLaunch launch;
+  launch.set_argument(0, input);
+  launch.set_argument(1, input1);
+  launch.set_argument(2, output);
+  launch.group_size = {{1, 9, 9}};
+  launch.group_count = {1, 9, 9};
+  lzu::find_host_kernel("main_kernel")(launch);
+}
+
 int main(int argc, char** argv) {
   ze_result_t result = ZE_RESULT_NOT_READY;
   std::chrono::time_point<std::chrono::system_clock> start = std::chrono::system_clock::now();
@@ -31,29 +55,41 @@ int main(int argc, char** argv) {
   // ze_memory_type_t memory_type = ZE_MEMORY_TYPE_DEVICE;
   int offset = 0;
 
-  std::vector<std::pair<ze_driver_handle_t, ze_device_handle_t>> supportedDevices = lzu::getSupportedDevices();
+  std::vector<std::pair<ze_driver_handle_t, ze_device_handle_t>> supportedDevices = lzu::cached::getSupportedDevices();
   if (supportedDevices.empty()) {
-    std::cout << "No supported level zero devices available" << std::endl;
-    return -2;
+    std::cout << "No supported level zero devices available, running on the host (" << lzu::host_kernel_isa() << ")"
+              << std::endl;
+    std::vector<int64_t> value0 = {1, 2, 3, 4, 5, 6, 7, 8, 9};
+    std::vector<int64_t> value1 = {1, 2, 3, 4, 5, 6, 7, 8, 9};
+    std::vector<int64_t> out(size, 0);
+    run_on_host(value0.data(), value1.data(), out.data());
+    std::cout << "Output data: " << std::endl;
+    for (size_t i = 0; i < size; i++) {
+      std::cout << out[i] << " ";
+    }
+    std::cout << std::endl;
+    std::cout << "Finish." << std::endl;
+    return 0;
   }
 
   std::cout << "Available level zero devices count: " << supportedDevices.size() << std::endl;
   for (auto& target : supportedDevices) {
-    std::cout << "Device: " << lzu::get_device_properties(target.second).name << std::endl;
+    std::cout << "Device: " << lzu::cached::get_device_properties(target.second).name << std::endl;
   }
 
-  ze_context_handle_t context = lzu::get_context(supportedDevices[0].first);
+  // Shared context of the driver, owned by the device registry
+  ze_context_handle_t context = lzu::cached::get_context(supportedDevices[0].first);
   ze_device_handle_t device = supportedDevices[0].second;
-  ze_command_queue_handle_t command_queue = lzu::create_command_queue(
-      context, device, /*flags*/ 0, ZE_COMMAND_QUEUE_MODE_DEFAULT, ZE_COMMAND_QUEUE_PRIORITY_NORMAL,
-      /*ordinal*/ 0, /*index*/ 0);
-  ze_command_list_handle_t command_list = lzu::create_command_list(context, device, /*flags*/ 0, /*ordinal*/ 0);
-  std::vector<uint8_t> binary_file = lzu::load_binary_file("spirv_0");
-  ze_module_handle_t module = lzu::create_module(context, device, binary_file.data(), binary_file.size(),
-                                                 ZE_MODULE_FORMAT_IL_SPIRV, "", nullptr);
+  // Uploads and readbacks go to a copy-only engine when the device has one
+  lzu::DeviceQueues queues(context, device);
+  lzu::BinaryView binary_file = lzu::map_binary_file("spirv_0");
+  ze_module_handle_t module = lzu::cached::create_module(context, device, binary_file.data(), binary_file.size(),
+                                                         ZE_MODULE_FORMAT_IL_SPIRV, "", nullptr);
 
   // auto module = lzu::create_module(device, "spirv_0");
-  ze_kernel_handle_t kernel = lzu::create_function(module, /*flag*/ 0, "main_kernel");
+  lzu::KernelRegistry kernels(module, /*flags*/ 0);
+  lzu::KernelLaunch& kernel = kernels.launch("main_kernel");
+  bool matches = false;
 
   {
     {
@@ -61,72 +97,81 @@ int main(int argc, char** argv) {
       if (memory_type == ZE_MEMORY_TYPE_HOST) {
         // Can change host ptr data like
         // input_data[0] = 255;
-        input_data = static_cast<int64_t*>(lzu::allocate_host_memory(size * sizeof(int64_t), 1, context));
-        input_data1 = static_cast<int64_t*>(lzu::allocate_host_memory(size * sizeof(int64_t), 1, context));
-        output_data = static_cast<int64_t*>(lzu::allocate_host_memory(size * sizeof(int64_t), 1, context));
+        input_data = static_cast<int64_t*>(lzu::cached::allocate_host_memory(size * sizeof(int64_t), 1, context));
+        input_data1 = static_cast<int64_t*>(lzu::cached::allocate_host_memory(size * sizeof(int64_t), 1, context));
+        output_data = static_cast<int64_t*>(lzu::cached::allocate_host_memory(size * sizeof(int64_t), 1, context));
       } else if (memory_type = ZE_MEMORY_TYPE_DEVICE) {
-        input_data =
-            static_cast<int64_t*>(lzu::allocate_device_memory(size * sizeof(int64_t), 1, 0, 0, device, context));
-        input_data1 =
-            static_cast<int64_t*>(lzu::allocate_device_memory(size * sizeof(int64_t), 1, 0, 0, device, context));
-        output_data =
-            static_cast<int64_t*>(lzu::allocate_device_memory(size * sizeof(int64_t), 1, 0, 0, device, context));
+        input_data = static_cast<int64_t*>(
+            lzu::cached::allocate_device_memory(size * sizeof(int64_t), 1, 0, 0, device, context));
+        input_data1 = static_cast<int64_t*>(
+            lzu::cached::allocate_device_memory(size * sizeof(int64_t), 1, 0, 0, device, context));
+        output_data = static_cast<int64_t*>(
+            lzu::cached::allocate_device_memory(size * sizeof(int64_t), 1, 0, 0, device, context));
       } else {
-        input_data =
-            static_cast<int64_t*>(lzu::allocate_shared_memory(size * sizeof(int64_t), 1, 0, 0, device, context));
-        input_data1 =
-            static_cast<int64_t*>(lzu::allocate_shared_memory(size * sizeof(int64_t), 1, 0, 0, device, context));
-        output_data =
-            static_cast<int64_t*>(lzu::allocate_shared_memory(size * sizeof(int64_t), 1, 0, 0, device, context));
+        input_data = static_cast<int64_t*>(
+            lzu::cached::allocate_shared_memory(size * sizeof(int64_t), 1, 0, 0, device, context));
+        input_data1 = static_cast<int64_t*>(
+            lzu::cached::allocate_shared_memory(size * sizeof(int64_t), 1, 0, 0, device, context));
+        output_data = static_cast<int64_t*>(
+            lzu::cached::allocate_shared_memory(size * sizeof(int64_t), 1, 0, 0, device, context));
       }
 
-      std::vector<ze_event_handle_t> allEvents;
       lzu::zeEventPool eventPool;
       eventPool.InitEventPool(context, 32);
-      std::vector<uint64_t> value0 = {1, 2, 3, 4, 5, 6, 7, 8, 9};
-      ze_event_handle_t e0;
-      eventPool.create_event(&e0);
-      allEvents.push_back(e0);
-      lzu::append_memory_copy(command_list, reinterpret_cast<void*>(input_data), reinterpret_cast<void*>(value0.data()),
-                              9 * 8, e0, 0, nullptr);
+      lzu::TaskGraph graph(&eventPool);
 
+      std::vector<uint64_t> value0 = {1, 2, 3, 4, 5, 6, 7, 8, 9};
       std::vector<uint64_t> value1 = {1, 2, 3, 4, 5, 6, 7, 8, 9};
-      ze_event_handle_t e1;
-      eventPool.create_event(&e1);
-      allEvents.push_back(e1);
-      lzu::append_memory_copy(command_list, reinterpret_cast<void*>(input_data1),
-                              reinterpret_cast<void*>(value1.data()), 9 * 8, e1, 0, nullptr);
-
       std::vector<uint64_t> out = {0, 0, 0, 0, 0, 0, 0, 0, 0};
-      ze_event_handle_t e2;
-      eventPool.create_event(&e2);
-      allEvents.push_back(e2);
-      lzu::append_memory_copy(command_list, reinterpret_cast<void*>(output_data), reinterpret_cast<void*>(out.data()),
-                              9 * 8, e2, 0, nullptr);
-
-      ze_kernel_handle_t kernel1 = kernel;
-      lzu::set_argument_value(kernel1, 0, sizeof(input_data), &input_data);
-      lzu::set_argument_value(kernel1, 1, sizeof(input_data1), &input_data1);
-      lzu::set_argument_value(kernel1, 2, sizeof(output_data), &output_data);
+      std::vector<lzu::TaskGraph::Node> nodes;
+      nodes.push_back(graph.add_copy(input_data, value0.data(), 9 * 8));
+      nodes.push_back(graph.add_copy(input_data1, value1.data(), 9 * 8));
+      nodes.push_back(graph.add_copy(output_data, out.data(), 9 * 8));
 
       // Group size and count will influence some old neo drivers on subgroup broadcast part.
-      // Each group size
-      lzu::set_group_size(kernel, 1, 9, 9);
-
-      // Total group count
-      ze_group_count_t group_count;
-      group_count.groupCountX = 1;
-      group_count.groupCountY = 9;
-      group_count.groupCountZ = 9;
-
-      std::vector<ze_event_handle_t> events;
-      events.push_back(e0);
-      events.push_back(e1);
-      events.push_back(e2);
-      ze_event_handle_t e3;
-      eventPool.create_event(&e3);
-      allEvents.push_back(e3);
-      lzu::append_launch_function(command_list, kernel, &group_count, e3, events.size(), events.data());
+      // The shape comes from the tuning database, and stays 1x9x9 until main_kernel was tuned for this device.
+      // LZU_AUTOTUNE=1 times the candidates that compute the right sum on the first run and stores the winner.
+      const std::array<uint32_t, 3> global_size = {{1, 81, 81}};
+      lzu::AutotuneOptions tune_options;
+      const char* autotune = getenv("LZU_AUTOTUNE");
+      tune_options.tune_on_miss = autotune && strcmp(autotune, "0") != 0;
+      tune_options.default_group_size = {{1, 9, 9}};
+      // The buffers may be device memory, so candidates get their data through the queues like the graph does
+      auto transfer = [&](void* dst, const void* src) {
+        lzu::append_memory_copy(queues.compute_list(), dst, src, size * sizeof(int64_t), nullptr, 0, nullptr);
+        queues.close();
+        queues.execute();
+        queues.synchronize(UINT64_MAX);
+        queues.reset();
+      };
+      std::vector<uint64_t> readback(size, 0);
+      tune_options.validate = [&](const std::array<uint32_t, 3>&) {
+        transfer(readback.data(), output_data);
+        bool valid = true;
+        for (size_t i = 0; i < size; i++) valid = valid && readback[i] == value0[i] + value1[i];
+        transfer(output_data, out.data());
+        return valid;
+      };
+      if (tune_options.tune_on_miss) {
+        // The graph uploads the inputs only later, candidates are checked against these
+        transfer(input_data, value0.data());
+        transfer(input_data1, value1.data());
+        transfer(output_data, out.data());
+      }
+      lzu::Autotuner tuner(context, device, &lzu::TuningDatabase::get(), tune_options);
+      kernel.set_argument(0, input_data);
+      kernel.set_argument(1, input_data1);
+      kernel.set_argument(2, output_data);
+      ze_group_count_t group_count = tuner.apply(kernel, "main_kernel", global_size);
+      std::array<uint32_t, 3> group_size = {{global_size[0] / group_count.groupCountX,
+                                             global_size[1] / group_count.groupCountY,
+                                             global_size[2] / group_count.groupCountZ}};
+
+      // Dependencies are inferred from the buffers each node reads and writes
+      nodes.push_back(graph.add_launch(kernel, group_size, group_count,
+                                       {lzu::TaskGraph::argument(input_data), lzu::TaskGraph::argument(input_data1),
+                                        lzu::TaskGraph::argument(output_data)},
+                                       {input_data, input_data1}, {output_data}));
 
       // For host kind memory, can submmit here and then copy by cpu.
       // For shared and device memory, can submit later
@@ -135,52 +180,42 @@ int main(int argc, char** argv) {
       // lzu::execute_command_lists(command_queue, 1, &command_list, nullptr);
       // lzu::synchronize(command_queue, UINT64_MAX);
 
-      ze_event_handle_t e0_0;
-      eventPool.create_event(&e0_0);
-      allEvents.push_back(e0_0);
-      std::vector<ze_event_handle_t> events0;
-      events0.push_back(e3);
-      events0.push_back(e0);
-      lzu::append_memory_copy(command_list, reinterpret_cast<void*>(value0.data()), reinterpret_cast<void*>(input_data),
-                              9 * 8, e0_0, events0.size(), events0.data());
-
-      ze_event_handle_t e1_1;
-      eventPool.create_event(&e1_1);
-      allEvents.push_back(e1_1);
-      std::vector<ze_event_handle_t> events1;
-      events1.push_back(e3);
-      events1.push_back(e1);
-      lzu::append_memory_copy(command_list, reinterpret_cast<void*>(value1.data()),
-                              reinterpret_cast<void*>(input_data1), 9 * 8, e1_1, events1.size(), events1.data());
+      lzu::TaskGraph::Node read0 = graph.add_copy(value0.data(), input_data, 9 * 8);
+      lzu::TaskGraph::Node read1 = graph.add_copy(value1.data(), input_data1, 9 * 8);
+      lzu::TaskGraph::Node read2 = graph.add_copy(out.data(), output_data, 9 * 8);
+      nodes.push_back(read0);
+      nodes.push_back(read1);
+      nodes.push_back(read2);
 
-      // std::vector<uint64_t> out = {0, 0, 0, 0, 0, 0};
-      ze_event_handle_t e2_2;
-      eventPool.create_event(&e2_2);
-      allEvents.push_back(e2_2);
-      std::vector<ze_event_handle_t> events2;
-      events2.push_back(e3);
-      events2.push_back(e2);
-      lzu::append_memory_copy(command_list, reinterpret_cast<void*>(out.data()), reinterpret_cast<void*>(output_data),
-                              9 * 8, e2_2, events2.size(), events2.data());
+      // Every node is profiled below, so every node needs an event
+      for (auto node : nodes) graph.require_event(node);
+      graph.emit(queues.compute_list(), queues.copy_list());
 
-      lzu::close_command_list(command_list);
-      lzu::execute_command_lists(command_queue, 1, &command_list, nullptr);
-      lzu::synchronize(command_queue, UINT64_MAX);
+      queues.close();
+      queues.execute();
 
       // Check the result
       // if (0 != memcmp(input_data, output_data + offset, (size - offset) *
       // sizeof(int)))
       //    return -1;
 
-      ze_event_handle_t et0 = e0_0;
-      ze_event_handle_t et1 = e1_1;
-      ze_event_handle_t et2 = e2_2;
-      zeEventHostSynchronize(et0, UINT64_MAX);
-      zeEventHostSynchronize(et1, UINT64_MAX);
-      zeEventHostSynchronize(et2, UINT64_MAX);
-      zeEventHostSynchronize(e0_0, UINT64_MAX);
-      zeEventHostSynchronize(e1_1, UINT64_MAX);
-      zeEventHostSynchronize(e2_2, UINT64_MAX);
+      // The readbacks are the last nodes, the completion reactor reports them without a blocked wait each
+      lzu::CompletionReactor& reactor = lzu::CompletionReactor::get();
+      std::vector<std::future<void>> readbacks;
+      readbacks.push_back(reactor.when_event(graph.event(read0)));
+      readbacks.push_back(reactor.when_event(graph.event(read1)));
+      readbacks.push_back(reactor.when_event(graph.event(read2)));
+      for (auto& readback : readbacks) readback.get();
+
+      const char* copy_track = queues.has_copy_engine() ? "copy" : "compute";
+      lzu::Profiler profiler(device);
+      profiler.record(graph.event(nodes[0]), "upload input_data", lzu::OpKind::Copy, copy_track);
+      profiler.record(graph.event(nodes[1]), "upload input_data1", lzu::OpKind::Copy, copy_track);
+      profiler.record(graph.event(nodes[2]), "upload output_data", lzu::OpKind::Copy, copy_track);
+      profiler.record(graph.event(nodes[3]), "main_kernel", lzu::OpKind::Kernel);
+      profiler.record(graph.event(read0), "read input_data", lzu::OpKind::Copy, copy_track);
+      profiler.record(graph.event(read1), "read input_data1", lzu::OpKind::Copy, copy_track);
+      profiler.record(graph.event(read2), "read output_data", lzu::OpKind::Copy, copy_track);
 
       std::chrono::time_point<std::chrono::system_clock> end = std::chrono::system_clock::now();
       std::chrono::duration<double> diff = end - start;
@@ -197,69 +232,32 @@ int main(int argc, char** argv) {
       }
       std::cout << std::endl;
 
+      // The same inputs on the host
+      std::vector<int64_t> expected(size, 0);
+      run_on_host(reinterpret_cast<const int64_t*>(value0.data()), reinterpret_cast<const int64_t*>(value1.data()),
+                  expected.data());
+      matches = memcmp(expected.data(), out.data(), size * sizeof(int64_t)) == 0;
+      std::cout << "Host check: " << (matches ? "passed" : "failed") << std::endl;
+
       // final confirm
-      lzu::synchronize(command_queue, UINT64_MAX);
+      queues.synchronize(UINT64_MAX);
 
       // profiling
-      using std::chrono::nanoseconds;
-      using fp_milliseconds = std::chrono::duration<double, std::chrono::milliseconds::period>;
-      nanoseconds totalExecuteTime{0};
-      nanoseconds kernelExecuteTime{0};
-      nanoseconds memoryExecuteTime{0};
-      // unsigned kernelsCnt = 0;
-      // unsigned memoryCnt = 0;
-
-      auto getEventKernelTimestamp = [](ze_event_handle_t event) -> ze_kernel_timestamp_result_t {
-        ze_kernel_timestamp_result_t value = {};
-        zeEventQueryKernelTimestamp(event, &value);
-        return value;
-      };
-
-      auto deviceProperties = lzu::get_device_properties(device);
-      const uint64_t timestampFreq = deviceProperties.timerResolution;
-      const uint64_t timestampMaxValue = ~(-1 << deviceProperties.kernelTimestampValidBits);
-
-      for (auto event : allEvents) {
-        if (event == nullptr) continue;
-        ze_kernel_timestamp_result_t timestamp = getEventKernelTimestamp(event);
-        uint64_t start = timestamp.context.kernelStart;
-        uint64_t end = timestamp.context.kernelEnd;
-        auto eventExecuteTime =
-            (end >= start) ? (end - start) * timestampFreq : ((timestampMaxValue - start + end + 1) * timestampFreq);
-        nanoseconds executeTime{eventExecuteTime};
-        totalExecuteTime += executeTime;
-
-        // if (event->getKind() == LevelZeroActionKind::Kernel) {
-        // kernelExecuteTime += executeTime;
-        // kernelsCnt += 1;
-        // IVLOG(2, "  Kernel '" << event->getName() << "' execute time: "
-        //                  << fp_milliseconds(executeTime).count() << "ms");
-        //}
-      }
-
-      std::cout << "Total Level Zero execution time: " << (fp_milliseconds(totalExecuteTime).count()) << "ms"
-                << std::endl;
+      profiler.collect();
+      profiler.print(std::cout);
+      const char* trace_file = getenv("LZU_TRACE_FILE");
+      if (trace_file) profiler.write_chrome_trace(trace_file);
 
       // cleanup
-      lzu::free_memory(context, reinterpret_cast<void*>(input_data));
-      lzu::free_memory(context, reinterpret_cast<void*>(input_data1));
-      lzu::free_memory(context, reinterpret_cast<void*>(output_data));
-
-      eventPool.destroy_event(e0);
-      eventPool.destroy_event(e1);
-      eventPool.destroy_event(e2);
-      eventPool.destroy_event(e3);
-      eventPool.destroy_event(e0_0);
-      eventPool.destroy_event(e1_1);
-      eventPool.destroy_event(e2_2);
+      lzu::cached::free_memory(context, reinterpret_cast<void*>(input_data));
+      lzu::cached::free_memory(context, reinterpret_cast<void*>(input_data1));
+      lzu::cached::free_memory(context, reinterpret_cast<void*>(output_data));
 
-      lzu::destroy_function(kernel);
+      kernels.clear();
       lzu::destroy_module(module);
-      lzu::destroy_command_list(command_list);
-      lzu::destroy_command_queue(command_queue);
     }
     std::cout << std::endl;
   }
   std::cout << "Finish." << std::endl;
-  return 0;
+  return matches ? 0 : -3;
 }
@@ -0,0 +1,140 @@
+// Copyright 2020 Intel Corporation
+#ifndef UTILS_INCLUDE_LEVEL_ZERO_ALLOCATOR_HPP_
+#define UTILS_INCLUDE_LEVEL_ZERO_ALLOCATOR_HPP_
+
+#include <set>
+#include <unordered_map>
+
+#include "level_zero_utils.hpp"
+
+namespace lzu {
+
+struct CachingAllocatorOptions {
+  // When false every call goes straight to the allocate_*_memory / free_memory wrappers.
+  bool enabled = true;
+  // Requests up to this size are rounded to a size class and get their own driver allocation. Larger requests are
+  // carved out of segments that are split on allocation and coalesced on free.
+  size_t small_size_limit = 1 << 20;
+  // Large segments are allocated from the driver in multiples of this size.
+  size_t segment_granularity = 2 << 20;
+  // Free blocks are released back to the driver once the cache holds more than this.
+  size_t max_cached_bytes = size_t(1) << 30;
+};
+
+struct CachingAllocatorStats {
+  size_t allocated_bytes = 0;  // Handed out to callers, after rounding
+  size_t reserved_bytes = 0;   // Currently held from the driver
+  size_t cached_bytes = 0;     // Reserved but free
+  size_t peak_allocated_bytes = 0;
+  size_t peak_reserved_bytes = 0;
+  uint64_t cache_hits = 0;
+  uint64_t cache_misses = 0;
+  uint64_t driver_allocations = 0;
+  uint64_t driver_frees = 0;
+  uint64_t splits = 0;
+  uint64_t merges = 0;
+};
+
+// Caching allocator for USM memory. Free blocks are cached per (context, device, memory type, flags) pool and reused
+// by later requests of the same size class, so the steady state does not call zeMemAlloc* / zeMemFree at all.
+class CachingAllocator {
+ public:
+  explicit CachingAllocator(const CachingAllocatorOptions& options = CachingAllocatorOptions());
+  ~CachingAllocator();
+
+  // Process wide allocator. Setting LZU_DISABLE_CACHING_ALLOCATOR=1 in the environment turns caching off.
+  static CachingAllocator& get();
+
+  void* allocate_host(size_t size, size_t alignment, ze_context_handle_t context);
+
+  void* allocate_device(size_t size, size_t alignment, ze_device_mem_alloc_flags_t flags, uint32_t ordinal,
+                        ze_device_handle_t device, ze_context_handle_t context);
+
+  void* allocate_shared(size_t size, size_t alignment, ze_device_mem_alloc_flags_t dev_flags,
+                        ze_host_mem_alloc_flags_t host_flags, ze_device_handle_t device, ze_context_handle_t context,
+                        uint32_t ordinal = 0);
+
+  // Pointers that were not handed out by this allocator are passed on to free_memory.
+  void free(ze_context_handle_t context, void* ptr);
+
+  // Release unused segments until at most max_cached_bytes stay cached. Returns the number of bytes released.
+  size_t trim(size_t max_cached_bytes = 0);
+
+  // Release every unused segment, or only the ones of the given context. Must be called before destroy_context.
+  void empty_cache(ze_context_handle_t context = nullptr);
+
+  CachingAllocatorStats get_stats() const;
+  void reset_peak_stats();
+
+  bool enabled() const;
+  void set_enabled(bool enabled);
+
+  // Smallest block size and the largest alignment the cache can satisfy.
+  static constexpr size_t kMinBlockSize = 512;
+
+ private:
+  struct PoolKey {
+    ze_context_handle_t context;
+    ze_device_handle_t device;
+    ze_memory_type_t type;
+    ze_device_mem_alloc_flags_t device_flags;
+    ze_host_mem_alloc_flags_t host_flags;
+    uint32_t ordinal;
+    bool small;
+
+    bool operator<(const PoolKey& other) const;
+  };
+
+  struct Block;
+
+  struct BlockLess {
+    bool operator()(const Block* a, const Block* b) const;
+  };
+
+  struct BlockPool {
+    PoolKey key;
+    std::set<Block*, BlockLess> free_blocks;
+  };
+
+  struct Block {
+    BlockPool* pool = nullptr;
+    char* ptr = nullptr;
+    size_t size = 0;
+    bool allocated = false;
+    // Neighbours inside the same driver allocation
+    Block* prev = nullptr;
+    Block* next = nullptr;
+  };
+
+  void* allocate(PoolKey key, size_t size, size_t alignment);
+  void* driver_allocate(const PoolKey& key, size_t size, size_t alignment);
+  void release_block(Block* block);
+  size_t release_free_segments(size_t max_cached_bytes, ze_context_handle_t context);
+  size_t round_size(size_t size) const;
+
+  CachingAllocatorOptions options_;
+  mutable std::mutex mutex_;
+  std::map<PoolKey, BlockPool> pools_;
+  std::unordered_map<void*, Block*> allocated_blocks_;
+  CachingAllocatorStats stats_;
+};
+
+// Drop-in replacements for the allocate_*_memory / free_memory wrappers that go through CachingAllocator::get().
+namespace cached {
+
+void* allocate_host_memory(const size_t size, const size_t alignment, const ze_context_handle_t context);
+
+void* allocate_device_memory(const size_t size, const size_t alignment, const ze_device_mem_alloc_flags_t flags,
+                             const uint32_t ordinal, ze_device_handle_t device_handle, ze_context_handle_t context);
+
+void* allocate_shared_memory(const size_t size, const size_t alignment, const ze_device_mem_alloc_flags_t dev_flags,
+                             const ze_host_mem_alloc_flags_t host_flags, ze_device_handle_t device,
+                             ze_context_handle_t context, const uint32_t ordinal = 0);
+
+void free_memory(ze_context_handle_t context, void* ptr);
+
+}  // namespace cached
+
+}  // namespace lzu
+
+#endif  // UTILS_INCLUDE_LEVEL_ZERO_ALLOCATOR_HPP_
@@ -0,0 +1,123 @@
+// Copyright 2020 Intel Corporation
+#ifndef UTILS_INCLUDE_LEVEL_ZERO_ASYNC_HPP_
+#define UTILS_INCLUDE_LEVEL_ZERO_ASYNC_HPP_
+
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <thread>
+
+#include "level_zero_utils.hpp"
+
+#if defined(__cpp_impl_coroutine)
+#if __has_include(<coroutine>)
+#include <coroutine>
+#define LZU_HAS_COROUTINES 1
+#endif
+#endif
+
+namespace lzu {
+
+struct ReactorOptions {
+  uint32_t spin_polls = 64;         // Idle polling rounds with only a yield in between
+  uint64_t min_sleep_ns = 2000;     // First sleep after spinning, doubled every idle round
+  uint64_t max_sleep_ns = 1000000;  // Longest sleep between polls
+};
+
+struct ReactorStats {
+  uint64_t watches = 0;      // Events and fences handed to the reactor
+  uint64_t completions = 0;  // Callbacks run
+  uint64_t polls = 0;        // Polling rounds over all pending watches
+  uint64_t sleeps = 0;       // Rounds that slept instead of yielding
+};
+
+// Completion of events and fences without a host thread blocked per submission. One reactor thread polls every
+// pending event or fence and runs its callback once it signals. While completions keep arriving the thread only
+// yields between rounds. Once idle it sleeps with exponential backoff, and a new watch wakes it.
+//
+// Callbacks run on the reactor thread, so they should be short. The result is ZE_RESULT_SUCCESS once signaled, a
+// driver error, or ZE_RESULT_NOT_READY when the reactor is destroyed first.
+class CompletionReactor {
+ public:
+  typedef std::function<void(ze_result_t)> Callback;
+
+  explicit CompletionReactor(const ReactorOptions& options = ReactorOptions());
+  ~CompletionReactor();
+
+  CompletionReactor(const CompletionReactor&) = delete;
+  CompletionReactor& operator=(const CompletionReactor&) = delete;
+
+  // Process wide reactor.
+  static CompletionReactor& get();
+
+  void on_event(ze_event_handle_t event, Callback callback);
+  void on_fence(ze_fence_handle_t fence, Callback callback);
+
+  // Futures become ready when the event or fence signals and hold a std::runtime_error on failure.
+  std::future<void> when_event(ze_event_handle_t event);
+  std::future<void> when_fence(ze_fence_handle_t fence);
+
+#ifdef LZU_HAS_COROUTINES
+  // co_await reactor.event(e) suspends until e signals and resumes on the reactor thread. Signaled events do not
+  // suspend at all. The co_await expression yields the ze_result_t.
+  class Awaitable {
+   public:
+    Awaitable(CompletionReactor* reactor, ze_event_handle_t event, ze_fence_handle_t fence)
+        : reactor_(reactor), event_(event), fence_(fence) {}
+
+    bool await_ready() {
+      result_ = event_ ? zeEventQueryStatus(event_) : zeFenceQueryStatus(fence_);
+      return result_ != ZE_RESULT_NOT_READY;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle) {
+      Callback resume = [this, handle](ze_result_t result) {
+        result_ = result;
+        handle.resume();
+      };
+      if (event_) {
+        reactor_->on_event(event_, resume);
+      } else {
+        reactor_->on_fence(fence_, resume);
+      }
+    }
+
+    ze_result_t await_resume() const { return result_; }
+
+   private:
+    CompletionReactor* reactor_;
+    ze_event_handle_t event_;
+    ze_fence_handle_t fence_;
+    ze_result_t result_ = ZE_RESULT_NOT_READY;
+  };
+
+  Awaitable event(ze_event_handle_t event) { return Awaitable(this, event, nullptr); }
+  Awaitable fence(ze_fence_handle_t fence) { return Awaitable(this, nullptr, fence); }
+#endif
+
+  size_t pending() const;
+  ReactorStats get_stats() const;
+
+ private:
+  struct Watch {
+    ze_event_handle_t event = nullptr;
+    ze_fence_handle_t fence = nullptr;
+    Callback callback;
+  };
+
+  void add(Watch watch);
+  void run();
+
+  ReactorOptions options_;
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  std::vector<Watch> incoming_;  // Watches not picked up by the reactor thread yet
+  size_t pending_ = 0;           // Incoming plus the ones being polled
+  bool stop_ = false;
+  ReactorStats stats_;
+  std::thread thread_;
+};
+
+}  // namespace lzu
+
+#endif  // UTILS_INCLUDE_LEVEL_ZERO_ASYNC_HPP_
@@ -0,0 +1,110 @@
+// Copyright 2020 Intel Corporation
+#ifndef UTILS_INCLUDE_LEVEL_ZERO_AUTOTUNE_HPP_
+#define UTILS_INCLUDE_LEVEL_ZERO_AUTOTUNE_HPP_
+
+#include <functional>
+
+#include "level_zero_kernel.hpp"
+
+namespace lzu {
+
+struct TuningEntry {
+  std::array<uint32_t, 3> group_size = {{1, 1, 1}};
+  double kernel_ns = 0;  // Median kernel time of the winner when it was tuned
+};
+
+struct TuningDatabaseStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t stores = 0;
+  uint64_t errors = 0;  // Failed writes and malformed lines
+};
+
+// Persistent group sizes keyed by device UUID, driver version, kernel name and global size. The database is a text
+// file with one entry per line, written to a temporary file and renamed over the old one on every store. Devices
+// without a device_key() always miss and store nothing.
+class TuningDatabase {
+ public:
+  // Empty path means $LZU_TUNING_DB, then $XDG_CACHE_HOME/lzu/tuning.db, then $HOME/.cache/lzu/tuning.db.
+  explicit TuningDatabase(const std::string& path = std::string(), bool enabled = true);
+
+  // Process wide database. Setting LZU_DISABLE_TUNING_DB=1 in the environment keeps it in memory only.
+  static TuningDatabase& get();
+
+  bool lookup(ze_device_handle_t device, const std::string& kernel_name, const std::array<uint32_t, 3>& global_size,
+              TuningEntry* entry);
+
+  void store(ze_device_handle_t device, const std::string& kernel_name, const std::array<uint32_t, 3>& global_size,
+             const TuningEntry& entry);
+
+  // Forget every entry, in memory and on disk.
+  void clear();
+
+  const std::string& path() const { return path_; }
+  size_t size() const;
+  TuningDatabaseStats get_stats() const;
+
+ private:
+  std::string make_key(ze_device_handle_t device, const std::string& kernel_name,
+                       const std::array<uint32_t, 3>& global_size);
+  void load(std::map<std::string, TuningEntry>* entries);
+  void save();
+
+  std::string path_;
+  bool enabled_;
+  mutable std::mutex mutex_;
+  std::map<std::string, TuningEntry> entries_;
+  TuningDatabaseStats stats_;
+};
+
+struct AutotuneOptions {
+  uint32_t repetitions = 5;      // Timed launches per candidate, the median counts
+  uint32_t max_candidates = 24;  // Largest shapes first, the driver's suggestion is always tried
+  bool tune_on_miss = false;     // Let apply() tune keys the database does not know yet
+  // Shape for keys the database does not know, instead of the driver's suggestion. Zeros mean the suggestion.
+  std::array<uint32_t, 3> default_group_size = {{0, 0, 0}};
+  // Called once a candidate ran on its own, with the queue idle. Returns whether the output is right, and leaves the
+  // buffers ready for the next run. Candidates it rejects are neither timed nor stored.
+  std::function<bool(const std::array<uint32_t, 3>& group_size)> validate;
+};
+
+struct AutotuneResult {
+  TuningEntry best;
+  std::vector<TuningEntry> candidates;  // Every shape that was timed, in launch order
+};
+
+// Picks work-group shapes for (kernel, global size, device). Shapes come from the tuning database, or from
+// zeKernelSuggestGroupSize before the key has been tuned. Only shapes that divide the global size evenly are
+// considered, so kernels without bounds checks stay correct. Kernels whose result depends on the shape should pin
+// default_group_size and check the candidates with validate, since the fastest shape wins otherwise.
+class Autotuner {
+ public:
+  Autotuner(ze_context_handle_t context, ze_device_handle_t device, TuningDatabase* database = &TuningDatabase::get(),
+            const AutotuneOptions& options = AutotuneOptions());
+
+  std::array<uint32_t, 3> group_size(ze_kernel_handle_t kernel, const std::string& kernel_name,
+                                     const std::array<uint32_t, 3>& global_size);
+
+  // Sets the chosen group size on the launch descriptor and returns the group count that covers global_size.
+  ze_group_count_t apply(KernelLaunch& launch, const std::string& kernel_name,
+                         const std::array<uint32_t, 3>& global_size);
+
+  // Times every candidate with kernel timestamps and stores the fastest. The kernel runs with the arguments already
+  // set on the descriptor, many times over, so it has to produce the same result when repeated.
+  AutotuneResult tune(KernelLaunch& launch, const std::string& kernel_name, const std::array<uint32_t, 3>& global_size);
+
+  std::vector<std::array<uint32_t, 3>> candidates(ze_kernel_handle_t kernel,
+                                                  const std::array<uint32_t, 3>& global_size) const;
+
+ private:
+  ze_context_handle_t context_;
+  ze_device_handle_t device_;
+  TuningDatabase* database_;
+  AutotuneOptions options_;
+  ze_device_properties_t properties_;
+  ze_device_compute_properties_t compute_properties_;
+};
+
+}  // namespace lzu
+
+#endif  // UTILS_INCLUDE_LEVEL_ZERO_AUTOTUNE_HPP_
@@ -0,0 +1,41 @@
+// Copyright 2020 Intel Corporation
+#ifndef UTILS_INCLUDE_LEVEL_ZERO_CACHE_FILES_HPP_
+#define UTILS_INCLUDE_LEVEL_ZERO_CACHE_FILES_HPP_
+
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "level_zero_utils.hpp"
+
+namespace lzu {
+
+// Helpers shared by the files kept across processes: the module cache, the tuning database and the offload profiles.
+
+// Creates every missing directory of path, or of path up to its last '/'.
+bool make_directories(const std::string& path);
+bool make_parent_directories(const std::string& path);
+
+// $variable when set, else name in $XDG_CACHE_HOME/lzu, $HOME/.cache/lzu or /tmp/lzu.
+std::string default_cache_path(const char* variable, const std::string& name);
+
+// Runs write on a temporary file next to path and renames it over path, so readers see either the old or the new
+// file, never a partial one. Returns false and leaves path alone when writing or renaming fails.
+bool write_file_atomically(const std::string& path, const std::function<void(std::ostream&)>& write);
+
+// Removes the temporary files write_file_atomically left in directory when its process died before the rename: those
+// of processes that are gone, and those older than max_age_seconds, which also covers reused pids. Returns how many.
+uint32_t remove_orphaned_temporary_files(const std::string& directory, uint32_t max_age_seconds = 3600);
+
+// Hex device UUID plus "-" and the version of the driver that lists the device, sub-devices included. Entries measured
+// or built for one device and driver must not be used with another. Empty when no driver lists the device: callers
+// then neither read nor write their files, an entry without the driver version would outlive a driver upgrade.
+std::string device_key(ze_device_handle_t device);
+
+// 0 without samples.
+double median(std::vector<double> samples);
+
+}  // namespace lzu
+
+#endif  // UTILS_INCLUDE_LEVEL_ZERO_CACHE_FILES_HPP_
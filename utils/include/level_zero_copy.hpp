@@ -0,0 +1,151 @@
+// Copyright 2020 Intel Corporation
+#ifndef UTILS_INCLUDE_LEVEL_ZERO_COPY_HPP_
+#define UTILS_INCLUDE_LEVEL_ZERO_COPY_HPP_
+
+#include <array>
+
+#include "level_zero_kernel.hpp"
+
+namespace lzu {
+
+// Copy implementations of kernels/copy_module.cl, plus the driver's own memory copy.
+enum class CopyVariant {
+  Driver,     // zeCommandListAppendMemoryCopy
+  Bytes,      // copy_u8
+  Words16,    // copy_u16, both pointers and the size 2-byte aligned
+  Words32,    // copy_u32
+  Words64,    // copy_u64
+  Unaligned,  // copy_unaligned, vload16/vstore16 at any alignment
+  Vector16,   // copy_x16, src and dst equally misaligned modulo 16
+  Vector32,   // copy_x32, src and dst equally misaligned modulo 32
+  Block,      // copy_block, sub-group block reads, only built with cl_intel_subgroups
+  Count
+};
+
+const char* to_string(CopyVariant variant);
+
+// Kernel name of a variant, null for Driver.
+const char* copy_kernel_name(CopyVariant variant);
+
+// Bytes one work-item moves per loop iteration.
+size_t copy_unit(CopyVariant variant);
+
+// Variants that can copy bytes from src to dst, best first. The list always ends with Driver.
+std::vector<CopyVariant> copy_candidates(const void* dst, const void* src, size_t bytes);
+
+// Appends copies with the kernels of copy_module. Each copy takes the first candidate whose kernel the module has,
+// so modules built without some of the kernels still work and fall back to the driver copy in the end. Command lists
+// must belong to a compute queue. Not thread safe, the launch descriptors are shared between calls.
+class CopyKernels {
+ public:
+  CopyKernels(ze_module_handle_t module, ze_device_handle_t device);
+
+  CopyVariant append_copy(ze_command_list_handle_t command_list, void* dst, const void* src, size_t bytes,
+                          ze_event_handle_t signal_event = nullptr, uint32_t num_wait_events = 0,
+                          ze_event_handle_t* wait_events = nullptr);
+
+  bool available(CopyVariant variant) const;
+
+  // Group count the variant is launched with for a copy of bytes.
+  ze_group_count_t group_count(CopyVariant variant, size_t bytes) const;
+
+  uint32_t group_size() const { return group_size_; }
+
+ private:
+  KernelRegistry registry_;
+  std::vector<KernelLaunch*> kernels_;  // By variant, null when the module lacks the kernel
+  uint32_t group_size_;
+  uint32_t max_groups_;  // Enough groups to fill every hardware thread, the kernels loop over the rest
+};
+
+// One copy of a scatter/gather batch, laid out like struct copy_descriptor in copy_module.cl.
+struct CopyDescriptor {
+  void* dst;
+  const void* src;
+  uint64_t bytes;
+};
+
+enum class BatchMethod {
+  Kernel,    // copy_batch, one launch over a descriptor table
+  Indirect,  // copy_data_indirect, one launch when every copy has the same size in whole uints
+  Driver,    // One zeCommandListAppendMemoryCopy per merged run and a single event for the batch
+  Count
+};
+
+const char* to_string(BatchMethod method);
+
+struct BatchCopyStats {
+  uint64_t batches = 0;
+  uint64_t copies = 0;  // Descriptors passed in
+  uint64_t merged = 0;  // Descriptors folded into the previous one because both ranges continued it
+  uint64_t bytes = 0;
+  uint64_t commands = 0;  // Launches and driver copies appended
+  std::array<uint64_t, static_cast<size_t>(BatchMethod::Count)> by_method = {};
+};
+
+// Host time of the same copies done one command and one event each, against one batch.
+struct BatchCopyReport {
+  uint32_t copies = 0;
+  uint64_t bytes = 0;
+  BatchMethod method = BatchMethod::Driver;
+  double individual_ns = 0;
+  double batched_ns = 0;
+
+  bool pays_off() const { return batched_ns < individual_ns; }
+  double speedup() const { return batched_ns > 0 ? individual_ns / batched_ns : 0; }
+};
+
+// Scatter/gather copies with one command per batch. Adjacent copies are merged first. The kernel methods need a
+// compute command list and every pointer to be a USM allocation of the context, anything else is appended as driver
+// copies that share one signal event. Descriptor tables live in host memory the device reads directly and are kept
+// until reset(), which may only be called once the lists that used them have completed. Not thread safe.
+class BatchCopier {
+ public:
+  // Without a module, or with one that lacks both kernels, every batch uses driver copies. check_pointers = false
+  // skips the zeMemGetAllocProperties call per pointer for callers that only ever pass USM allocations.
+  // indirect_rows says the module's copy_data_indirect spreads each buffer over dimension 1, as the one of
+  // copy_module.cl does. Modules with the older kernel, which copies a whole buffer per work-item, need false and get a
+  // 1-D launch. The kernels have the same arguments, so the module itself can not tell.
+  BatchCopier(ze_context_handle_t context, ze_device_handle_t device, ze_module_handle_t module = nullptr,
+              bool check_pointers = true, bool indirect_rows = true);
+  ~BatchCopier();
+
+  BatchCopier(const BatchCopier&) = delete;
+  BatchCopier& operator=(const BatchCopier&) = delete;
+
+  BatchMethod append(ze_command_list_handle_t command_list, const std::vector<CopyDescriptor>& copies,
+                     ze_event_handle_t signal_event = nullptr, uint32_t num_wait_events = 0,
+                     ze_event_handle_t* wait_events = nullptr);
+
+  // Method append() picks for copies.
+  BatchMethod method(const std::vector<CopyDescriptor>& copies) const;
+
+  // Releases the descriptor tables.
+  void reset();
+
+  // Runs copies both ways on a compute queue of its own, repetitions times after one warmup, and reports the median
+  // host time of each.
+  BatchCopyReport compare(const std::vector<CopyDescriptor>& copies, uint32_t repetitions = 5);
+
+  const BatchCopyStats& stats() const { return stats_; }
+
+ private:
+  BatchMethod choose(const std::vector<CopyDescriptor>& runs) const;
+  void* table(size_t bytes);
+
+  ze_context_handle_t context_;
+  ze_device_handle_t device_;
+  KernelRegistry registry_;
+  KernelLaunch* batch_ = nullptr;     // copy_batch
+  KernelLaunch* indirect_ = nullptr;  // copy_data_indirect
+  bool indirect_rows_ = false;        // copy_data_indirect spreads each buffer over dimension 1
+  uint32_t max_group_size_;
+  uint32_t max_groups_;
+  bool check_pointers_;
+  std::vector<void*> tables_;
+  BatchCopyStats stats_;
+};
+
+}  // namespace lzu
+
+#endif  // UTILS_INCLUDE_LEVEL_ZERO_COPY_HPP_
@@ -0,0 +1,83 @@
+// Copyright 2020 Intel Corporation
+#ifndef UTILS_INCLUDE_LEVEL_ZERO_DEVICE_REGISTRY_HPP_
+#define UTILS_INCLUDE_LEVEL_ZERO_DEVICE_REGISTRY_HPP_
+
+#include <unordered_map>
+
+#include "level_zero_utils.hpp"
+
+namespace lzu {
+
+struct DeviceInfo {
+  ze_driver_handle_t driver = nullptr;
+  ze_device_handle_t device = nullptr;
+  ze_context_handle_t context = nullptr;  // Shared by every device of the driver, owned by the registry
+  ze_device_properties_t properties = {};
+  ze_device_compute_properties_t compute_properties = {};
+  std::vector<ze_device_memory_properties_t> memory_properties;
+  std::vector<ze_command_queue_group_properties_t> queue_groups;
+};
+
+struct DriverInfo {
+  ze_driver_handle_t driver = nullptr;
+  ze_driver_properties_t properties = {};
+  ze_context_handle_t context = nullptr;
+  std::vector<size_t> devices;  // Indexes into DeviceRegistry::devices()
+};
+
+// Drivers and devices of the process, discovered once with one thread per driver. Every property the wrapper asks for
+// repeatedly is read at discovery, later lookups are plain reads without locks or driver calls. zeInit has to be
+// called before the first get().
+class DeviceRegistry {
+ public:
+  static DeviceRegistry& get();
+
+  DeviceRegistry(const DeviceRegistry&) = delete;
+  DeviceRegistry& operator=(const DeviceRegistry&) = delete;
+
+  // In driver order, then device order within the driver, like getSupportedDevices().
+  const std::vector<DeviceInfo>& devices() const { return devices_; }
+  const std::vector<DriverInfo>& drivers() const { return drivers_; }
+
+  // Null for handles the registry does not know, e.g. sub-devices.
+  const DeviceInfo* find(ze_device_handle_t device) const;
+  const DriverInfo* find(ze_driver_handle_t driver) const;
+
+  // Throws for unknown handles.
+  const DeviceInfo& device(ze_device_handle_t device) const;
+  ze_context_handle_t context(ze_driver_handle_t driver) const;
+
+  std::vector<std::pair<ze_driver_handle_t, ze_device_handle_t>> supported_devices() const;
+
+  // Wall time of discovery, including context creation.
+  double discovery_ms() const { return discovery_ms_; }
+
+ private:
+  DeviceRegistry();
+
+  std::vector<DriverInfo> drivers_;
+  std::vector<DeviceInfo> devices_;
+  std::unordered_map<ze_device_handle_t, size_t> device_index_;
+  double discovery_ms_ = 0;
+};
+
+namespace cached {
+
+// Drop-in replacements that read from DeviceRegistry::get() instead of calling the driver. Devices the registry does
+// not know fall through to the uncached call.
+std::vector<std::pair<ze_driver_handle_t, ze_device_handle_t>> getSupportedDevices();
+
+// The registry's shared context of the driver. Callers must not destroy it.
+ze_context_handle_t get_context(ze_driver_handle_t driver);
+
+ze_device_properties_t get_device_properties(ze_device_handle_t device);
+
+ze_device_compute_properties_t get_device_compute_properties(ze_device_handle_t device);
+
+std::vector<ze_command_queue_group_properties_t> get_command_queue_group_properties(ze_device_handle_t device);
+
+}  // namespace cached
+
+}  // namespace lzu
+
+#endif  // UTILS_INCLUDE_LEVEL_ZERO_DEVICE_REGISTRY_HPP_
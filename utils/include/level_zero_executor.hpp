@@ -0,0 +1,90 @@
+// Copyright 2020 Intel Corporation
+#ifndef UTILS_INCLUDE_LEVEL_ZERO_EXECUTOR_HPP_
+#define UTILS_INCLUDE_LEVEL_ZERO_EXECUTOR_HPP_
+
+#include <functional>
+#include <memory>
+
+#include "level_zero_device_registry.hpp"
+#include "level_zero_kernel.hpp"
+#include "level_zero_queues.hpp"
+#include "level_zero_utils.hpp"
+
+namespace lzu {
+
+// Part of a launch that runs on one device. Level Zero 1.0 has no global offset, so kernels get offset as an
+// argument from the prepare callback.
+struct Shard {
+  uint32_t device_index = 0;
+  uint32_t dimension = 0;
+  std::array<uint32_t, 3> offset = {{0, 0, 0}};  // In work-items
+  std::array<uint32_t, 3> size = {{0, 0, 0}};    // In work-items
+  ze_group_count_t group_count = {};
+  double kernel_ms = 0;  // Measured device time, filled in by run()
+};
+
+// Per device state of the executor. Devices of one driver share that driver's context, the queues, module, kernels
+// and events are per device. Allocations should go through the caching allocator with this context and device.
+struct ExecutorDevice {
+  ze_driver_handle_t driver = nullptr;
+  ze_device_handle_t device = nullptr;
+  ze_context_handle_t context = nullptr;
+  ze_device_properties_t properties = {};
+  ze_device_compute_properties_t compute_properties = {};
+  std::unique_ptr<DeviceQueues> queues;
+  std::unique_ptr<zeEventPool> events;
+  ze_module_handle_t module = nullptr;
+  std::unique_ptr<KernelRegistry> kernels;
+  // Relative share of the work, starts from the compute properties and follows measured throughput afterwards
+  double weight = 1;
+};
+
+// Shards a 1-D, 2-D or 3-D launch across every device along one dimension, sized by the relative weight of each
+// device, and rebalances the weights from the throughput measured with kernel timestamps on every run. Every device
+// gets at least one work-group when the launch has as many, so a device that measured slow once is still measured
+// on later runs. The contexts are the shared ones of the DeviceRegistry.
+class MultiDeviceExecutor {
+ public:
+  // Sets the kernel arguments of the shard and appends its uploads to the compute list of the device.
+  typedef std::function<void(const Shard&, ExecutorDevice&, KernelLaunch&)> PrepareFunction;
+  // Appends the readbacks of the shard, waiting on launch_event when they go to the copy list.
+  typedef std::function<void(const Shard&, ExecutorDevice&, ze_event_handle_t launch_event)> FinishFunction;
+
+  explicit MultiDeviceExecutor(
+      const std::vector<std::pair<ze_driver_handle_t, ze_device_handle_t>>& devices = cached::getSupportedDevices());
+  ~MultiDeviceExecutor();
+
+  MultiDeviceExecutor(const MultiDeviceExecutor&) = delete;
+  MultiDeviceExecutor& operator=(const MultiDeviceExecutor&) = delete;
+
+  // Build the module on every device.
+  void load_module(const uint8_t* data, size_t bytes, ze_module_format_t format, const char* build_flags);
+
+  // Split global_size along dimension in whole work-groups, proportionally to the device weights. Devices get no shard
+  // only when there are fewer groups than devices.
+  std::vector<Shard> plan(const std::array<uint32_t, 3>& global_size, const std::array<uint32_t, 3>& group_size,
+                          uint32_t dimension) const;
+
+  // Run one launch over all devices and wait for it. Returns the shards with their measured time.
+  std::vector<Shard> run(const std::string& kernel_name, const std::array<uint32_t, 3>& global_size,
+                         const std::array<uint32_t, 3>& group_size, const PrepareFunction& prepare,
+                         const FinishFunction& finish, uint32_t dimension = 0);
+
+  size_t device_count() const { return devices_.size(); }
+  ExecutorDevice& device(size_t index) { return *devices_.at(index); }
+
+  // Weight of the newest throughput sample when rebalancing, 1 uses only the last run.
+  void set_rebalance_rate(double rate) { rebalance_rate_ = rate; }
+
+ private:
+  void rebalance(const std::vector<Shard>& shards);
+
+  std::map<ze_driver_handle_t, ze_context_handle_t> contexts_;
+  std::vector<std::unique_ptr<ExecutorDevice>> devices_;
+  double rebalance_rate_ = 0.5;
+  bool measured_ = false;  // Weights hold throughput instead of the initial estimate
+};
+
+}  // namespace lzu
+
+#endif  // UTILS_INCLUDE_LEVEL_ZERO_EXECUTOR_HPP_
@@ -0,0 +1,57 @@
+// Copyright 2020 Intel Corporation
+#ifndef UTILS_INCLUDE_LEVEL_ZERO_HOST_KERNELS_HPP_
+#define UTILS_INCLUDE_LEVEL_ZERO_HOST_KERNELS_HPP_
+
+#include <string.h>
+
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "level_zero_utils.hpp"
+
+namespace lzu {
+
+// Arguments and shape of one launch, laid out the way zeKernelSetArgumentValue and zeKernelSetGroupSize take them.
+struct HostLaunch {
+  std::vector<std::vector<uint8_t>> arguments;  // Raw argument values in index order
+  std::array<uint32_t, 3> group_size = {{1, 1, 1}};
+  ze_group_count_t group_count = {};
+
+  template <typename T>
+  T argument(uint32_t index) const {
+    T value;
+    const std::vector<uint8_t>& bytes = arguments.at(index);
+    memcpy(&value, bytes.data(), std::min(bytes.size(), sizeof(T)));
+    return value;
+  }
+
+  template <typename T>
+  void set_argument(uint32_t index, const T& value) {
+    if (arguments.size() <= index) arguments.resize(index + 1);
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+    arguments[index].assign(bytes, bytes + sizeof(T));
+  }
+};
+
+typedef std::function<void(const HostLaunch&)> HostKernel;
+
+// Host version of copy_data, copy_data_indirect, copy_batch and the typed copies of copy_module.cl and of main_kernel
+// of spirv_0, null for other names. A launch is split over ThreadPool::get() by work-group, the way the device splits
+// it over its execution units, so the group count picked for the device also sizes the host launch. Pointers must be
+// host accessible: host or shared allocations, or plain host memory when no device is used at all.
+HostKernel find_host_kernel(const std::string& name);
+
+// Instruction set the host kernels run with: "avx512", "avx2" or "scalar". LZU_HOST_ISA=scalar|avx2 caps it, to
+// compare their results.
+const char* host_kernel_isa();
+
+// Lets the software driver run the host kernels, when it is the driver linked in. DeviceRegistry calls it before it
+// discovers the devices, LZU_SOFTWARE_KERNELS=0 skips it so every launch does nothing, for pure overhead measurements.
+void register_software_kernels();
+
+}  // namespace lzu
+
+#endif  // UTILS_INCLUDE_LEVEL_ZERO_HOST_KERNELS_HPP_
@@ -0,0 +1,92 @@
+// Copyright 2020 Intel Corporation
+#ifndef UTILS_INCLUDE_LEVEL_ZERO_KERNEL_HPP_
+#define UTILS_INCLUDE_LEVEL_ZERO_KERNEL_HPP_
+
+#include <memory>
+#include <unordered_map>
+
+#include "level_zero_utils.hpp"
+
+namespace lzu {
+
+struct KernelLaunchStats {
+  uint64_t argument_calls = 0;    // zeKernelSetArgumentValue calls issued
+  uint64_t argument_skips = 0;    // Calls skipped because the value did not change
+  uint64_t group_size_calls = 0;  // zeKernelSetGroupSize calls issued
+  uint64_t group_size_skips = 0;
+  uint64_t launches = 0;
+};
+
+// Launch descriptor of one kernel. Remembers the argument values and the group size last sent to the driver and only
+// forwards the ones that changed. The kernel must not be modified through set_argument_value or set_group_size
+// directly while a descriptor is in use, or the cached state goes stale.
+class KernelLaunch {
+ public:
+  explicit KernelLaunch(ze_kernel_handle_t kernel);
+
+  // A null value (local memory argument) is always forwarded.
+  void set_argument(uint32_t index, size_t size, const void* value);
+
+  template <typename T>
+  void set_argument(uint32_t index, const T& value) {
+    set_argument(index, sizeof(T), &value);
+  }
+
+  void set_group_size(uint32_t x, uint32_t y, uint32_t z);
+
+  void append(ze_command_list_handle_t command_list, const ze_group_count_t* group_count,
+              ze_event_handle_t signal_event, uint32_t num_wait_events, ze_event_handle_t* wait_events);
+
+  // Forget the cached state, the next calls are sent to the driver again.
+  void invalidate();
+
+  ze_kernel_handle_t kernel() const { return kernel_; }
+  const KernelLaunchStats& stats() const { return stats_; }
+
+ private:
+  struct Argument {
+    bool valid = false;
+    std::vector<uint8_t> value;
+  };
+
+  ze_kernel_handle_t kernel_;
+  std::vector<Argument> arguments_;
+  std::array<uint32_t, 3> group_size_ = {{0, 0, 0}};
+  KernelLaunchStats stats_;
+};
+
+// Module scoped kernel registry. Each kernel name is resolved with zeKernelCreate once, later lookups return the
+// same handle and launch descriptor. Kernels are destroyed with the registry or by clear(), which has to happen
+// before the module is destroyed.
+class KernelRegistry {
+ public:
+  explicit KernelRegistry(ze_module_handle_t module, ze_kernel_flags_t flags = 0);
+  ~KernelRegistry();
+
+  KernelRegistry(const KernelRegistry&) = delete;
+  KernelRegistry& operator=(const KernelRegistry&) = delete;
+
+  ze_kernel_handle_t get(const std::string& name);
+
+  KernelLaunch& launch(const std::string& name);
+
+  // Like launch(), but null when the module has no kernel of that name.
+  KernelLaunch* find(const std::string& name);
+
+  void clear();
+
+  // Totals over every kernel of the registry
+  KernelLaunchStats stats() const;
+
+  ze_module_handle_t module() const { return module_; }
+
+ private:
+  ze_module_handle_t module_;
+  ze_kernel_flags_t flags_;
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, std::unique_ptr<KernelLaunch>> kernels_;
+};
+
+}  // namespace lzu
+
+#endif  // UTILS_INCLUDE_LEVEL_ZERO_KERNEL_HPP_
@@ -0,0 +1,94 @@
+// Copyright 2020 Intel Corporation
+#ifndef UTILS_INCLUDE_LEVEL_ZERO_MIGRATION_HPP_
+#define UTILS_INCLUDE_LEVEL_ZERO_MIGRATION_HPP_
+
+#include <map>
+#include <mutex>
+
+#include "level_zero_kernel.hpp"
+#include "level_zero_utils.hpp"
+
+namespace lzu {
+
+enum class BufferAccess { Read, Write, ReadWrite };
+
+struct BufferAdvice {
+  bool read_mostly = false;   // Reads on the device and the host keep their own copies
+  bool prefer_device = true;  // Pages stay in device memory unless the host touches them
+};
+
+struct MigrationStats {
+  uint64_t prefetches = 0;  // Prefetches appended ahead of launches
+  uint64_t prefetched_bytes = 0;
+  uint64_t resident_skips = 0;   // Launches that read the buffer while it was still on the device
+  uint64_t launches = 0;         // Launches that declared the buffer
+  uint64_t host_migrations = 0;  // Host accesses that moved the buffer back to the host
+  uint64_t advice = 0;           // zeCommandListAppendMemAdvise calls
+};
+
+// Migration hints for shared allocations. Tracked buffers get read-mostly and preferred-location advice, and a launch
+// that declares the buffers it reads gets a prefetch for each of them appended in front of it, so pages move in bulk
+// instead of faulting in one by one while the kernel runs.
+//
+// Residency is followed from the declarations: a prefetch puts a buffer on the device and a host write, or a host read
+// of a buffer that is not read-mostly, takes it back. A buffer that is still resident is not prefetched again.
+// Untracked pointers in a declaration are ignored, so device and host allocations can be listed as well. Thread safe.
+//
+// Residency is an estimate made when the prefetch is appended, not when the list runs. It holds as long as lists are
+// executed in the order they were recorded and host_access() is called once the list that used the buffer completed.
+// A list that is recorded but never executed leaves its buffers marked resident, call host_access() for them.
+class MigrationPolicy {
+ public:
+  struct Access {
+    const void* ptr;
+    BufferAccess access;
+  };
+
+  explicit MigrationPolicy(ze_device_handle_t device);
+
+  MigrationPolicy(const MigrationPolicy&) = delete;
+  MigrationPolicy& operator=(const MigrationPolicy&) = delete;
+
+  // Start tracking a shared allocation, appending its advice to command_list. name labels the buffer in print().
+  void track(ze_command_list_handle_t command_list, const void* ptr, size_t size, const BufferAdvice& advice,
+             const std::string& name = "");
+  // Clears the advice of the buffer and stops tracking it, before it is freed.
+  void untrack(ze_command_list_handle_t command_list, const void* ptr);
+
+  // Appends a prefetch for every buffer of buffers the kernel reads that is not on the device already.
+  void prefetch(ze_command_list_handle_t command_list, const std::vector<Access>& buffers);
+
+  // prefetch(), then the launch.
+  void launch(ze_command_list_handle_t command_list, KernelLaunch& kernel, const ze_group_count_t& group_count,
+              const std::vector<Access>& buffers, ze_event_handle_t signal_event = nullptr,
+              uint32_t num_wait_events = 0, ze_event_handle_t* wait_events = nullptr);
+
+  // The host is about to touch the buffer that contains ptr.
+  void host_access(const void* ptr, BufferAccess access);
+
+  // Statistics of the buffer that contains ptr, zero for untracked pointers.
+  MigrationStats get_stats(const void* ptr) const;
+
+  // Per buffer statistics.
+  void print(std::ostream& out) const;
+
+ private:
+  struct Buffer {
+    size_t size = 0;
+    std::string name;
+    BufferAdvice advice;
+    bool on_device = false;
+    MigrationStats stats;
+  };
+
+  // Base address of the tracked buffer that contains ptr, or null. Caller holds mutex_.
+  const uint8_t* find(const void* ptr) const;
+
+  ze_device_handle_t device_;
+  mutable std::mutex mutex_;
+  std::map<const uint8_t*, Buffer> buffers_;  // By base address
+};
+
+}  // namespace lzu
+
+#endif  // UTILS_INCLUDE_LEVEL_ZERO_MIGRATION_HPP_
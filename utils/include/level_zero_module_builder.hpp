@@ -0,0 +1,102 @@
+// Copyright 2020 Intel Corporation
+#ifndef UTILS_INCLUDE_LEVEL_ZERO_MODULE_BUILDER_HPP_
+#define UTILS_INCLUDE_LEVEL_ZERO_MODULE_BUILDER_HPP_
+
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+
+#include "level_zero_kernel.hpp"
+#include "level_zero_module_cache.hpp"
+#include "level_zero_thread_pool.hpp"
+#include "level_zero_utils.hpp"
+
+namespace lzu {
+
+// A module build the driver rejected, with the build log it returned.
+class ModuleBuildError : public std::runtime_error {
+ public:
+  ModuleBuildError(const std::string& name, const std::string& reason, const std::string& build_log);
+
+  const std::string& module_name() const { return module_name_; }
+  const std::string& build_log() const { return build_log_; }
+
+ private:
+  std::string module_name_;
+  std::string build_log_;
+};
+
+// Destroys build_log, null allowed, and returns its text when the build failed and empty otherwise. A log the driver
+// fails to read or destroy is dropped, the build result stands without it.
+std::string take_module_build_log(ze_module_build_log_handle_t build_log, bool failed);
+
+struct ModuleBuildRequest {
+  std::string name;  // Key of the module in the builder, path when empty
+  ze_device_handle_t device = nullptr;
+  std::string path;               // Module file, mapped on the worker thread
+  const uint8_t* data = nullptr;  // In-memory module used instead of path, must outlive the build
+  size_t bytes = 0;
+  ze_module_format_t format = ZE_MODULE_FORMAT_IL_SPIRV;
+  std::string build_flags;
+};
+
+struct ModuleBuildStats {
+  uint64_t submitted = 0;
+  uint64_t built = 0;
+  uint64_t failed = 0;
+  double build_ns = 0;  // Sum of the build times, the wall time a serial build would have taken
+};
+
+// Builds modules on a thread pool. submit() returns at once with a future of the module, so the kernels of a module
+// that finished can be used while others are still building. A failed build makes the future throw
+// ModuleBuildError with the build log. SPIR-V builds go through the module cache when one is given.
+//
+// The builder owns the modules and kernel registries it hands out. The destructor waits for builds in flight, then
+// destroys them. Waiting for a module from a task of the same pool can deadlock once every worker waits.
+class ModuleBuilder {
+ public:
+  explicit ModuleBuilder(ze_context_handle_t context, ThreadPool* pool = &ThreadPool::get(),
+                         ModuleCache* cache = &ModuleCache::get());
+  ~ModuleBuilder();
+
+  ModuleBuilder(const ModuleBuilder&) = delete;
+  ModuleBuilder& operator=(const ModuleBuilder&) = delete;
+
+  // Names must be unique within the builder.
+  std::shared_future<ze_module_handle_t> submit(const ModuleBuildRequest& request);
+  std::vector<std::shared_future<ze_module_handle_t>> submit(const std::vector<ModuleBuildRequest>& requests);
+
+  // Wait for this one module. Throws its ModuleBuildError, or std::runtime_error for unknown names.
+  ze_module_handle_t module(const std::string& name);
+  KernelRegistry& kernels(const std::string& name);
+
+  // True once the build finished or failed.
+  bool ready(const std::string& name) const;
+
+  // Wait for every build submitted so far and return the failures.
+  std::vector<ModuleBuildError> wait_all();
+
+  ModuleBuildStats get_stats() const;
+
+ private:
+  struct Entry {
+    std::shared_future<ze_module_handle_t> module;
+    std::unique_ptr<KernelRegistry> kernels;
+  };
+
+  ze_module_handle_t build(const ModuleBuildRequest& request, const std::string& name);
+  std::shared_future<ze_module_handle_t> find(const std::string& name) const;
+
+  ze_context_handle_t context_;
+  ThreadPool* pool_;
+  ModuleCache* cache_;
+  mutable std::mutex mutex_;
+  std::map<std::string, Entry> entries_;
+  ModuleBuildStats stats_;
+};
+
+}  // namespace lzu
+
+#endif  // UTILS_INCLUDE_LEVEL_ZERO_MODULE_BUILDER_HPP_
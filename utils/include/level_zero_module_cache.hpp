@@ -0,0 +1,96 @@
+// Copyright 2020 Intel Corporation
+#ifndef UTILS_INCLUDE_LEVEL_ZERO_MODULE_CACHE_HPP_
+#define UTILS_INCLUDE_LEVEL_ZERO_MODULE_CACHE_HPP_
+
+#include "level_zero_utils.hpp"
+
+namespace lzu {
+
+// Specialization constants together with the size of each value, which ze_module_constants_t does not carry but the
+// module cache needs for its key.
+class SpecializationConstants {
+ public:
+  void set(uint32_t id, const void* value, size_t size);
+
+  template <typename T>
+  void set(uint32_t id, const T& value) {
+    set(id, &value, sizeof(T));
+  }
+
+  bool empty() const { return ids_.empty(); }
+  const std::vector<uint32_t>& ids() const { return ids_; }
+  const std::vector<std::vector<uint8_t>>& values() const { return values_; }
+
+  // Valid until the next call to set()
+  const ze_module_constants_t* get() const;
+
+ private:
+  std::vector<uint32_t> ids_;
+  std::vector<std::vector<uint8_t>> values_;
+  mutable std::vector<const void*> value_pointers_;
+  mutable ze_module_constants_t constants_ = {};
+};
+
+struct ModuleCacheOptions {
+  bool enabled = true;
+  // Empty means $LZU_MODULE_CACHE_DIR, then $XDG_CACHE_HOME/lzu/modules, then $HOME/.cache/lzu/modules.
+  std::string directory;
+  // Least recently used entries are evicted once the cache directory grows beyond this.
+  size_t max_bytes = 256 << 20;
+};
+
+struct ModuleCacheStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t stores = 0;
+  uint64_t evictions = 0;
+  uint64_t errors = 0;  // Unreadable, corrupt or rejected entries
+};
+
+// Persistent cache of native module binaries. SPIR-V modules are keyed by a hash of the IL bytes, the build flags,
+// the device UUID, the driver version and the specialization constants. A miss builds from IL and stores the result
+// of zeModuleGetNativeBinary, a hit reloads the stored binary with ZE_MODULE_FORMAT_NATIVE. Devices without a
+// device_key() always build from IL.
+class ModuleCache {
+ public:
+  explicit ModuleCache(const ModuleCacheOptions& options = ModuleCacheOptions());
+
+  // Process wide cache. Setting LZU_DISABLE_MODULE_CACHE=1 in the environment turns it off.
+  static ModuleCache& get();
+
+  ze_module_handle_t create_module(ze_context_handle_t context, ze_device_handle_t device, const uint8_t* data,
+                                   size_t bytes, const ze_module_format_t format, const char* build_flags,
+                                   ze_module_build_log_handle_t* p_build_log,
+                                   const SpecializationConstants* constants = nullptr);
+
+  // Remove every cache entry from disk.
+  void clear();
+
+  const std::string& directory() const { return options_.directory; }
+  ModuleCacheStats get_stats() const;
+
+ private:
+  std::string make_key(ze_device_handle_t device, const uint8_t* data, size_t bytes, const char* build_flags,
+                       const SpecializationConstants* constants);
+  std::string entry_path(const std::string& key) const;
+  bool load(const std::string& key, BinaryView* entry);
+  void store(const std::string& key, const std::vector<uint8_t>& binary);
+  void evict();
+
+  ModuleCacheOptions options_;
+  mutable std::mutex mutex_;
+  ModuleCacheStats stats_;
+};
+
+namespace cached {
+
+// Drop-in replacement for create_module that goes through ModuleCache::get().
+ze_module_handle_t create_module(ze_context_handle_t context, ze_device_handle_t device, const uint8_t* data,
+                                 size_t bytes, const ze_module_format_t format, const char* build_flags,
+                                 ze_module_build_log_handle_t* p_build_log);
+
+}  // namespace cached
+
+}  // namespace lzu
+
+#endif  // UTILS_INCLUDE_LEVEL_ZERO_MODULE_CACHE_HPP_
@@ -0,0 +1,97 @@
+// Copyright 2020 Intel Corporation
+#ifndef UTILS_INCLUDE_LEVEL_ZERO_MODULE_VARIANTS_HPP_
+#define UTILS_INCLUDE_LEVEL_ZERO_MODULE_VARIANTS_HPP_
+
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "level_zero_kernel.hpp"
+#include "level_zero_module_builder.hpp"
+#include "level_zero_module_cache.hpp"
+#include "level_zero_utils.hpp"
+
+namespace lzu {
+
+// One specialized build of a module and its kernels. Destroyed once the variant cache evicted it and the last
+// holder let go of it.
+class ModuleVariant {
+ public:
+  explicit ModuleVariant(ze_module_handle_t module);
+  ~ModuleVariant();
+
+  ModuleVariant(const ModuleVariant&) = delete;
+  ModuleVariant& operator=(const ModuleVariant&) = delete;
+
+  ze_module_handle_t module() const { return module_; }
+  KernelRegistry& kernels() { return kernels_; }
+
+ private:
+  ze_module_handle_t module_;
+  KernelRegistry kernels_;
+};
+
+struct ModuleVariantStats {
+  uint64_t hits = 0;
+  uint64_t builds = 0;
+  uint64_t failures = 0;
+  uint64_t evictions = 0;
+  double build_ns = 0;
+};
+
+// Builds of one SPIR-V module specialized with different constant sets, so the compiler can fold shapes that are
+// otherwise kernel arguments. Variants are keyed by the constants sorted by id, and the least recently used one is
+// evicted once more than max_variants are held. A variant in use stays alive until its holder releases it.
+// Concurrent requests for the same constants share one build, a failed one throws ModuleBuildError. Thread safe.
+class ModuleVariants {
+ public:
+  // binary must outlive the cache. Builds go through the module cache when one is given.
+  ModuleVariants(ze_context_handle_t context, ze_device_handle_t device, const uint8_t* binary, size_t bytes,
+                 const std::string& build_flags = "", size_t max_variants = 8,
+                 ModuleCache* cache = &ModuleCache::get());
+
+  ModuleVariants(const ModuleVariants&) = delete;
+  ModuleVariants& operator=(const ModuleVariants&) = delete;
+
+  // The variant for constants, built on first use. Empty constants give the unspecialized module.
+  std::shared_ptr<ModuleVariant> get(const SpecializationConstants& constants);
+
+  // Drop every variant held by the cache.
+  void clear();
+
+  size_t size() const;
+  size_t max_variants() const { return max_variants_; }
+  ModuleVariantStats get_stats() const;
+
+ private:
+  typedef std::shared_future<std::shared_ptr<ModuleVariant>> Pending;
+  struct Entry {
+    Pending variant;
+    std::list<std::string>::iterator position;  // In lru_
+    uint64_t serial;                             // Tells a rebuilt entry from the one a failed build inserted
+  };
+
+  static std::string make_key(const SpecializationConstants& constants);
+  std::shared_ptr<ModuleVariant> build(const SpecializationConstants& constants);
+  // Caller holds mutex_. Evicted variants go to released, to be dropped after unlocking.
+  void evict(std::vector<Pending>* released);
+
+  ze_context_handle_t context_;
+  ze_device_handle_t device_;
+  const uint8_t* binary_;
+  size_t bytes_;
+  std::string build_flags_;
+  size_t max_variants_;
+  ModuleCache* cache_;
+  mutable std::mutex mutex_;
+  std::map<std::string, Entry> variants_;
+  std::list<std::string> lru_;  // Most recently used first
+  uint64_t next_serial_ = 0;
+  ModuleVariantStats stats_;
+};
+
+}  // namespace lzu
+
+#endif  // UTILS_INCLUDE_LEVEL_ZERO_MODULE_VARIANTS_HPP_
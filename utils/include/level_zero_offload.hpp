@@ -0,0 +1,153 @@
+// Copyright 2020 Intel Corporation
+#ifndef UTILS_INCLUDE_LEVEL_ZERO_OFFLOAD_HPP_
+#define UTILS_INCLUDE_LEVEL_ZERO_OFFLOAD_HPP_
+
+#include <array>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+
+#include "level_zero_kernel.hpp"
+#include "level_zero_thread_pool.hpp"
+#include "level_zero_utils.hpp"
+
+namespace lzu {
+
+enum class OffloadKind { Copy, Kernel, Count };
+enum class OffloadTarget { Host, Device };
+
+const char* to_string(OffloadKind kind);
+const char* to_string(OffloadTarget target);
+
+// Copy sizes the bandwidths of a profile are measured at, from cache resident to past the last level cache. Copy times
+// in between are interpolated, beyond the largest size its bandwidth holds.
+const std::array<uint64_t, 4> kOffloadCopySizes = {{uint64_t(64) << 10, uint64_t(1) << 20, uint64_t(4) << 20,
+                                                     uint64_t(16) << 20}};
+
+// Measured costs the policy decides with, in nanoseconds as seen from the host.
+struct OffloadProfile {
+  std::string device_key;       // Device UUID and driver version the costs were measured on
+  double launch_ns = 0;         // Append, execute and synchronize of one work-group
+  double copy_ns = 0;           // The same for a 64-byte device copy
+  double event_ns = 0;          // Signaling an event and waiting for it on the host, on top of copy_ns
+  double host_dispatch_ns = 0;  // Spreading one operation over the host thread pool
+  // Host to device copy bandwidth of the device and memcpy bandwidth of the host thread pool, at kOffloadCopySizes
+  std::array<double, 4> device_bytes_per_ns = {};
+  std::array<double, 4> host_bytes_per_ns = {};
+
+  bool valid() const;
+
+  // Time of moving bytes on either side, fixed costs excluded.
+  double device_transfer_ns(uint64_t bytes) const;
+  double host_transfer_ns(uint64_t bytes) const;
+};
+
+// Default profile file: $LZU_OFFLOAD_PROFILE, else offload.profile in $XDG_CACHE_HOME/lzu or ~/.cache/lzu.
+std::string default_offload_profile_path();
+
+// The profile file holds one line per device below a version line. load fails when the file has none for device_key,
+// device_key is empty or the file was written in another version. save skips profiles that are not valid().
+bool load_offload_profile(const std::string& path, const std::string& device_key, OffloadProfile* profile);
+bool save_offload_profile(const std::string& path, const OffloadProfile& profile);
+
+// Measures every cost of the profile. kernel, when given, is launched with one work-group for launch_ns, otherwise
+// launch_ns is taken from the copy.
+OffloadProfile calibrate_offload(ze_context_handle_t context, ze_device_handle_t device, ThreadPool* pool,
+                                 KernelLaunch* kernel = nullptr);
+
+struct OffloadCounts {
+  uint64_t host = 0;
+  uint64_t device = 0;
+  uint64_t forced = 0;    // Calls that had only one choice: device memory, no host implementation or earlier commands
+  uint64_t explored = 0;  // Host executions of kernels predicted faster on the device, to measure their host time
+  uint64_t host_bytes = 0;
+  uint64_t device_bytes = 0;
+  double host_ns = 0;             // Measured time of the host executions
+  double predicted_host_ns = 0;   // Predicted time of the same host executions
+  double predicted_saved_ns = 0;  // Predicted device cost minus predicted host cost of every host decision
+};
+
+struct OffloadStats {
+  std::array<OffloadCounts, static_cast<size_t>(OffloadKind::Count)> by_kind = {};
+};
+
+// Decides per call whether an operation runs on the host thread pool or goes to the device through
+// append_memory_copy / append_launch_function, whichever the cost model predicts to be faster. The device side is
+// modeled as a full round trip, a fixed launch or copy cost plus the interpolated copy time of bytes, which is what an
+// operation costs when the host waits for it. Host kernels start from the host copy bandwidth and follow their
+// measured run times afterwards. A kernel whose host prediction is within a small factor of the device is run on the
+// host once before it has been measured there and again every few launches, so a wrong first guess or a host that
+// got faster does not keep it on the device for good.
+//
+// Host execution happens during the call: wait events are waited for on the host first and the signal event is
+// signaled from the host afterwards, so it runs ahead of every command still sitting in an unexecuted list. Once the
+// policy appended to a list it keeps sending the operations given with that list to the device, in order behind them,
+// until reset() says the list was executed to completion or reset. Commands appended by the caller are not seen: when
+// a host execution must not overtake them, execute the list first or pass an event they signal as wait event.
+// Thread safe.
+class OffloadPolicy {
+ public:
+  typedef std::function<void(size_t begin, size_t end)> HostKernel;
+
+  // Loads the profile of the device from path, or calibrates and saves it there.
+  OffloadPolicy(ze_context_handle_t context, ze_device_handle_t device, const std::string& path = "",
+                ThreadPool* pool = &ThreadPool::get());
+  OffloadPolicy(ze_context_handle_t context, ze_device_handle_t device, const OffloadProfile& profile,
+                ThreadPool* pool = &ThreadPool::get());
+
+  OffloadPolicy(const OffloadPolicy&) = delete;
+  OffloadPolicy& operator=(const OffloadPolicy&) = delete;
+
+  // Predicted host and device time of an operation touching bytes. name selects the host throughput of a kernel.
+  double host_cost(OffloadKind kind, uint64_t bytes, const std::string& name = "") const;
+  double device_cost(OffloadKind kind, uint64_t bytes, bool with_event) const;
+  OffloadTarget decide(OffloadKind kind, uint64_t bytes, bool with_event, const std::string& name = "") const;
+
+  // memcpy on the pool when both pointers are host accessible and that is predicted faster.
+  OffloadTarget copy(ze_command_list_handle_t command_list, void* dst, const void* src, size_t bytes,
+                     ze_event_handle_t signal_event = nullptr, uint32_t num_wait_events = 0,
+                     ze_event_handle_t* wait_events = nullptr);
+
+  // host(begin, end) over [0, items) on the pool, or kernel appended with group_count. bytes is the data the launch
+  // reads and writes. A null host function always launches on the device.
+  OffloadTarget launch(ze_command_list_handle_t command_list, KernelLaunch& kernel, const std::string& name,
+                       const ze_group_count_t& group_count, size_t items, uint64_t bytes, const HostKernel& host,
+                       ze_event_handle_t signal_event = nullptr, uint32_t num_wait_events = 0,
+                       ze_event_handle_t* wait_events = nullptr);
+
+  // Lets host execution pick operations given with command_list again, after it was reset or executed to completion.
+  void reset(ze_command_list_handle_t command_list);
+
+  const OffloadProfile& profile() const { return profile_; }
+  OffloadStats get_stats() const;
+
+  // Decision counts and predicted against measured host time per kind, for auditing the choices.
+  void print(std::ostream& out) const;
+
+ private:
+  void wait_on_host(uint32_t num_wait_events, ze_event_handle_t* wait_events);
+  // Whether command_list holds operations this policy appended, and marks it as holding one when append is set.
+  bool appended_to(ze_command_list_handle_t command_list, bool append);
+  void record(OffloadKind kind, OffloadTarget target, uint64_t bytes, bool forced, bool explored,
+              double predicted_host_ns, double predicted_device_ns, double host_ns);
+
+  struct HostKernelTime {
+    double ns_per_byte = 0;
+    bool measured = false;
+    uint32_t device_launches = 0;  // Since the last host execution
+  };
+
+  ze_context_handle_t context_;
+  ze_device_handle_t device_;
+  ThreadPool* pool_;
+  OffloadProfile profile_;
+  mutable std::mutex mutex_;
+  std::map<std::string, HostKernelTime> kernel_times_;  // Host throughput per kernel name
+  std::set<ze_command_list_handle_t> appended_lists_;
+  OffloadStats stats_;
+};
+
+}  // namespace lzu
+
+#endif  // UTILS_INCLUDE_LEVEL_ZERO_OFFLOAD_HPP_
@@ -0,0 +1,101 @@
+// Copyright 2020 Intel Corporation
+#ifndef UTILS_INCLUDE_LEVEL_ZERO_PROFILER_HPP_
+#define UTILS_INCLUDE_LEVEL_ZERO_PROFILER_HPP_
+
+#include "level_zero_utils.hpp"
+
+namespace lzu {
+
+// Converts device kernel timestamps to nanoseconds. Counters only have kernelTimestampValidBits valid bits and wrap
+// around after that, differences are taken modulo 2^bits.
+class TimestampConverter {
+ public:
+  explicit TimestampConverter(const ze_device_properties_t& properties);
+
+  // Ticks from start to end, correct across one wraparound.
+  uint64_t elapsed_ticks(uint64_t start, uint64_t end) const { return (end - start) & mask_; }
+
+  // Signed distance from reference to ticks, for placing timestamps on one timeline.
+  int64_t offset_ticks(uint64_t reference, uint64_t ticks) const;
+
+  double to_ns(double ticks) const { return ticks * ns_per_tick_; }
+  double elapsed_ns(uint64_t start, uint64_t end) const {
+    return to_ns(static_cast<double>(elapsed_ticks(start, end)));
+  }
+
+  uint64_t mask() const { return mask_; }
+  double ns_per_tick() const { return ns_per_tick_; }
+
+ private:
+  uint64_t mask_;
+  double ns_per_tick_;
+};
+
+enum class OpKind { Kernel, Copy, Barrier, Other };
+
+const char* to_string(OpKind kind);
+
+// One profiled command, with times in nanoseconds from the earliest start seen by collect().
+struct ProfiledOp {
+  std::string name;
+  OpKind kind = OpKind::Other;
+  std::string track;  // Engine or queue the command ran on, one row in the trace
+  ze_event_handle_t event = nullptr;
+  bool valid = false;  // False when the event had no timestamp to read
+  double start_ns = 0;
+  double end_ns = 0;
+  double duration_ns() const { return end_ns - start_ns; }
+};
+
+struct KindSummary {
+  OpKind kind = OpKind::Other;
+  uint32_t count = 0;
+  double total_ns = 0;
+  double min_ns = 0;
+  double p50_ns = 0;
+  double p90_ns = 0;
+  double p99_ns = 0;
+  double max_ns = 0;
+};
+
+struct ProfileReport {
+  std::vector<KindSummary> kinds;  // Only kinds that occurred
+  double span_ns = 0;              // First start to last end
+  double busy_ns = 0;              // Time at least one command was running
+  double idle_ns = 0;              // span_ns - busy_ns
+  uint32_t idle_gaps = 0;
+  double max_idle_gap_ns = 0;
+};
+
+// Collects kernel timestamps of tagged events and turns them into a per-kind summary and a Chrome trace.
+//
+// Events must come from a pool created with ZE_EVENT_POOL_FLAG_KERNEL_TIMESTAMP and have signaled before collect().
+// Global timestamps are used so commands of different engines land on the same timeline.
+class Profiler {
+ public:
+  explicit Profiler(ze_device_handle_t device);
+
+  void record(ze_event_handle_t event, const std::string& name, OpKind kind, const std::string& track = "compute");
+
+  // Read the timestamps of every recorded event. Call before the events are reset or recycled.
+  void collect();
+
+  ProfileReport report() const;
+  void print(std::ostream& out) const;
+
+  // Chrome trace event format, loadable in chrome://tracing and Perfetto.
+  std::string chrome_trace() const;
+  void write_chrome_trace(const std::string& path) const;
+
+  const std::vector<ProfiledOp>& ops() const { return ops_; }
+  const TimestampConverter& converter() const { return converter_; }
+  void clear() { ops_.clear(); }
+
+ private:
+  TimestampConverter converter_;
+  std::vector<ProfiledOp> ops_;
+};
+
+}  // namespace lzu
+
+#endif  // UTILS_INCLUDE_LEVEL_ZERO_PROFILER_HPP_
@@ -0,0 +1,53 @@
+// Copyright 2020 Intel Corporation
+#ifndef UTILS_INCLUDE_LEVEL_ZERO_QUEUES_HPP_
+#define UTILS_INCLUDE_LEVEL_ZERO_QUEUES_HPP_
+
+#include "level_zero_utils.hpp"
+
+namespace lzu {
+
+// Command queue groups of a device that matter for offloading transfers.
+struct QueueGroups {
+  uint32_t compute_ordinal = 0;
+  uint32_t copy_ordinal = 0;  // Same as compute_ordinal without a copy-only group
+  bool has_copy_engine = false;
+};
+
+QueueGroups discover_queue_groups(ze_device_handle_t device);
+
+// A compute queue and command list, plus a second queue and list on a copy-only engine when the device has one.
+// Transfers appended to copy_list() then overlap with the kernels of compute_list(). Work on the two lists has to be
+// ordered with events, e.g. by emitting a TaskGraph into both. Without a copy engine copy_list() is the compute list
+// and everything behaves as a single in-order list.
+class DeviceQueues {
+ public:
+  DeviceQueues(ze_context_handle_t context, ze_device_handle_t device, bool use_copy_engine = true);
+  ~DeviceQueues();
+
+  DeviceQueues(const DeviceQueues&) = delete;
+  DeviceQueues& operator=(const DeviceQueues&) = delete;
+
+  ze_command_list_handle_t compute_list() const { return compute_list_; }
+  ze_command_list_handle_t copy_list() const { return copy_list_ ? copy_list_ : compute_list_; }
+  ze_command_queue_handle_t compute_queue() const { return compute_queue_; }
+  ze_command_queue_handle_t copy_queue() const { return copy_queue_ ? copy_queue_ : compute_queue_; }
+  bool has_copy_engine() const { return copy_list_ != nullptr; }
+  const QueueGroups& groups() const { return groups_; }
+
+  void close();
+  // The fence, when given, belongs to the compute queue.
+  void execute(ze_fence_handle_t compute_fence = nullptr);
+  void synchronize(uint64_t timeout = UINT64_MAX);
+  void reset();
+
+ private:
+  QueueGroups groups_;
+  ze_command_queue_handle_t compute_queue_ = nullptr;
+  ze_command_list_handle_t compute_list_ = nullptr;
+  ze_command_queue_handle_t copy_queue_ = nullptr;
+  ze_command_list_handle_t copy_list_ = nullptr;
+};
+
+}  // namespace lzu
+
+#endif  // UTILS_INCLUDE_LEVEL_ZERO_QUEUES_HPP_
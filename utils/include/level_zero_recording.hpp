@@ -0,0 +1,130 @@
+// Copyright 2020 Intel Corporation
+#ifndef UTILS_INCLUDE_LEVEL_ZERO_RECORDING_HPP_
+#define UTILS_INCLUDE_LEVEL_ZERO_RECORDING_HPP_
+
+#include <list>
+#include <memory>
+
+#include "level_zero_kernel.hpp"
+#include "level_zero_utils.hpp"
+
+namespace lzu {
+
+struct CommandRecordingStats {
+  uint64_t replays = 0;
+  uint64_t instantiations = 0;  // Replays that had to append into a new command list
+  uint64_t evictions = 0;
+  uint64_t waits = 0;  // Replays that found the previous run of the same list still executing
+};
+
+// Records a fixed sequence of copies, kernel launches and barriers once and replays it many times.
+//
+// Operations refer to slots instead of values: buffer pointers and scalar kernel arguments are slots that get their
+// value from set() before each replay. Level Zero 1.0 cannot patch a closed command list, so every distinct set of
+// slot values is instantiated into its own closed command list, and a replay with values that were seen before only
+// resubmits that list through execute_command_lists. With the caching allocator buffers come back at the same
+// addresses, so the steady state never appends.
+//
+// Each instantiated list starts by resetting the events it uses, which makes it safe to resubmit while the events of
+// the previous run are still signaled. A list must not be executed again while its previous run is still executing, so
+// replay() first waits for that run: on the fence of the instance, or on completion_event() when the caller passed a
+// fence of its own for it.
+class CommandRecording {
+ public:
+  typedef uint32_t Slot;
+  typedef uint32_t Op;
+
+  CommandRecording(ze_context_handle_t context, ze_device_handle_t device, uint32_t ordinal = 0,
+                   size_t max_instances = 4);
+  ~CommandRecording();
+
+  CommandRecording(const CommandRecording&) = delete;
+  CommandRecording& operator=(const CommandRecording&) = delete;
+
+  // Declare a parameter of the given size. Pointers use sizeof(void*).
+  Slot add_slot(size_t size);
+
+  // Slot holding initial. A size_t initial picks the overload above, declare and set() those instead.
+  template <typename T>
+  Slot add_slot(const T& initial) {
+    Slot slot = add_slot(sizeof(T));
+    set(slot, initial);
+    return slot;
+  }
+
+  Op record_copy(Slot dst, Slot src, size_t size, const std::vector<Op>& dependencies = {});
+
+  // Every kernel argument is a slot, in argument order.
+  Op record_launch(KernelLaunch& kernel, const std::vector<Slot>& arguments, const std::array<uint32_t, 3>& group_size,
+                   const ze_group_count_t& group_count, const std::vector<Op>& dependencies = {});
+
+  Op record_barrier(const std::vector<Op>& dependencies = {});
+
+  void set(Slot slot, const void* value, size_t size);
+
+  template <typename T>
+  void set(Slot slot, const T& value) {
+    set(slot, &value, sizeof(T));
+  }
+
+  // Submit the recording with the current slot values. Blocks while the list of these values still executes.
+  void replay(ze_command_queue_handle_t command_queue, ze_fence_handle_t fence = nullptr);
+
+  // Signaled when everything submitted by the last replay has finished.
+  ze_event_handle_t completion_event() const;
+
+  // Event signaled by an operation in the last replay, e.g. for profiling.
+  ze_event_handle_t event(Op op) const;
+
+  const CommandRecordingStats& stats() const { return stats_; }
+
+ private:
+  enum class OpKind { Copy, Launch, Barrier };
+
+  struct Operation {
+    OpKind kind;
+    std::vector<Op> dependencies;
+    Slot dst = 0;
+    Slot src = 0;
+    size_t size = 0;
+    KernelLaunch* kernel = nullptr;
+    std::vector<Slot> arguments;
+    std::array<uint32_t, 3> group_size = {{1, 1, 1}};
+    ze_group_count_t group_count = {};
+  };
+
+  struct Instance {
+    std::string key;  // Slot values the list was recorded with
+    ze_command_list_handle_t command_list = nullptr;
+    std::vector<ze_event_handle_t> events;  // One per operation
+    ze_event_handle_t done = nullptr;
+    ze_command_queue_handle_t last_queue = nullptr;
+    ze_fence_handle_t fence = nullptr;  // On last_queue, signaled by runs submitted without a caller fence
+    bool fenced = false;                // The last run signals fence, otherwise only done tells when it finished
+    bool executing = false;             // Submitted and not waited for yet
+  };
+
+  Op add_operation(Operation operation);
+  void check_slot(Slot slot, size_t size) const;
+  void* pointer(Slot slot) const;
+  std::unique_ptr<Instance> instantiate();
+  void wait(Instance* instance);
+  void destroy(Instance* instance);
+
+  ze_context_handle_t context_;
+  ze_device_handle_t device_;
+  uint32_t ordinal_;
+  size_t max_instances_;
+  zeEventPool event_pool_;
+  std::vector<Operation> operations_;
+  std::vector<size_t> slot_offsets_;
+  std::vector<size_t> slot_sizes_;
+  std::string values_;
+  // Most recently used first
+  std::list<std::unique_ptr<Instance>> instances_;
+  CommandRecordingStats stats_;
+};
+
+}  // namespace lzu
+
+#endif  // UTILS_INCLUDE_LEVEL_ZERO_RECORDING_HPP_
@@ -0,0 +1,64 @@
+// Copyright 2020 Intel Corporation
+#ifndef UTILS_INCLUDE_LEVEL_ZERO_RING_HPP_
+#define UTILS_INCLUDE_LEVEL_ZERO_RING_HPP_
+
+#include "level_zero_utils.hpp"
+
+namespace lzu {
+
+struct RingStats {
+  uint64_t submissions = 0;
+  uint64_t stalls = 0;         // acquire() calls that had to wait for the device
+  double stall_ms = 0;         // Host time spent in those waits
+  uint64_t occupancy_sum = 0;  // Lists still executing at each submit(), the new one included
+  uint32_t max_occupancy = 0;
+
+  double mean_occupancy() const { return submissions ? static_cast<double>(occupancy_sum) / submissions : 0; }
+};
+
+// Ring of depth command lists on one queue, each with its own fence, so the host records batch k+1 while batch k
+// executes. acquire() hands out the next list once its previous submission has signaled, waiting only when the whole
+// ring is in flight. Meant for one producer thread.
+class SubmissionRing {
+ public:
+  SubmissionRing(ze_context_handle_t context, ze_device_handle_t device, uint32_t ordinal, uint32_t depth = 3);
+  ~SubmissionRing();
+
+  SubmissionRing(const SubmissionRing&) = delete;
+  SubmissionRing& operator=(const SubmissionRing&) = delete;
+
+  // Next list to record into, reset and open. Repeated calls before submit() return the same list.
+  ze_command_list_handle_t acquire();
+
+  // Close and execute the acquired list with its fence. Returns a sequence number for is_complete() and wait().
+  // Every sequence is checked against its own fence, nothing is assumed about the queue running lists in order.
+  uint64_t submit();
+
+  bool is_complete(uint64_t sequence);
+  void wait(uint64_t sequence);
+  void wait_all();
+
+  uint32_t depth() const { return static_cast<uint32_t>(slots_.size()); }
+  ze_command_queue_handle_t queue() const { return queue_; }
+  const RingStats& stats() const { return stats_; }
+
+ private:
+  struct Slot {
+    ze_command_list_handle_t list = nullptr;
+    ze_fence_handle_t fence = nullptr;
+    uint64_t sequence = 0;  // Of the last submission, 0 if none is outstanding
+  };
+
+  // Wait for the slot's outstanding submission, if any, and make it reusable.
+  void retire(Slot* slot, bool count_stall);
+
+  ze_command_queue_handle_t queue_ = nullptr;
+  std::vector<Slot> slots_;
+  uint64_t next_sequence_ = 1;
+  bool acquired_ = false;
+  RingStats stats_;
+};
+
+}  // namespace lzu
+
+#endif  // UTILS_INCLUDE_LEVEL_ZERO_RING_HPP_
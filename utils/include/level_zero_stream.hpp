@@ -0,0 +1,99 @@
+// Copyright 2020 Intel Corporation
+#ifndef UTILS_INCLUDE_LEVEL_ZERO_STREAM_HPP_
+#define UTILS_INCLUDE_LEVEL_ZERO_STREAM_HPP_
+
+#include <functional>
+#include <istream>
+#include <ostream>
+
+#include "level_zero_queues.hpp"
+#include "level_zero_utils.hpp"
+
+namespace lzu {
+
+// Fills up to capacity bytes at data and returns how many it wrote, 0 once the input is exhausted.
+typedef std::function<size_t(void* data, size_t capacity)> StreamSource;
+
+// Consumes the output of one chunk. Called in chunk order on the thread running the pipeline.
+typedef std::function<void(const void* data, size_t bytes)> StreamSink;
+
+// Records the work for one chunk into list. in holds bytes of input in device memory, out has room for
+// StreamOptions::output_chunk_bytes. Returns how many bytes of out to read back. The list runs in order after the
+// upload, so no events are needed inside it.
+typedef std::function<size_t(ze_command_list_handle_t list, const void* in, void* out, size_t bytes)> ChunkKernel;
+
+struct StreamOptions {
+  size_t chunk_bytes = 16 << 20;  // Input staged per chunk
+  size_t output_chunk_bytes = 0;  // Output room per chunk, chunk_bytes when 0
+  uint32_t buffers = 2;           // Staging sets in flight, 2 for double and 3 for triple buffering
+  bool use_copy_engine = true;    // Uploads and readbacks on a copy-only engine when the device has one
+};
+
+struct StreamStats {
+  uint64_t chunks = 0;
+  uint64_t bytes_in = 0;
+  uint64_t bytes_out = 0;
+  double total_ms = 0;
+  double source_ms = 0;  // Host time inside the source
+  double sink_ms = 0;    // Host time inside the sink
+  double stall_ms = 0;   // Host time waiting for a staging set to come back from the device
+};
+
+// Streams a dataset of any size through fixed device staging buffers. The input is cut into chunks, and chunk i goes
+// to staging set i % buffers: host upload buffer, device input, device output and host readback buffer. Chunk i+1 is
+// uploaded while the kernel runs on chunk i and chunk i-1 is read back, ordered with events across the copy and
+// compute queues. The host only waits when it needs a staging set whose readback has not finished yet.
+class StreamingPipeline {
+ public:
+  StreamingPipeline(ze_context_handle_t context, ze_device_handle_t device,
+                    const StreamOptions& options = StreamOptions());
+  ~StreamingPipeline();
+
+  StreamingPipeline(const StreamingPipeline&) = delete;
+  StreamingPipeline& operator=(const StreamingPipeline&) = delete;
+
+  // Runs until the source is exhausted and every chunk reached the sink. The staging buffers are kept for the next
+  // run. When a callback throws, the device work in flight is drained before the exception propagates.
+  StreamStats run(const StreamSource& source, const ChunkKernel& kernel, const StreamSink& sink);
+
+  const StreamOptions& options() const { return options_; }
+  bool has_copy_engine() const { return copy_queue_ != compute_queue_; }
+
+ private:
+  struct Staging {
+    void* host_in = nullptr;
+    void* device_in = nullptr;
+    void* device_out = nullptr;
+    void* host_out = nullptr;
+    ze_command_list_handle_t upload = nullptr;
+    ze_command_list_handle_t compute = nullptr;
+    ze_command_list_handle_t readback = nullptr;
+    ze_event_handle_t uploaded = nullptr;
+    ze_event_handle_t computed = nullptr;
+    ze_event_handle_t read = nullptr;
+    size_t output_bytes = 0;
+    bool busy = false;  // Submitted and not handed to the sink yet
+  };
+
+  // Wait for the staging set's readback, pass the output to the sink and make the set reusable.
+  void drain(Staging* staging, const StreamSink& sink, StreamStats* stats);
+  void submit_readback(Staging* staging);
+
+  ze_context_handle_t context_;
+  ze_device_handle_t device_;
+  StreamOptions options_;
+  ze_command_queue_handle_t compute_queue_ = nullptr;
+  ze_command_queue_handle_t copy_queue_ = nullptr;
+  zeEventPool events_;
+  std::vector<Staging> staging_;
+};
+
+// Sources and sinks over standard streams and memory.
+StreamSource istream_source(std::istream* in);
+StreamSink ostream_sink(std::ostream* out);
+StreamSource memory_source(const void* data, size_t bytes);
+StreamSink memory_sink(std::vector<uint8_t>* out);
+
+}  // namespace lzu
+
+#endif  // UTILS_INCLUDE_LEVEL_ZERO_STREAM_HPP_
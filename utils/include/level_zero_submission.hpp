@@ -0,0 +1,125 @@
+// Copyright 2020 Intel Corporation
+#ifndef UTILS_INCLUDE_LEVEL_ZERO_SUBMISSION_HPP_
+#define UTILS_INCLUDE_LEVEL_ZERO_SUBMISSION_HPP_
+
+#include <condition_variable>
+#include <memory>
+#include <thread>
+
+#include "level_zero_utils.hpp"
+
+namespace lzu {
+
+// Event allocation for many threads. zeEventPool is not thread safe, so the events are spread over shards of
+// independent pools with one lock each, and every thread allocates from its own shard. Threads are assigned to
+// shards round robin on first use, so contention only starts once there are more threads than shards.
+class ShardedEventPool {
+ public:
+  struct Event {
+    ze_event_handle_t handle = nullptr;
+    uint32_t shard = 0;  // Pool the event has to go back to
+  };
+
+  // Zero shards means one per hardware thread.
+  explicit ShardedEventPool(ze_context_handle_t context, uint32_t shards = 0, uint32_t count_per_shard = 32,
+                            ze_event_pool_flags_t flags = (ZE_EVENT_POOL_FLAG_HOST_VISIBLE |
+                                                           ZE_EVENT_POOL_FLAG_KERNEL_TIMESTAMP));
+
+  ShardedEventPool(const ShardedEventPool&) = delete;
+  ShardedEventPool& operator=(const ShardedEventPool&) = delete;
+
+  Event create_event(ze_event_scope_flags_t signal = 0, ze_event_scope_flags_t wait = 0);
+
+  // May be called from any thread, not only the one that created the event.
+  void destroy_event(const Event& event);
+
+  uint32_t shard_count() const { return static_cast<uint32_t>(shards_.size()); }
+  uint32_t in_use() const;
+
+ private:
+  struct Shard {
+    std::mutex mutex;
+    zeEventPool pool;
+  };
+
+  std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+struct SubmitterStats {
+  uint64_t submissions = 0;    // Command lists handed to submit()
+  uint64_t batches = 0;        // zeCommandQueueExecuteCommandLists calls
+  uint64_t lists_created = 0;  // Command lists ever created, the rest were recycled
+  uint32_t largest_batch = 0;
+
+  double lists_per_batch() const { return batches ? static_cast<double>(submissions) / batches : 0; }
+};
+
+// Submission path shared by many threads. Each thread records into its own command list, submit() closes it and
+// queues it, and one submitter thread merges everything queued so far into a single execute call with a fence. Up to
+// max_in_flight batches run at once. Once a batch's fence signals, its lists are reset and recycled for any thread.
+//
+// Batches run in submission order on one queue, but the lists of a batch may overlap on the device. Order dependent
+// work across threads with events.
+class ConcurrentSubmitter {
+ public:
+  ConcurrentSubmitter(ze_context_handle_t context, ze_device_handle_t device, uint32_t ordinal,
+                      uint32_t max_batch = 64, uint32_t max_in_flight = 4);
+  ~ConcurrentSubmitter();
+
+  ConcurrentSubmitter(const ConcurrentSubmitter&) = delete;
+  ConcurrentSubmitter& operator=(const ConcurrentSubmitter&) = delete;
+
+  // Open command list of the calling thread, created or recycled on first use after each submit().
+  ze_command_list_handle_t command_list();
+
+  // Queue the calling thread's list and return a ticket for wait(). Submitting without recording gives an empty list.
+  uint64_t submit();
+
+  // Block until the batch holding the ticket has finished on the device. Rethrows submitter thread failures.
+  void wait(uint64_t ticket);
+
+  // Wait for everything submitted so far.
+  void flush();
+
+  SubmitterStats get_stats() const;
+
+ private:
+  struct Batch {
+    std::vector<ze_command_list_handle_t> lists;
+    ze_fence_handle_t fence = nullptr;
+    uint64_t last_ticket = 0;
+  };
+
+  void run();
+  void complete(Batch* batch);
+  ze_fence_handle_t take_fence();
+
+  ze_context_handle_t context_;
+  ze_device_handle_t device_;
+  uint32_t ordinal_;
+  uint32_t max_batch_;
+  uint32_t max_in_flight_;
+  uint64_t id_;  // Key of this submitter in the thread local list maps
+  ze_command_queue_handle_t queue_ = nullptr;
+
+  mutable std::mutex mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable done_cv_;
+  std::vector<ze_command_list_handle_t> pending_;
+  uint64_t submitted_ = 0;  // Tickets handed out
+  uint64_t taken_ = 0;      // Tickets moved into a batch
+  uint64_t completed_ = 0;  // Tickets whose batch finished
+  std::vector<ze_command_list_handle_t> free_lists_;
+  std::vector<ze_command_list_handle_t> all_lists_;
+  std::vector<ze_fence_handle_t> free_fences_;
+  std::vector<ze_fence_handle_t> all_fences_;
+  std::string error_;
+  bool failed_ = false;
+  bool stop_ = false;
+  SubmitterStats stats_;
+  std::thread thread_;
+};
+
+}  // namespace lzu
+
+#endif  // UTILS_INCLUDE_LEVEL_ZERO_SUBMISSION_HPP_
@@ -0,0 +1,131 @@
+// Copyright 2020 Intel Corporation
+#ifndef UTILS_INCLUDE_LEVEL_ZERO_TASK_GRAPH_HPP_
+#define UTILS_INCLUDE_LEVEL_ZERO_TASK_GRAPH_HPP_
+
+#include "level_zero_kernel.hpp"
+#include "level_zero_utils.hpp"
+
+namespace lzu {
+
+struct TaskGraphStats {
+  uint32_t nodes = 0;
+  uint32_t inferred_edges = 0;    // Hazards found between nodes
+  uint32_t transitive_edges = 0;  // Of those, implied by other edges and dropped
+  uint32_t edges = 0;             // Wait list entries actually emitted
+  uint32_t cross_engine_edges = 0;
+  uint32_t events = 0;
+  uint32_t barriers = 0;
+  uint32_t levels = 0;  // Length of the longest dependency chain
+};
+
+// Builds a dependency graph of copies, kernel launches and barriers from the byte ranges each node reads and writes.
+//
+// schedule() infers read-after-write, write-after-read and write-after-write hazards in insertion order between nodes
+// whose ranges overlap, so a copy into one half of a buffer does not wait on a reader of the other half. It drops the
+// edges that are implied by other ones, and groups the nodes into levels of mutually independent work. emit() then
+// appends the nodes level by level, so independent nodes sit next to each other and can run concurrently, with
+// events taken from the pool only for nodes somebody waits on. Events waited on from the other engine get device scope.
+class TaskGraph {
+ public:
+  typedef uint32_t Node;
+
+  enum class Engine { Compute, Copy };
+
+  struct Argument {
+    std::vector<uint8_t> value;
+  };
+
+  // Bytes [ptr, ptr + size) a launch reads or writes. A bare pointer stands for the whole allocation it points into,
+  // as zeMemGetAddressRange reports it in the context of the event pool. Memory the driver did not allocate has no
+  // known extent, its bare pointer only covers the byte it points at, so pass the size for it. Implicit, so that
+  // {buffer0, buffer1} lists of pointers still work.
+  struct Range {
+    Range(const void* ptr, size_t size = 0) : ptr(ptr), size(size) {}
+
+    const void* ptr;
+    size_t size;  // 0 for the whole allocation
+  };
+
+  template <typename T>
+  static Argument argument(const T& value) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+    return Argument{std::vector<uint8_t>(bytes, bytes + sizeof(T))};
+  }
+
+  explicit TaskGraph(zeEventPool* event_pool);
+  ~TaskGraph();
+
+  TaskGraph(const TaskGraph&) = delete;
+  TaskGraph& operator=(const TaskGraph&) = delete;
+
+  // Reads src and writes dst.
+  Node add_copy(void* dst, const void* src, size_t size, Engine engine = Engine::Copy);
+
+  // Arguments are captured now and bound when the graph is emitted.
+  Node add_launch(KernelLaunch& kernel, const std::array<uint32_t, 3>& group_size, const ze_group_count_t& group_count,
+                  const std::vector<Argument>& arguments, const std::vector<Range>& reads,
+                  const std::vector<Range>& writes);
+
+  // Orders every node before it against every node after it.
+  Node add_barrier();
+
+  // Give the node a signal event even when no other node waits on it, e.g. for host waits or profiling. The event is
+  // signaled and waited on with host scope.
+  void require_event(Node node);
+
+  void schedule();
+
+  // Copy nodes go to copy_list when one is given, everything else to compute_list.
+  void emit(ze_command_list_handle_t compute_list, ze_command_list_handle_t copy_list = nullptr);
+
+  // Valid after schedule(), null for nodes that nobody waits on.
+  ze_event_handle_t event(Node node) const;
+
+  // Dependencies of a node after transitive reduction.
+  const std::vector<Node>& dependencies(Node node) const;
+
+  uint32_t level(Node node) const;
+
+  const TaskGraphStats& stats() const { return stats_; }
+
+ private:
+  enum class Kind { Copy, Launch, Barrier };
+
+  struct Span {
+    uintptr_t begin;
+    uintptr_t end;
+  };
+
+  struct NodeInfo {
+    Kind kind;
+    Engine engine = Engine::Compute;
+    void* dst = nullptr;
+    const void* src = nullptr;
+    size_t size = 0;
+    KernelLaunch* kernel = nullptr;
+    std::array<uint32_t, 3> group_size = {{1, 1, 1}};
+    ze_group_count_t group_count = {};
+    std::vector<Argument> arguments;
+    std::vector<Span> reads;
+    std::vector<Span> writes;
+    std::vector<Node> dependencies;
+    uint32_t level = 0;
+    bool needs_event = false;
+    ze_event_scope_flags_t scope = 0;  // Signal and wait scope of event
+    ze_event_handle_t event = nullptr;
+  };
+
+  Node add_node(NodeInfo info);
+  Span span(const Range& range) const;
+  void infer_dependencies();
+  void reduce_dependencies();
+
+  zeEventPool* event_pool_;
+  std::vector<NodeInfo> nodes_;
+  bool scheduled_ = false;
+  TaskGraphStats stats_;
+};
+
+}  // namespace lzu
+
+#endif  // UTILS_INCLUDE_LEVEL_ZERO_TASK_GRAPH_HPP_
@@ -0,0 +1,61 @@
+// Copyright 2020 Intel Corporation
+#ifndef UTILS_INCLUDE_LEVEL_ZERO_THREAD_POOL_HPP_
+#define UTILS_INCLUDE_LEVEL_ZERO_THREAD_POOL_HPP_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace lzu {
+
+// Fixed set of worker threads for host-side work. submit() queues one task and returns its future, parallel_for()
+// splits a range over the workers and the calling thread. A thread waiting in parallel_for() runs queued tasks in the
+// meantime, so parallel_for() may also be called from inside a task.
+class ThreadPool {
+ public:
+  // 0 threads means one per hardware thread.
+  explicit ThreadPool(uint32_t threads = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  // Process wide pool, sized by LZU_HOST_THREADS when set.
+  static ThreadPool& get();
+
+  template <typename F>
+  auto submit(F task) -> std::future<decltype(task())> {
+    typedef decltype(task()) Result;
+    std::shared_ptr<std::packaged_task<Result()>> packaged = std::make_shared<std::packaged_task<Result()>>(task);
+    std::future<Result> future = packaged->get_future();
+    enqueue([packaged] { (*packaged)(); });
+    return future;
+  }
+
+  // Calls function(begin, end) for parts of [0, count) of at least grain items and returns once all of them ran.
+  // The first exception thrown by a part is rethrown.
+  void parallel_for(size_t count, const std::function<void(size_t begin, size_t end)>& function, size_t grain = 1);
+
+  uint32_t size() const { return static_cast<uint32_t>(threads_.size()); }
+
+ private:
+  void enqueue(std::function<void()> task);
+  // Runs one queued task on the calling thread, false when the queue was empty.
+  bool run_one();
+  void run();
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::function<void()>> tasks_;
+  bool stop_ = false;
+  std::vector<std::thread> threads_;
+};
+
+}  // namespace lzu
+
+#endif  // UTILS_INCLUDE_LEVEL_ZERO_THREAD_POOL_HPP_
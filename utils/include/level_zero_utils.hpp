@@ -11,6 +11,7 @@
 #include <zet_api.h>
 #endif
 
+#include <algorithm>
 #include <array>
 #include <fstream>
 #include <iostream>
@@ -43,6 +44,8 @@ uint32_t get_driver_handle_count();
 
 std::vector<ze_driver_handle_t> get_all_driver_handles();
 
+ze_driver_properties_t get_driver_properties(ze_driver_handle_t driver);
+
 // Device
 uint32_t get_device_count(ze_driver_handle_t driver);
 
@@ -50,30 +53,60 @@ std::vector<ze_device_handle_t> get_devices(ze_driver_handle_t driver);
 
 ze_device_properties_t get_device_properties(ze_device_handle_t device);
 
+ze_device_compute_properties_t get_device_compute_properties(ze_device_handle_t device);
+
+std::vector<ze_command_queue_group_properties_t> get_command_queue_group_properties(ze_device_handle_t device);
+
+// Ordinal of the first queue group that has all of the required flags and none of the excluded ones, or UINT32_MAX.
+uint32_t find_command_queue_group(ze_device_handle_t device, ze_command_queue_group_property_flags_t required,
+                                  ze_command_queue_group_property_flags_t excluded = 0);
+
 // Memory
 void* allocate_host_memory(const size_t size, const size_t alignment, const ze_context_handle_t context);
 
 void* allocate_device_memory(const size_t size, const size_t alignment, const ze_device_mem_alloc_flags_t flags,
                              const uint32_t ordinal, ze_device_handle_t device_handle, ze_context_handle_t context);
 
+// ordinal selects the device memory the allocation prefers when it is resident on the device.
 void* allocate_shared_memory(const size_t size, const size_t alignment, const ze_device_mem_alloc_flags_t dev_flags,
                              const ze_host_mem_alloc_flags_t host_flags, ze_device_handle_t device,
-                             ze_context_handle_t context);
+                             ze_context_handle_t context, const uint32_t ordinal = 0);
 
 void free_memory(ze_context_handle_t context, void* ptr);
 
 void append_memory_copy(ze_command_list_handle_t cl, void* dstptr, const void* srcptr, size_t size,
                         ze_event_handle_t hSignalEvent, uint32_t num_wait_events, ze_event_handle_t* wait_events);
 
+// Migrate a range of shared memory to the device of the command list ahead of its use.
+void append_memory_prefetch(ze_command_list_handle_t cl, const void* ptr, size_t size);
+
+void append_memory_advise(ze_command_list_handle_t cl, ze_device_handle_t device, const void* ptr, size_t size,
+                          ze_memory_advice_t advice);
+
 // Module
-ze_module_handle_t create_module(ze_context_handle_t context, ze_device_handle_t device, uint8_t* data, size_t bytes,
+class BinaryView;
+
+ze_module_handle_t create_module(ze_context_handle_t context, ze_device_handle_t device, const uint8_t* data,
+                                 size_t bytes, const ze_module_format_t format, const char* build_flags,
+                                 ze_module_build_log_handle_t* p_build_log,
+                                 const ze_module_constants_t* constants = nullptr);
+
+ze_module_handle_t create_module(ze_context_handle_t context, ze_device_handle_t device, const BinaryView& binary,
                                  const ze_module_format_t format, const char* build_flags,
-                                 ze_module_build_log_handle_t* p_build_log);
+                                 ze_module_build_log_handle_t* p_build_log,
+                                 const ze_module_constants_t* constants = nullptr);
+
+std::vector<uint8_t> get_module_native_binary(ze_module_handle_t module);
+
+// Text of a build log, empty when the driver left it empty.
+std::string get_module_build_log(ze_module_build_log_handle_t build_log);
+
+void destroy_module_build_log(ze_module_build_log_handle_t build_log);
 
 void destroy_module(ze_module_handle_t module);
 
 // Kernel
-ze_kernel_handle_t create_function(ze_module_handle_t module, ze_kernel_flags_t flag, std::string func_name);
+ze_kernel_handle_t create_function(ze_module_handle_t module, ze_kernel_flags_t flag, const std::string& func_name);
 
 void set_argument_value(ze_kernel_handle_t hFunction, uint32_t argIndex, size_t argSize, const void* pArgValue);
 
@@ -105,7 +138,20 @@ void synchronize(ze_command_queue_handle_t cq, uint64_t timeout);
 
 void destroy_command_queue(ze_command_queue_handle_t cq);
 
+// Fence
+ze_fence_handle_t create_fence(ze_command_queue_handle_t cq);
+
+void reset_fence(ze_fence_handle_t fence);
+
+void synchronize(ze_fence_handle_t fence, uint64_t timeout);
+
+void destroy_fence(ze_fence_handle_t fence);
+
 // Event
+// Growable event allocator. Events live in a chain of ze_event_pool_handle_t slabs, the first one sized by
+// InitEventPool and every following one doubling the total capacity. Free slots are handed out from a LIFO free
+// list, and destroy_event only resets the event with zeEventHostReset so the next create_event can reuse it.
+// Not thread safe, ShardedEventPool in level_zero_submission.hpp serves many threads.
 class zeEventPool {
  public:
   zeEventPool();
@@ -117,17 +163,54 @@ class zeEventPool {
 
   void create_event(ze_event_handle_t* event, ze_event_scope_flags_t signal = 0, ze_event_scope_flags_t wait = 0);
 
+  // Returns the event to the pool. The driver object is kept and recycled by a later create_event.
   void destroy_event(ze_event_handle_t event);
 
-  ze_event_pool_handle_t event_pool_ = nullptr;
+  uint32_t capacity() const { return static_cast<uint32_t>(slots_.size()); }
+  uint32_t in_use() const { return capacity() - static_cast<uint32_t>(free_slots_.size()); }
+  uint64_t events_created() const { return events_created_; }
+  uint64_t events_recycled() const { return events_recycled_; }
+
+  ze_event_pool_handle_t event_pool_ = nullptr;  // First slab
   ze_context_handle_t context_ = nullptr;
-  std::vector<bool> pool_indexes_available_;
-  std::map<ze_event_handle_t, uint32_t> handle_to_index_map_;
+  ze_event_pool_flags_t flags_ = 0;
+  std::vector<ze_event_pool_handle_t> slabs_;
+
+ private:
+  struct EventSlot {
+    ze_event_handle_t event = nullptr;
+    ze_event_pool_handle_t slab = nullptr;
+    uint32_t index = 0;  // Index inside slab
+    ze_event_scope_flags_t signal = 0;
+    ze_event_scope_flags_t wait = 0;
+    bool in_use = false;
+  };
+
+  void add_slab(uint32_t count);
+  uint32_t find_slot(ze_event_handle_t event) const;
+  void insert_lookup(ze_event_handle_t event, uint32_t slot);
+  void erase_lookup(ze_event_handle_t event);
+  void rehash_lookup(size_t buckets);
+
+  std::vector<EventSlot> slots_;
+  std::vector<uint32_t> free_slots_;
+  // Open addressing (linear probing) table from event handle to slot. Events recreated with other scope flags leave an
+  // erased bucket behind, which later inserts reuse and the next rehash drops. lookup_size_ counts both kinds.
+  std::vector<std::pair<ze_event_handle_t, uint32_t>> lookup_;
+  size_t lookup_size_ = 0;
+  uint64_t events_created_ = 0;
+  uint64_t events_recycled_ = 0;
 };
 
 void append_barrier(ze_command_list_handle_t cl, ze_event_handle_t hSignalEvent, uint32_t numWaitEvents,
                     ze_event_handle_t* phWaitEvents);
 
+void append_signal_event(ze_command_list_handle_t cl, ze_event_handle_t event);
+
+void append_wait_on_events(ze_command_list_handle_t cl, uint32_t numEvents, ze_event_handle_t* phEvents);
+
+void append_event_reset(ze_command_list_handle_t cl, ze_event_handle_t event);
+
 // Group
 void set_group_size(ze_kernel_handle_t hFunction, uint32_t groupSizeX, uint32_t groupSizeY, uint32_t groupSizeZ);
 
@@ -135,6 +218,36 @@ void suggest_group_size(ze_kernel_handle_t hFunction, uint32_t globalSizeX, uint
                         uint32_t* groupSizeX, uint32_t* groupSizeY, uint32_t* groupSizeZ);
 
 // Helper
+// Read-only view of a binary file. Regular files are memory mapped and the mapping is owned by the view, anything
+// else (pipes, character devices, procfs) is read into an owned buffer.
+class BinaryView {
+ public:
+  BinaryView() {}
+  explicit BinaryView(std::vector<uint8_t> buffer);
+  BinaryView(BinaryView&& other);
+  BinaryView& operator=(BinaryView&& other);
+  BinaryView(const BinaryView&) = delete;
+  BinaryView& operator=(const BinaryView&) = delete;
+  ~BinaryView();
+
+  const uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  bool is_mapped() const { return mapping_ != nullptr; }
+
+ private:
+  friend BinaryView map_binary_file(const std::string& file_path);
+  void reset();
+
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+  void* mapping_ = nullptr;
+  std::vector<uint8_t> buffer_;
+};
+
+// Returns an empty view if the file cannot be read.
+BinaryView map_binary_file(const std::string& file_path);
+
 std::vector<uint8_t> load_binary_file(const std::string& file_path);
 
 std::string to_string(const ze_result_t result);
@@ -0,0 +1,285 @@
+// Copyright 2020 Intel Corporation
+
+#include "level_zero_allocator.hpp"
+
+#include <stdlib.h>
+
+#include <tuple>
+
+namespace lzu {
+
+static size_t round_up(size_t size, size_t step) { return ((size + step - 1) / step) * step; }
+
+bool CachingAllocator::PoolKey::operator<(const PoolKey& other) const {
+  return std::tie(context, device, type, device_flags, host_flags, ordinal, small) <
+         std::tie(other.context, other.device, other.type, other.device_flags, other.host_flags, other.ordinal,
+                  other.small);
+}
+
+bool CachingAllocator::BlockLess::operator()(const Block* a, const Block* b) const {
+  if (a->size != b->size) return a->size < b->size;
+  return a->ptr < b->ptr;
+}
+
+constexpr size_t CachingAllocator::kMinBlockSize;
+
+CachingAllocator::CachingAllocator(const CachingAllocatorOptions& options) : options_(options) {}
+
+CachingAllocator::~CachingAllocator() {
+  // Memory still cached here is not returned to the driver: the contexts may already be gone at this point. Use
+  // empty_cache() before destroying a context.
+  for (auto& entry : pools_) {
+    for (auto block : entry.second.free_blocks) delete block;
+  }
+  for (auto& entry : allocated_blocks_) delete entry.second;
+}
+
+CachingAllocator& CachingAllocator::get() {
+  // Intentionally leaked, see the destructor
+  static CachingAllocator* allocator = [] {
+    CachingAllocatorOptions options;
+    const char* disable = getenv("LZU_DISABLE_CACHING_ALLOCATOR");
+    if (disable && strcmp(disable, "0") != 0) {
+      options.enabled = false;
+    }
+    return new CachingAllocator(options);
+  }();
+  return *allocator;
+}
+
+void* CachingAllocator::allocate_host(size_t size, size_t alignment, ze_context_handle_t context) {
+  PoolKey key = {context, nullptr, ZE_MEMORY_TYPE_HOST, 0, 0, 0, false};
+  return allocate(key, size, alignment);
+}
+
+void* CachingAllocator::allocate_device(size_t size, size_t alignment, ze_device_mem_alloc_flags_t flags,
+                                        uint32_t ordinal, ze_device_handle_t device, ze_context_handle_t context) {
+  PoolKey key = {context, device, ZE_MEMORY_TYPE_DEVICE, flags, 0, ordinal, false};
+  return allocate(key, size, alignment);
+}
+
+void* CachingAllocator::allocate_shared(size_t size, size_t alignment, ze_device_mem_alloc_flags_t dev_flags,
+                                        ze_host_mem_alloc_flags_t host_flags, ze_device_handle_t device,
+                                        ze_context_handle_t context, uint32_t ordinal) {
+  PoolKey key = {context, device, ZE_MEMORY_TYPE_SHARED, dev_flags, host_flags, ordinal, false};
+  return allocate(key, size, alignment);
+}
+
+size_t CachingAllocator::round_size(size_t size) const {
+  if (size <= kMinBlockSize) return kMinBlockSize;
+  if (size > options_.small_size_limit) return round_up(size, kMinBlockSize);
+  // Four size classes per power of two
+  size_t power = kMinBlockSize;
+  while (power * 2 <= size) power *= 2;
+  return round_up(size, std::max(power / 4, kMinBlockSize));
+}
+
+void* CachingAllocator::allocate(PoolKey key, size_t size, size_t alignment) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (!options_.enabled || alignment > kMinBlockSize) {
+    lock.unlock();
+    return driver_allocate(key, size, alignment);
+  }
+
+  size_t rounded = round_size(size);
+  key.small = rounded <= options_.small_size_limit;
+  BlockPool& pool = pools_[key];
+  pool.key = key;
+
+  Block probe;
+  probe.size = rounded;
+  Block* block = nullptr;
+  auto it = pool.free_blocks.lower_bound(&probe);
+  if (it != pool.free_blocks.end() && (!key.small || (*it)->size == rounded)) {
+    block = *it;
+    pool.free_blocks.erase(it);
+    stats_.cached_bytes -= block->size;
+    stats_.cache_hits++;
+  } else {
+    size_t segment_size = key.small ? rounded : round_up(rounded, options_.segment_granularity);
+    char* ptr = nullptr;
+    try {
+      ptr = static_cast<char*>(driver_allocate(key, segment_size, kMinBlockSize));
+    } catch (std::runtime_error&) {
+      // Give the cached memory back to the driver and try once more
+      release_free_segments(0, nullptr);
+      ptr = static_cast<char*>(driver_allocate(key, segment_size, kMinBlockSize));
+    }
+    block = new Block();
+    block->pool = &pool;
+    block->ptr = ptr;
+    block->size = segment_size;
+    stats_.cache_misses++;
+    stats_.driver_allocations++;
+    stats_.reserved_bytes += segment_size;
+    stats_.peak_reserved_bytes = std::max(stats_.peak_reserved_bytes, stats_.reserved_bytes);
+  }
+
+  // Split large blocks when the remainder is still worth keeping
+  if (!key.small && block->size - rounded > options_.small_size_limit) {
+    Block* remainder = new Block();
+    remainder->pool = &pool;
+    remainder->ptr = block->ptr + rounded;
+    remainder->size = block->size - rounded;
+    remainder->prev = block;
+    remainder->next = block->next;
+    if (block->next) block->next->prev = remainder;
+    block->next = remainder;
+    block->size = rounded;
+    pool.free_blocks.insert(remainder);
+    stats_.cached_bytes += remainder->size;
+    stats_.splits++;
+  }
+
+  block->allocated = true;
+  allocated_blocks_[block->ptr] = block;
+  stats_.allocated_bytes += block->size;
+  stats_.peak_allocated_bytes = std::max(stats_.peak_allocated_bytes, stats_.allocated_bytes);
+  return block->ptr;
+}
+
+void* CachingAllocator::driver_allocate(const PoolKey& key, size_t size, size_t alignment) {
+  switch (key.type) {
+    case ZE_MEMORY_TYPE_HOST:
+      return allocate_host_memory(size, alignment, key.context);
+    case ZE_MEMORY_TYPE_DEVICE:
+      return allocate_device_memory(size, alignment, key.device_flags, key.ordinal, key.device, key.context);
+    case ZE_MEMORY_TYPE_SHARED:
+      return allocate_shared_memory(size, alignment, key.device_flags, key.host_flags, key.device, key.context,
+                                    key.ordinal);
+    default:
+      throw std::runtime_error("CachingAllocator: unsupported memory type");
+  }
+}
+
+void CachingAllocator::free(ze_context_handle_t context, void* ptr) {
+  if (ptr == nullptr) return;
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto it = allocated_blocks_.find(ptr);
+  if (it == allocated_blocks_.end()) {
+    lock.unlock();
+    free_memory(context, ptr);
+    return;
+  }
+
+  Block* block = it->second;
+  BlockPool& pool = *block->pool;
+  if (pool.key.context != context) {
+    throw std::runtime_error("CachingAllocator: pointer freed with a different context");
+  }
+  allocated_blocks_.erase(it);
+  block->allocated = false;
+  stats_.allocated_bytes -= block->size;
+
+  // Coalesce with free neighbours of the same segment
+  if (block->prev && !block->prev->allocated) {
+    Block* prev = block->prev;
+    pool.free_blocks.erase(prev);
+    stats_.cached_bytes -= prev->size;
+    prev->size += block->size;
+    prev->next = block->next;
+    if (block->next) block->next->prev = prev;
+    delete block;
+    block = prev;
+    stats_.merges++;
+  }
+  if (block->next && !block->next->allocated) {
+    Block* next = block->next;
+    pool.free_blocks.erase(next);
+    stats_.cached_bytes -= next->size;
+    block->size += next->size;
+    block->next = next->next;
+    if (next->next) next->next->prev = block;
+    delete next;
+    stats_.merges++;
+  }
+  pool.free_blocks.insert(block);
+  stats_.cached_bytes += block->size;
+
+  if (stats_.cached_bytes > options_.max_cached_bytes) {
+    release_free_segments(options_.max_cached_bytes, nullptr);
+  }
+}
+
+void CachingAllocator::release_block(Block* block) {
+  block->pool->free_blocks.erase(block);
+  stats_.cached_bytes -= block->size;
+  stats_.reserved_bytes -= block->size;
+  stats_.driver_frees++;
+  free_memory(block->pool->key.context, block->ptr);
+  delete block;
+}
+
+size_t CachingAllocator::release_free_segments(size_t max_cached_bytes, ze_context_handle_t context) {
+  // Only whole segments can go back to the driver. Release the largest ones first.
+  std::vector<Block*> segments;
+  for (auto& entry : pools_) {
+    if (context && entry.first.context != context) continue;
+    for (auto block : entry.second.free_blocks) {
+      if (block->prev == nullptr && block->next == nullptr) segments.push_back(block);
+    }
+  }
+  std::sort(segments.begin(), segments.end(), [](const Block* a, const Block* b) { return a->size > b->size; });
+
+  size_t released = 0;
+  for (auto block : segments) {
+    if (stats_.cached_bytes <= max_cached_bytes) break;
+    released += block->size;
+    release_block(block);
+  }
+  return released;
+}
+
+size_t CachingAllocator::trim(size_t max_cached_bytes) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return release_free_segments(max_cached_bytes, nullptr);
+}
+
+void CachingAllocator::empty_cache(ze_context_handle_t context) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  release_free_segments(0, context);
+}
+
+CachingAllocatorStats CachingAllocator::get_stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+void CachingAllocator::reset_peak_stats() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats_.peak_allocated_bytes = stats_.allocated_bytes;
+  stats_.peak_reserved_bytes = stats_.reserved_bytes;
+}
+
+bool CachingAllocator::enabled() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return options_.enabled;
+}
+
+void CachingAllocator::set_enabled(bool enabled) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  options_.enabled = enabled;
+}
+
+namespace cached {
+
+void* allocate_host_memory(const size_t size, const size_t alignment, const ze_context_handle_t context) {
+  return CachingAllocator::get().allocate_host(size, alignment, context);
+}
+
+void* allocate_device_memory(const size_t size, const size_t alignment, const ze_device_mem_alloc_flags_t flags,
+                             const uint32_t ordinal, ze_device_handle_t device_handle, ze_context_handle_t context) {
+  return CachingAllocator::get().allocate_device(size, alignment, flags, ordinal, device_handle, context);
+}
+
+void* allocate_shared_memory(const size_t size, const size_t alignment, const ze_device_mem_alloc_flags_t dev_flags,
+                             const ze_host_mem_alloc_flags_t host_flags, ze_device_handle_t device,
+                             ze_context_handle_t context, const uint32_t ordinal) {
+  return CachingAllocator::get().allocate_shared(size, alignment, dev_flags, host_flags, device, context, ordinal);
+}
+
+void free_memory(ze_context_handle_t context, void* ptr) { CachingAllocator::get().free(context, ptr); }
+
+}  // namespace cached
+
+}  // namespace lzu
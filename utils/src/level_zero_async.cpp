@@ -0,0 +1,167 @@
+// Copyright 2020 Intel Corporation
+
+#include "level_zero_async.hpp"
+
+#include <chrono>
+#include <memory>
+
+namespace lzu {
+
+namespace {
+
+CompletionReactor::Callback fulfill(const std::shared_ptr<std::promise<void>>& promise) {
+  return [promise](ze_result_t result) {
+    if (result == ZE_RESULT_SUCCESS) {
+      promise->set_value();
+    } else {
+      promise->set_exception(std::make_exception_ptr(std::runtime_error("Completion failed: " + to_string(result))));
+    }
+  };
+}
+
+}  // namespace
+
+CompletionReactor::CompletionReactor(const ReactorOptions& options) : options_(options) {
+  thread_ = std::thread(&CompletionReactor::run, this);
+}
+
+CompletionReactor::~CompletionReactor() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_one();
+  thread_.join();
+}
+
+CompletionReactor& CompletionReactor::get() {
+  static CompletionReactor reactor;
+  return reactor;
+}
+
+void CompletionReactor::on_event(ze_event_handle_t event, Callback callback) {
+  Watch watch;
+  watch.event = event;
+  watch.callback = std::move(callback);
+  add(std::move(watch));
+}
+
+void CompletionReactor::on_fence(ze_fence_handle_t fence, Callback callback) {
+  Watch watch;
+  watch.fence = fence;
+  watch.callback = std::move(callback);
+  add(std::move(watch));
+}
+
+std::future<void> CompletionReactor::when_event(ze_event_handle_t event) {
+  std::shared_ptr<std::promise<void>> promise = std::make_shared<std::promise<void>>();
+  std::future<void> future = promise->get_future();
+  on_event(event, fulfill(promise));
+  return future;
+}
+
+std::future<void> CompletionReactor::when_fence(ze_fence_handle_t fence) {
+  std::shared_ptr<std::promise<void>> promise = std::make_shared<std::promise<void>>();
+  std::future<void> future = promise->get_future();
+  on_fence(fence, fulfill(promise));
+  return future;
+}
+
+size_t CompletionReactor::pending() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return pending_;
+}
+
+ReactorStats CompletionReactor::get_stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+void CompletionReactor::add(Watch watch) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    incoming_.push_back(std::move(watch));
+    pending_++;
+    stats_.watches++;
+  }
+  cv_.notify_one();
+}
+
+void CompletionReactor::run() {
+  std::vector<Watch> watches;
+  std::vector<std::pair<Callback, ze_result_t>> done;
+  uint32_t idle_rounds = 0;
+  uint64_t sleep_ns = options_.min_sleep_ns;
+
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (watches.empty() && incoming_.empty()) {
+        cv_.wait(lock, [this] { return stop_ || !incoming_.empty(); });
+      } else if (idle_rounds > options_.spin_polls) {
+        // Idle for a while, sleep but let a new watch cut the sleep short
+        stats_.sleeps++;
+        cv_.wait_for(lock, std::chrono::nanoseconds(sleep_ns), [this] { return stop_ || !incoming_.empty(); });
+        sleep_ns = std::min(sleep_ns * 2, options_.max_sleep_ns);
+      }
+      if (stop_) break;
+      if (!incoming_.empty()) {
+        for (auto& watch : incoming_) watches.push_back(std::move(watch));
+        incoming_.clear();
+        idle_rounds = 0;
+      }
+      stats_.polls++;
+    }
+
+    // Poll without the lock, completed watches are swapped to the back and dropped
+    size_t remaining = watches.size();
+    for (size_t i = 0; i < remaining;) {
+      Watch& watch = watches[i];
+      ze_result_t result = watch.event ? zeEventQueryStatus(watch.event) : zeFenceQueryStatus(watch.fence);
+      if (result == ZE_RESULT_NOT_READY) {
+        i++;
+        continue;
+      }
+      done.push_back(std::make_pair(std::move(watch.callback), result));
+      std::swap(watch, watches[--remaining]);
+    }
+    watches.resize(remaining);
+
+    if (done.empty()) {
+      if (++idle_rounds <= options_.spin_polls) std::this_thread::yield();
+      continue;
+    }
+    idle_rounds = 0;
+    sleep_ns = options_.min_sleep_ns;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      pending_ -= done.size();
+      stats_.completions += done.size();
+    }
+    for (auto& entry : done) {
+      try {
+        entry.first(entry.second);
+      } catch (std::exception& e) {
+        std::cout << "Completion callback failed: " << e.what() << std::endl;
+      }
+    }
+    done.clear();
+  }
+
+  // Abandoned watches still get their callback, so futures and coroutines do not hang
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& watch : incoming_) watches.push_back(std::move(watch));
+    incoming_.clear();
+    pending_ = 0;
+  }
+  for (auto& watch : watches) {
+    try {
+      watch.callback(ZE_RESULT_NOT_READY);
+    } catch (std::exception& e) {
+      std::cout << "Completion callback failed: " << e.what() << std::endl;
+    }
+  }
+}
+
+}  // namespace lzu
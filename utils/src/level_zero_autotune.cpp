@@ -0,0 +1,303 @@
+// Copyright 2020 Intel Corporation
+
+#include "level_zero_autotune.hpp"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "level_zero_cache_files.hpp"
+#include "level_zero_device_registry.hpp"
+#include "level_zero_profiler.hpp"
+#include "level_zero_queues.hpp"
+
+namespace lzu {
+
+namespace {
+
+const char kDatabaseHeader[] = "# lzu tuning database v1";
+
+bool divides(const std::array<uint32_t, 3>& global_size, const std::array<uint32_t, 3>& group_size) {
+  return group_size[0] && group_size[1] && group_size[2] && global_size[0] % group_size[0] == 0 &&
+         global_size[1] % group_size[1] == 0 && global_size[2] % group_size[2] == 0;
+}
+
+std::vector<uint32_t> divisors(uint32_t value, uint32_t limit) {
+  std::vector<uint32_t> result;
+  for (uint32_t d = 1; d <= std::min(value, limit); d++) {
+    if (value % d == 0) result.push_back(d);
+  }
+  return result;
+}
+
+}  // namespace
+
+// TuningDatabase
+TuningDatabase::TuningDatabase(const std::string& path, bool enabled)
+    : path_(path.empty() ? default_cache_path("LZU_TUNING_DB", "tuning.db") : path), enabled_(enabled) {
+  if (enabled_) {
+    load(&entries_);
+  }
+}
+
+TuningDatabase& TuningDatabase::get() {
+  static TuningDatabase database(std::string(), [] {
+    const char* disable = getenv("LZU_DISABLE_TUNING_DB");
+    return !(disable && strcmp(disable, "0") != 0);
+  }());
+  return database;
+}
+
+std::string TuningDatabase::make_key(ze_device_handle_t device, const std::string& kernel_name,
+                                     const std::array<uint32_t, 3>& global_size) {
+  const std::string device_part = device_key(device);
+  if (device_part.empty()) return std::string();
+  return device_part + "/" + kernel_name + "/" + std::to_string(global_size[0]) + "x" +
+         std::to_string(global_size[1]) + "x" + std::to_string(global_size[2]);
+}
+
+bool TuningDatabase::lookup(ze_device_handle_t device, const std::string& kernel_name,
+                            const std::array<uint32_t, 3>& global_size, TuningEntry* entry) {
+  std::string key = make_key(device, kernel_name, global_size);
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = key.empty() ? entries_.end() : entries_.find(key);
+  if (it == entries_.end()) {
+    stats_.misses++;
+    return false;
+  }
+  stats_.hits++;
+  *entry = it->second;
+  return true;
+}
+
+void TuningDatabase::store(ze_device_handle_t device, const std::string& kernel_name,
+                           const std::array<uint32_t, 3>& global_size, const TuningEntry& entry) {
+  std::string key = make_key(device, kernel_name, global_size);
+  if (key.empty()) return;
+  std::lock_guard<std::mutex> lock(mutex_);
+  entries_[key] = entry;
+  stats_.stores++;
+  if (enabled_) {
+    save();
+  }
+}
+
+void TuningDatabase::clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  entries_.clear();
+  if (enabled_) {
+    unlink(path_.c_str());
+  }
+}
+
+size_t TuningDatabase::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return entries_.size();
+}
+
+TuningDatabaseStats TuningDatabase::get_stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+void TuningDatabase::load(std::map<std::string, TuningEntry>* entries) {
+  std::ifstream stream(path_);
+  std::string line;
+  while (std::getline(stream, line)) {
+    if (line.empty() || line[0] == '#') continue;
+    std::istringstream fields(line);
+    std::string key;
+    TuningEntry entry;
+    if (fields >> key >> entry.group_size[0] >> entry.group_size[1] >> entry.group_size[2] >> entry.kernel_ns) {
+      (*entries)[key] = entry;
+    } else {
+      stats_.errors++;
+    }
+  }
+}
+
+void TuningDatabase::save() {
+  // Keep what other processes stored since this one loaded, entries of this process win
+  std::map<std::string, TuningEntry> merged;
+  load(&merged);
+  for (auto& entry : entries_) merged[entry.first] = entry.second;
+
+  const bool written = make_parent_directories(path_) && write_file_atomically(path_, [&](std::ostream& stream) {
+    stream << kDatabaseHeader << "\n";
+    for (auto& entry : merged) {
+      const TuningEntry& value = entry.second;
+      stream << entry.first << " " << value.group_size[0] << " " << value.group_size[1] << " " << value.group_size[2]
+             << " " << value.kernel_ns << "\n";
+    }
+  });
+  if (!written) {
+    stats_.errors++;
+    return;
+  }
+  entries_.swap(merged);
+}
+
+// Autotuner
+Autotuner::Autotuner(ze_context_handle_t context, ze_device_handle_t device, TuningDatabase* database,
+                     const AutotuneOptions& options)
+    : context_(context),
+      device_(device),
+      database_(database),
+      options_(options),
+      properties_(cached::get_device_properties(device)),
+      compute_properties_(cached::get_device_compute_properties(device)) {}
+
+std::array<uint32_t, 3> Autotuner::group_size(ze_kernel_handle_t kernel, const std::string& kernel_name,
+                                              const std::array<uint32_t, 3>& global_size) {
+  TuningEntry entry;
+  if (database_ && database_->lookup(device_, kernel_name, global_size, &entry)) {
+    return entry.group_size;
+  }
+  if (divides(global_size, options_.default_group_size)) return options_.default_group_size;
+  std::array<uint32_t, 3> result = {{1, 1, 1}};
+  suggest_group_size(kernel, global_size[0], global_size[1], global_size[2], &result[0], &result[1], &result[2]);
+  // The largest divisor of each dimension that does not exceed the suggestion
+  for (size_t d = 0; d < 3; d++) {
+    result[d] = std::max<uint32_t>(std::min(result[d], global_size[d]), 1);
+    while (global_size[d] % result[d] != 0) result[d]--;
+  }
+  return result;
+}
+
+ze_group_count_t Autotuner::apply(KernelLaunch& launch, const std::string& kernel_name,
+                                  const std::array<uint32_t, 3>& global_size) {
+  std::array<uint32_t, 3> size;
+  TuningEntry entry;
+  if (options_.tune_on_miss && !(database_ && database_->lookup(device_, kernel_name, global_size, &entry))) {
+    size = tune(launch, kernel_name, global_size).best.group_size;
+  } else {
+    size = group_size(launch.kernel(), kernel_name, global_size);
+  }
+  launch.set_group_size(size[0], size[1], size[2]);
+  return ze_group_count_t{global_size[0] / size[0], global_size[1] / size[1], global_size[2] / size[2]};
+}
+
+std::vector<std::array<uint32_t, 3>> Autotuner::candidates(ze_kernel_handle_t kernel,
+                                                           const std::array<uint32_t, 3>& global_size) const {
+  const uint32_t max_total = std::max<uint32_t>(compute_properties_.maxTotalGroupSize, 1);
+  std::vector<uint32_t> xs = divisors(global_size[0], compute_properties_.maxGroupSizeX);
+  std::vector<uint32_t> ys = divisors(global_size[1], compute_properties_.maxGroupSizeY);
+  std::vector<uint32_t> zs = divisors(global_size[2], compute_properties_.maxGroupSizeZ);
+
+  std::vector<std::array<uint32_t, 3>> shapes;
+  for (uint32_t x : xs) {
+    for (uint32_t y : ys) {
+      for (uint32_t z : zs) {
+        if (static_cast<uint64_t>(x) * y * z <= max_total) shapes.push_back({{x, y, z}});
+      }
+    }
+  }
+  // Fuller groups first, then the wider X side since X is usually the contiguous one
+  std::sort(shapes.begin(), shapes.end(), [](const std::array<uint32_t, 3>& a, const std::array<uint32_t, 3>& b) {
+    uint64_t size_a = static_cast<uint64_t>(a[0]) * a[1] * a[2];
+    uint64_t size_b = static_cast<uint64_t>(b[0]) * b[1] * b[2];
+    if (size_a != size_b) return size_a > size_b;
+    return a > b;
+  });
+  if (shapes.size() > options_.max_candidates) shapes.resize(options_.max_candidates);
+
+  std::array<uint32_t, 3> suggested = {{1, 1, 1}};
+  suggest_group_size(kernel, global_size[0], global_size[1], global_size[2], &suggested[0], &suggested[1],
+                     &suggested[2]);
+  if (divides(global_size, suggested) && std::find(shapes.begin(), shapes.end(), suggested) == shapes.end()) {
+    shapes.push_back(suggested);
+  }
+  const std::array<uint32_t, 3>& pinned = options_.default_group_size;
+  if (divides(global_size, pinned) && std::find(shapes.begin(), shapes.end(), pinned) == shapes.end()) {
+    shapes.push_back(pinned);
+  }
+  return shapes;
+}
+
+AutotuneResult Autotuner::tune(KernelLaunch& launch, const std::string& kernel_name,
+                               const std::array<uint32_t, 3>& global_size) {
+  std::vector<std::array<uint32_t, 3>> shapes = candidates(launch.kernel(), global_size);
+  if (shapes.empty()) {
+    throw std::runtime_error("Autotuner: no group size divides the global size of " + kernel_name);
+  }
+  const uint32_t repetitions = std::max<uint32_t>(options_.repetitions, 1);
+
+  DeviceQueues queues(context_, device_, false);
+  if (options_.validate) {
+    std::vector<std::array<uint32_t, 3>> valid;
+    for (const std::array<uint32_t, 3>& shape : shapes) {
+      const ze_group_count_t count = {global_size[0] / shape[0], global_size[1] / shape[1], global_size[2] / shape[2]};
+      queues.reset();
+      launch.set_group_size(shape[0], shape[1], shape[2]);
+      launch.append(queues.compute_list(), &count, nullptr, 0, nullptr);
+      queues.close();
+      queues.execute();
+      queues.synchronize(UINT64_MAX);
+      if (options_.validate(shape)) valid.push_back(shape);
+    }
+    shapes.swap(valid);
+    if (shapes.empty()) {
+      throw std::runtime_error("Autotuner: no group size gives a valid result for " + kernel_name);
+    }
+    queues.reset();
+  }
+  zeEventPool events;
+  events.InitEventPool(context_, static_cast<uint32_t>(shapes.size()) * repetitions);
+  std::vector<ze_event_handle_t> launch_events;
+
+  // One warm-up launch, then every candidate back to back with barriers so launches never overlap
+  for (size_t i = 0; i < shapes.size(); i++) {
+    const std::array<uint32_t, 3>& shape = shapes[i];
+    const ze_group_count_t count = {global_size[0] / shape[0], global_size[1] / shape[1], global_size[2] / shape[2]};
+    launch.set_group_size(shape[0], shape[1], shape[2]);
+    if (i == 0) {
+      launch.append(queues.compute_list(), &count, nullptr, 0, nullptr);
+      append_barrier(queues.compute_list(), nullptr, 0, nullptr);
+    }
+    for (uint32_t r = 0; r < repetitions; r++) {
+      ze_event_handle_t event = nullptr;
+      events.create_event(&event);
+      launch_events.push_back(event);
+      launch.append(queues.compute_list(), &count, event, 0, nullptr);
+      append_barrier(queues.compute_list(), nullptr, 0, nullptr);
+    }
+  }
+  queues.close();
+  queues.execute();
+  queues.synchronize(UINT64_MAX);
+
+  TimestampConverter converter(properties_);
+  AutotuneResult result;
+  bool have_best = false;
+  for (size_t i = 0; i < shapes.size(); i++) {
+    std::vector<double> times;
+    for (uint32_t r = 0; r < repetitions; r++) {
+      ze_kernel_timestamp_result_t timestamp = {};
+      if (zeEventQueryKernelTimestamp(launch_events[i * repetitions + r], &timestamp) == ZE_RESULT_SUCCESS) {
+        times.push_back(converter.elapsed_ns(timestamp.context.kernelStart, timestamp.context.kernelEnd));
+      }
+    }
+    if (times.empty()) continue;
+    std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+
+    TuningEntry entry;
+    entry.group_size = shapes[i];
+    entry.kernel_ns = times[times.size() / 2];
+    result.candidates.push_back(entry);
+    if (!have_best || entry.kernel_ns < result.best.kernel_ns) {
+      result.best = entry;
+      have_best = true;
+    }
+  }
+  for (ze_event_handle_t event : launch_events) events.destroy_event(event);
+  if (!have_best) {
+    throw std::runtime_error("Autotuner: no kernel timestamps for " + kernel_name);
+  }
+
+  if (database_) {
+    database_->store(device_, kernel_name, global_size, result.best);
+  }
+  launch.set_group_size(result.best.group_size[0], result.best.group_size[1], result.best.group_size[2]);
+  return result;
+}
+
+}  // namespace lzu
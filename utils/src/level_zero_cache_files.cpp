@@ -0,0 +1,176 @@
+// Copyright 2020 Intel Corporation
+
+#include "level_zero_cache_files.hpp"
+
+#include <dirent.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+
+#include "level_zero_device_registry.hpp"
+
+namespace lzu {
+
+namespace {
+
+const char kTemporaryInfix[] = ".tmp.";
+
+// Pid of a write_file_atomically temporary name, "<path>.tmp.<pid>.<counter>", or 0 for other names.
+pid_t temporary_file_owner(const std::string& name) {
+  size_t pos = name.rfind(kTemporaryInfix);
+  if (pos == std::string::npos) return 0;
+  const char* begin = name.c_str() + pos + sizeof(kTemporaryInfix) - 1;
+  char* end = nullptr;
+  uint64_t pid = strtoull(begin, &end, 10);
+  if (end == begin || *end != '.') return 0;
+  const char* counter = end + 1;
+  strtoull(counter, &end, 10);
+  if (end == counter || *end != '\0') return 0;
+  return static_cast<pid_t>(pid);
+}
+
+// Whether device is one of devices or a sub-device of one of them, at any depth.
+bool contains_device(const std::vector<ze_device_handle_t>& devices, ze_device_handle_t device) {
+  for (auto candidate : devices) {
+    if (candidate == device) return true;
+    uint32_t count = 0;
+    if (zeDeviceGetSubDevices(candidate, &count, nullptr) != ZE_RESULT_SUCCESS || count == 0) continue;
+    std::vector<ze_device_handle_t> sub_devices(count);
+    if (zeDeviceGetSubDevices(candidate, &count, sub_devices.data()) != ZE_RESULT_SUCCESS) continue;
+    sub_devices.resize(count);
+    if (contains_device(sub_devices, device)) return true;
+  }
+  return false;
+}
+
+// Driver that lists device or the root device it is part of, null when none does.
+ze_driver_handle_t owning_driver(ze_device_handle_t device) {
+  static std::mutex mutex;
+  static std::unordered_map<ze_device_handle_t, ze_driver_handle_t> owners;
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = owners.find(device);
+  if (it != owners.end()) return it->second;
+
+  // The device handle does not know its driver, the registry does for the root devices it discovered
+  const DeviceInfo* info = DeviceRegistry::get().find(device);
+  ze_driver_handle_t owner = info ? info->driver : nullptr;
+  if (owner == nullptr) {
+    try {
+      for (auto driver : get_all_driver_handles()) {
+        if (contains_device(get_devices(driver), device)) {
+          owner = driver;
+          break;
+        }
+      }
+    } catch (std::exception& e) {
+      std::cout << "Failed to find the driver of a device: " << e.what() << std::endl;
+    }
+  }
+  if (owner) owners[device] = owner;
+  return owner;
+}
+
+}  // namespace
+
+bool make_directories(const std::string& path) {
+  for (size_t pos = path.find('/', 1);; pos = path.find('/', pos + 1)) {
+    std::string prefix = path.substr(0, pos);
+    if (!prefix.empty() && mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST) {
+      return false;
+    }
+    if (pos == std::string::npos) return true;
+  }
+}
+
+bool make_parent_directories(const std::string& path) {
+  size_t pos = path.rfind('/');
+  return pos == std::string::npos || pos == 0 || make_directories(path.substr(0, pos));
+}
+
+std::string default_cache_path(const char* variable, const std::string& name) {
+  const char* path = getenv(variable);
+  if (path && *path) return path;
+  path = getenv("XDG_CACHE_HOME");
+  if (path && *path) return std::string(path) + "/lzu/" + name;
+  path = getenv("HOME");
+  if (path && *path) return std::string(path) + "/.cache/lzu/" + name;
+  return "/tmp/lzu/" + name;
+}
+
+bool write_file_atomically(const std::string& path, const std::function<void(std::ostream&)>& write) {
+  static std::atomic<uint32_t> counter(0);
+  // Unique per process and call, concurrent writers never share a temporary file
+  std::string temp_path = path + kTemporaryInfix + std::to_string(getpid()) + "." + std::to_string(counter++);
+  {
+    std::ofstream stream(temp_path, std::ios::out | std::ios::binary | std::ios::trunc);
+    write(stream);
+    stream.flush();
+    if (!stream.good()) {
+      stream.close();
+      unlink(temp_path.c_str());
+      return false;
+    }
+  }
+  if (rename(temp_path.c_str(), path.c_str()) != 0) {
+    unlink(temp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+uint32_t remove_orphaned_temporary_files(const std::string& directory, uint32_t max_age_seconds) {
+  DIR* dir = opendir(directory.c_str());
+  if (dir == nullptr) return 0;
+  uint32_t removed = 0;
+  const time_t now = time(nullptr);
+  while (struct dirent* entry = readdir(dir)) {
+    pid_t owner = temporary_file_owner(entry->d_name);
+    if (owner <= 0 || owner == getpid()) continue;
+    std::string path = directory + "/" + entry->d_name;
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) continue;
+    // A live writer renames its file shortly, only leftovers of dead or very slow ones go
+    bool dead = kill(owner, 0) != 0 && errno == ESRCH;
+    if ((dead || now - info.st_mtime > max_age_seconds) && unlink(path.c_str()) == 0) removed++;
+  }
+  closedir(dir);
+  return removed;
+}
+
+std::string device_key(ze_device_handle_t device) {
+  static const char digits[] = "0123456789abcdef";
+  ze_driver_handle_t driver = owning_driver(device);
+  if (driver == nullptr) return std::string();
+  std::string key;
+  try {
+    ze_device_properties_t properties = cached::get_device_properties(device);
+    for (size_t i = 0; i < sizeof(properties.uuid.id); i++) {
+      key.push_back(digits[properties.uuid.id[i] >> 4]);
+      key.push_back(digits[properties.uuid.id[i] & 15]);
+    }
+    key += "-" + std::to_string(get_driver_properties(driver).driverVersion);
+  } catch (std::exception& e) {
+    std::cout << "Failed to build the device key: " << e.what() << std::endl;
+    return std::string();
+  }
+  return key;
+}
+
+double median(std::vector<double> samples) {
+  if (samples.empty()) return 0;
+  std::sort(samples.begin(), samples.end());
+  size_t middle = samples.size() / 2;
+  return (samples.size() % 2) ? samples[middle] : (samples[middle - 1] + samples[middle]) / 2;
+}
+
+}  // namespace lzu
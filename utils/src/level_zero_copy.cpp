@@ -0,0 +1,430 @@
+// Copyright 2020 Intel Corporation
+#include "level_zero_copy.hpp"
+
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "level_zero_allocator.hpp"
+#include "level_zero_cache_files.hpp"
+#include "level_zero_device_registry.hpp"
+#include "level_zero_queues.hpp"
+
+namespace lzu {
+
+namespace {
+
+// Below this a launch costs more than the vector width gains, element copies keep the grid small
+const size_t kSmallCopy = 4096;
+
+// Sub-group block reads only pay off once every sub-group has several blocks to move
+const size_t kBlockCopy = 1 << 20;
+
+bool aligned(uintptr_t value, size_t alignment) { return value % alignment == 0; }
+
+struct LaunchLimits {
+  uint32_t group_size;  // Along the dimension the copy is spread over, at most 256
+  uint32_t max_groups;  // Enough groups to fill every hardware thread, the kernels loop over the rest
+};
+
+LaunchLimits launch_limits(ze_device_handle_t device, uint32_t dimension) {
+  const ze_device_compute_properties_t compute = cached::get_device_compute_properties(device);
+  const uint32_t max_size = dimension == 0 ? compute.maxGroupSizeX : compute.maxGroupSizeY;
+  LaunchLimits limits;
+  limits.group_size = std::min<uint32_t>(256, std::max<uint32_t>(compute.maxTotalGroupSize, 1));
+  limits.group_size = std::min<uint32_t>(limits.group_size, std::max<uint32_t>(max_size, 1));
+
+  const ze_device_properties_t properties = cached::get_device_properties(device);
+  const uint64_t threads = static_cast<uint64_t>(properties.numSlices) * properties.numSubslicesPerSlice *
+                           properties.numEUsPerSubslice * properties.numThreadsPerEU;
+  limits.max_groups = threads ? static_cast<uint32_t>(std::min<uint64_t>(threads, UINT32_MAX)) : 1024;
+  return limits;
+}
+
+// Folds each copy into the previous one when both of its ranges continue the previous ranges
+std::vector<CopyDescriptor> merge_runs(const std::vector<CopyDescriptor>& copies) {
+  std::vector<CopyDescriptor> runs;
+  runs.reserve(copies.size());
+  for (const CopyDescriptor& copy : copies) {
+    if (copy.bytes == 0) continue;
+    if (!runs.empty()) {
+      CopyDescriptor& last = runs.back();
+      if (static_cast<uint8_t*>(last.dst) + last.bytes == copy.dst &&
+          static_cast<const uint8_t*>(last.src) + last.bytes == copy.src) {
+        last.bytes += copy.bytes;
+        continue;
+      }
+    }
+    runs.push_back(copy);
+  }
+  return runs;
+}
+
+bool is_usm(ze_context_handle_t context, const void* ptr) {
+  ze_memory_allocation_properties_t properties = {ZE_STRUCTURE_TYPE_MEMORY_ALLOCATION_PROPERTIES};
+  return zeMemGetAllocProperties(context, ptr, &properties, nullptr) == ZE_RESULT_SUCCESS &&
+         properties.type != ZE_MEMORY_TYPE_UNKNOWN;
+}
+
+}  // namespace
+
+const char* to_string(CopyVariant variant) {
+  switch (variant) {
+    case CopyVariant::Driver:
+      return "driver";
+    case CopyVariant::Bytes:
+      return "bytes";
+    case CopyVariant::Words16:
+      return "words16";
+    case CopyVariant::Words32:
+      return "words32";
+    case CopyVariant::Words64:
+      return "words64";
+    case CopyVariant::Unaligned:
+      return "unaligned";
+    case CopyVariant::Vector16:
+      return "vector16";
+    case CopyVariant::Vector32:
+      return "vector32";
+    case CopyVariant::Block:
+      return "block";
+    default:
+      return "unknown";
+  }
+}
+
+const char* to_string(BatchMethod method) {
+  switch (method) {
+    case BatchMethod::Kernel:
+      return "kernel";
+    case BatchMethod::Indirect:
+      return "indirect";
+    case BatchMethod::Driver:
+      return "driver";
+    default:
+      return "unknown";
+  }
+}
+
+const char* copy_kernel_name(CopyVariant variant) {
+  switch (variant) {
+    case CopyVariant::Bytes:
+      return "copy_u8";
+    case CopyVariant::Words16:
+      return "copy_u16";
+    case CopyVariant::Words32:
+      return "copy_u32";
+    case CopyVariant::Words64:
+      return "copy_u64";
+    case CopyVariant::Unaligned:
+      return "copy_unaligned";
+    case CopyVariant::Vector16:
+      return "copy_x16";
+    case CopyVariant::Vector32:
+      return "copy_x32";
+    case CopyVariant::Block:
+      return "copy_block";
+    default:
+      return nullptr;
+  }
+}
+
+size_t copy_unit(CopyVariant variant) {
+  switch (variant) {
+    case CopyVariant::Words16:
+      return 2;
+    case CopyVariant::Words32:
+      return 4;
+    case CopyVariant::Words64:
+      return 8;
+    case CopyVariant::Unaligned:
+    case CopyVariant::Vector16:
+    case CopyVariant::Block:
+      return 16;
+    case CopyVariant::Vector32:
+      return 32;
+    default:
+      return 1;
+  }
+}
+
+std::vector<CopyVariant> copy_candidates(const void* dst, const void* src, size_t bytes) {
+  const uintptr_t d = reinterpret_cast<uintptr_t>(dst);
+  const uintptr_t s = reinterpret_cast<uintptr_t>(src);
+  // The vector kernels copy the head bytewise, they only need src and dst to be equally misaligned
+  const uintptr_t distance = d > s ? d - s : s - d;
+  // The element kernels need both pointers and the size aligned
+  const uintptr_t common = d | s | bytes;
+
+  std::vector<CopyVariant> candidates;
+  if (bytes >= kSmallCopy) {
+    if (bytes >= kBlockCopy && aligned(distance, 16)) {
+      candidates.push_back(CopyVariant::Block);
+    }
+    if (aligned(distance, 32)) {
+      candidates.push_back(CopyVariant::Vector32);
+    }
+    if (aligned(distance, 16)) {
+      candidates.push_back(CopyVariant::Vector16);
+    } else {
+      candidates.push_back(CopyVariant::Unaligned);
+    }
+  }
+  if (aligned(common, 8)) {
+    candidates.push_back(CopyVariant::Words64);
+  }
+  if (aligned(common, 4)) {
+    candidates.push_back(CopyVariant::Words32);
+  }
+  if (aligned(common, 2)) {
+    candidates.push_back(CopyVariant::Words16);
+  }
+  candidates.push_back(CopyVariant::Bytes);
+  candidates.push_back(CopyVariant::Driver);
+  return candidates;
+}
+
+CopyKernels::CopyKernels(ze_module_handle_t module, ze_device_handle_t device)
+    : registry_(module), kernels_(static_cast<size_t>(CopyVariant::Count), nullptr) {
+  for (size_t i = 0; i < kernels_.size(); i++) {
+    const char* name = copy_kernel_name(static_cast<CopyVariant>(i));
+    if (name) {
+      kernels_[i] = registry_.find(name);
+    }
+  }
+
+  const LaunchLimits limits = launch_limits(device, 0);
+  group_size_ = limits.group_size;
+  max_groups_ = limits.max_groups;
+
+  for (KernelLaunch* launch : kernels_) {
+    if (launch) {
+      launch->set_group_size(group_size_, 1, 1);
+    }
+  }
+}
+
+bool CopyKernels::available(CopyVariant variant) const {
+  return variant == CopyVariant::Driver || kernels_.at(static_cast<size_t>(variant)) != nullptr;
+}
+
+ze_group_count_t CopyKernels::group_count(CopyVariant variant, size_t bytes) const {
+  const size_t unit = copy_unit(variant);
+  // Head and tail bytes are copied by the first work-items, at least one unit of them has to exist
+  const size_t items = std::max(bytes / unit, unit);
+  const size_t groups = std::min<size_t>((items + group_size_ - 1) / group_size_, max_groups_);
+  return ze_group_count_t{static_cast<uint32_t>(std::max<size_t>(groups, 1)), 1, 1};
+}
+
+CopyVariant CopyKernels::append_copy(ze_command_list_handle_t command_list, void* dst, const void* src, size_t bytes,
+                                     ze_event_handle_t signal_event, uint32_t num_wait_events,
+                                     ze_event_handle_t* wait_events) {
+  for (CopyVariant variant : copy_candidates(dst, src, bytes)) {
+    if (variant == CopyVariant::Driver) {
+      append_memory_copy(command_list, dst, src, bytes, signal_event, num_wait_events, wait_events);
+      return variant;
+    }
+    KernelLaunch* launch = kernels_[static_cast<size_t>(variant)];
+    if (!launch) {
+      continue;
+    }
+    // Element kernels take an element count, the others a byte count
+    const bool elements = variant == CopyVariant::Bytes || variant == CopyVariant::Words16 ||
+                          variant == CopyVariant::Words32 || variant == CopyVariant::Words64;
+    const uint64_t count = elements ? bytes / copy_unit(variant) : bytes;
+    launch->set_argument(0, src);
+    launch->set_argument(1, dst);
+    launch->set_argument(2, count);
+    const ze_group_count_t groups = group_count(variant, bytes);
+    launch->append(command_list, &groups, signal_event, num_wait_events, wait_events);
+    return variant;
+  }
+  throw std::runtime_error("No copy variant available");
+}
+
+// BatchCopier
+BatchCopier::BatchCopier(ze_context_handle_t context, ze_device_handle_t device, ze_module_handle_t module,
+                         bool check_pointers, bool indirect_rows)
+    : context_(context), device_(device), registry_(module), check_pointers_(check_pointers) {
+  if (module) {
+    batch_ = registry_.find("copy_batch");
+    indirect_ = registry_.find("copy_data_indirect");
+    indirect_rows_ = indirect_ && indirect_rows;
+  }
+
+  // Work-groups are 1 x group size x 1, one row of them per copy
+  const LaunchLimits limits = launch_limits(device, 1);
+  max_group_size_ = limits.group_size;
+  max_groups_ = limits.max_groups;
+}
+
+BatchCopier::~BatchCopier() {
+  try {
+    reset();
+  } catch (std::exception& e) {
+    std::cout << "Failed to destroy batch copier: " << e.what() << std::endl;
+  }
+}
+
+BatchMethod BatchCopier::choose(const std::vector<CopyDescriptor>& runs) const {
+  if (runs.empty() || runs.size() > UINT32_MAX || (!batch_ && !indirect_)) return BatchMethod::Driver;
+  for (size_t i = 0; check_pointers_ && i < runs.size(); i++) {
+    if (!is_usm(context_, runs[i].dst) || !is_usm(context_, runs[i].src)) return BatchMethod::Driver;
+  }
+  if (batch_) return BatchMethod::Kernel;
+
+  // copy_data_indirect copies the same number of uints for every buffer
+  const uint64_t bytes = runs.front().bytes;
+  if (bytes % 4 != 0 || bytes / 4 > INT32_MAX) return BatchMethod::Driver;
+  for (const CopyDescriptor& run : runs) {
+    const uintptr_t common = reinterpret_cast<uintptr_t>(run.dst) | reinterpret_cast<uintptr_t>(run.src);
+    if (run.bytes != bytes || !aligned(common, 4)) return BatchMethod::Driver;
+  }
+  return BatchMethod::Indirect;
+}
+
+BatchMethod BatchCopier::method(const std::vector<CopyDescriptor>& copies) const { return choose(merge_runs(copies)); }
+
+void* BatchCopier::table(size_t bytes) {
+  void* table = cached::allocate_host_memory(bytes, 64, context_);
+  tables_.push_back(table);
+  return table;
+}
+
+BatchMethod BatchCopier::append(ze_command_list_handle_t command_list, const std::vector<CopyDescriptor>& copies,
+                                ze_event_handle_t signal_event, uint32_t num_wait_events,
+                                ze_event_handle_t* wait_events) {
+  std::vector<CopyDescriptor> runs = merge_runs(copies);
+  const BatchMethod method = choose(runs);
+  stats_.batches++;
+  stats_.copies += copies.size();
+  stats_.merged += copies.size() - runs.size();
+  stats_.by_method[static_cast<size_t>(method)]++;
+  uint64_t largest = 0;
+  for (const CopyDescriptor& run : runs) {
+    stats_.bytes += run.bytes;
+    largest = std::max(largest, run.bytes);
+  }
+
+  if (method == BatchMethod::Driver) {
+    if (runs.size() == 1) {
+      append_memory_copy(command_list, runs[0].dst, runs[0].src, runs[0].bytes, signal_event, num_wait_events,
+                         wait_events);
+      stats_.commands++;
+      return method;
+    }
+    // The copies may run concurrently, the wait and the barrier bracket all of them
+    if (num_wait_events) append_wait_on_events(command_list, num_wait_events, wait_events);
+    for (const CopyDescriptor& run : runs) {
+      append_memory_copy(command_list, run.dst, run.src, run.bytes, nullptr, 0, nullptr);
+    }
+    if (signal_event) append_barrier(command_list, signal_event, 0, nullptr);
+    stats_.commands += runs.size();
+    return method;
+  }
+
+  const uint32_t count = static_cast<uint32_t>(runs.size());
+  const uint64_t units = std::max<uint64_t>((largest + 3) / 4, 1);
+  uint32_t group_size = 1;
+  while (group_size < units && group_size * 2 <= max_group_size_) group_size *= 2;
+  const uint64_t rows = std::max<uint32_t>(max_groups_ / count, 1);
+  ze_group_count_t groups = {count, static_cast<uint32_t>(std::min((units + group_size - 1) / group_size, rows)), 1};
+  if (method == BatchMethod::Indirect && !indirect_rows_) {
+    group_size = 1;
+    groups.groupCountY = 1;
+  }
+
+  KernelLaunch* launch;
+  if (method == BatchMethod::Kernel) {
+    void* descriptors = table(count * sizeof(CopyDescriptor));
+    memcpy(descriptors, runs.data(), count * sizeof(CopyDescriptor));
+    launch = batch_;
+    launch->set_argument(0, descriptors);
+  } else {
+    // Two tables of struct copy_data, which is a single pointer
+    void** sources = static_cast<void**>(table(count * sizeof(void*)));
+    void** destinations = static_cast<void**>(table(count * sizeof(void*)));
+    for (uint32_t i = 0; i < count; i++) {
+      sources[i] = const_cast<void*>(runs[i].src);
+      destinations[i] = runs[i].dst;
+    }
+    launch = indirect_;
+    launch->set_argument(0, sources);
+    launch->set_argument(1, destinations);
+    launch->set_argument(2, int32_t(0));
+    launch->set_argument(3, static_cast<int32_t>(runs[0].bytes / 4));
+  }
+  launch->set_group_size(1, group_size, 1);
+  launch->append(command_list, &groups, signal_event, num_wait_events, wait_events);
+  stats_.commands++;
+  return method;
+}
+
+void BatchCopier::reset() {
+  for (void* table : tables_) cached::free_memory(context_, table);
+  tables_.clear();
+}
+
+BatchCopyReport BatchCopier::compare(const std::vector<CopyDescriptor>& copies, uint32_t repetitions) {
+  typedef std::chrono::steady_clock Clock;
+  const uint32_t ordinal = discover_queue_groups(device_).compute_ordinal;
+  ze_command_queue_handle_t queue = create_command_queue(context_, device_, 0, ZE_COMMAND_QUEUE_MODE_DEFAULT,
+                                                         ZE_COMMAND_QUEUE_PRIORITY_NORMAL, ordinal, 0);
+  ze_command_list_handle_t list = nullptr;
+  zeEventPool events;
+  const BatchCopyStats saved = stats_;
+
+  std::vector<double> individual;
+  std::vector<double> batched;
+  std::vector<ze_event_handle_t> handles(copies.size());
+  try {
+    list = create_command_list(context_, device_, 0, ordinal);
+    events.InitEventPool(context_, static_cast<uint32_t>(copies.size()) + 1);
+    for (uint32_t r = 0; r <= repetitions; r++) {
+      for (auto& handle : handles) events.create_event(&handle);
+      Clock::time_point start = Clock::now();
+      reset_command_list(list);
+      for (size_t i = 0; i < copies.size(); i++) {
+        append_memory_copy(list, copies[i].dst, copies[i].src, copies[i].bytes, handles[i], 0, nullptr);
+      }
+      close_command_list(list);
+      execute_command_lists(queue, 1, &list, nullptr);
+      synchronize(queue, UINT64_MAX);
+      // The first round is warmup
+      if (r) individual.push_back(std::chrono::duration<double, std::nano>(Clock::now() - start).count());
+      for (auto handle : handles) events.destroy_event(handle);
+
+      ze_event_handle_t event = nullptr;
+      events.create_event(&event);
+      start = Clock::now();
+      reset_command_list(list);
+      append(list, copies, event);
+      close_command_list(list);
+      execute_command_lists(queue, 1, &list, nullptr);
+      synchronize(queue, UINT64_MAX);
+      if (r) batched.push_back(std::chrono::duration<double, std::nano>(Clock::now() - start).count());
+      events.destroy_event(event);
+      reset();
+    }
+  } catch (...) {
+    stats_ = saved;
+    reset();
+    if (list) destroy_command_list(list);
+    destroy_command_queue(queue);
+    throw;
+  }
+  stats_ = saved;
+  destroy_command_list(list);
+  destroy_command_queue(queue);
+
+  BatchCopyReport report;
+  report.copies = static_cast<uint32_t>(copies.size());
+  for (const CopyDescriptor& copy : copies) report.bytes += copy.bytes;
+  report.method = method(copies);
+  report.individual_ns = median(individual);
+  report.batched_ns = median(batched);
+  return report;
+}
+
+}  // namespace lzu
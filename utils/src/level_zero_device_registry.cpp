@@ -0,0 +1,163 @@
+// Copyright 2020 Intel Corporation
+
+#include "level_zero_device_registry.hpp"
+
+#include <chrono>
+#include <exception>
+#include <thread>
+
+#include "level_zero_host_kernels.hpp"
+
+namespace lzu {
+
+namespace {
+
+std::vector<ze_device_memory_properties_t> get_device_memory_properties(ze_device_handle_t device) {
+  uint32_t count = 0;
+  ze_result_t result = zeDeviceGetMemoryProperties(device, &count, nullptr);
+  if (result != ZE_RESULT_SUCCESS) {
+    throw std::runtime_error("zeDeviceGetMemoryProperties failed: " + to_string(result));
+  }
+  ze_device_memory_properties_t memory = {};
+  memory.stype = ZE_STRUCTURE_TYPE_DEVICE_MEMORY_PROPERTIES;
+  std::vector<ze_device_memory_properties_t> properties(count, memory);
+  result = zeDeviceGetMemoryProperties(device, &count, properties.data());
+  if (result != ZE_RESULT_SUCCESS) {
+    throw std::runtime_error("zeDeviceGetMemoryProperties failed: " + to_string(result));
+  }
+  properties.resize(count);
+  return properties;
+}
+
+// Everything one driver contributes, filled by its own thread
+struct DriverDiscovery {
+  DriverInfo driver;
+  std::vector<DeviceInfo> devices;
+  std::exception_ptr error;
+};
+
+void discover_driver(ze_driver_handle_t driver, DriverDiscovery* discovery) {
+  try {
+    discovery->driver.driver = driver;
+    discovery->driver.properties = get_driver_properties(driver);
+    discovery->driver.context = get_context(driver);
+    for (auto device : get_devices(driver)) {
+      DeviceInfo info;
+      info.driver = driver;
+      info.device = device;
+      info.context = discovery->driver.context;
+      info.properties = get_device_properties(device);
+      info.compute_properties = get_device_compute_properties(device);
+      info.memory_properties = get_device_memory_properties(device);
+      info.queue_groups = get_command_queue_group_properties(device);
+      discovery->devices.push_back(info);
+    }
+  } catch (...) {
+    discovery->error = std::current_exception();
+  }
+}
+
+}  // namespace
+
+DeviceRegistry::DeviceRegistry() {
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  // Before any module of the software driver can launch, a no-op without it
+  register_software_kernels();
+
+  std::vector<ze_driver_handle_t> handles = get_all_driver_handles();
+  std::vector<DriverDiscovery> discoveries(handles.size());
+  // The first driver is discovered on this thread while the others run on their own
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < handles.size(); i++) {
+    threads.emplace_back(discover_driver, handles[i], &discoveries[i]);
+  }
+  if (!handles.empty()) discover_driver(handles[0], &discoveries[0]);
+  for (auto& thread : threads) thread.join();
+
+  std::exception_ptr error;
+  for (auto& discovery : discoveries) {
+    if (discovery.error && !error) error = discovery.error;
+    for (auto& device : discovery.devices) {
+      discovery.driver.devices.push_back(devices_.size());
+      device_index_[device.device] = devices_.size();
+      devices_.push_back(device);
+    }
+    drivers_.push_back(discovery.driver);
+  }
+  if (error) {
+    for (auto& driver : drivers_) {
+      if (driver.context) zeContextDestroy(driver.context);
+    }
+    std::rethrow_exception(error);
+  }
+
+  discovery_ms_ = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+DeviceRegistry& DeviceRegistry::get() {
+  // Never destroyed: the contexts have to outlive other singletons, like the caching allocator, that free into them
+  // during static destruction
+  static DeviceRegistry* registry = new DeviceRegistry();
+  return *registry;
+}
+
+const DeviceInfo* DeviceRegistry::find(ze_device_handle_t device) const {
+  auto it = device_index_.find(device);
+  return it == device_index_.end() ? nullptr : &devices_[it->second];
+}
+
+const DriverInfo* DeviceRegistry::find(ze_driver_handle_t driver) const {
+  for (auto& info : drivers_) {
+    if (info.driver == driver) return &info;
+  }
+  return nullptr;
+}
+
+const DeviceInfo& DeviceRegistry::device(ze_device_handle_t device) const {
+  const DeviceInfo* info = find(device);
+  if (info == nullptr) {
+    throw std::runtime_error("DeviceRegistry: unknown device");
+  }
+  return *info;
+}
+
+ze_context_handle_t DeviceRegistry::context(ze_driver_handle_t driver) const {
+  const DriverInfo* info = find(driver);
+  if (info == nullptr) {
+    throw std::runtime_error("DeviceRegistry: unknown driver");
+  }
+  return info->context;
+}
+
+std::vector<std::pair<ze_driver_handle_t, ze_device_handle_t>> DeviceRegistry::supported_devices() const {
+  std::vector<std::pair<ze_driver_handle_t, ze_device_handle_t>> result;
+  for (auto& info : devices_) result.push_back(std::make_pair(info.driver, info.device));
+  return result;
+}
+
+namespace cached {
+
+std::vector<std::pair<ze_driver_handle_t, ze_device_handle_t>> getSupportedDevices() {
+  return DeviceRegistry::get().supported_devices();
+}
+
+ze_context_handle_t get_context(ze_driver_handle_t driver) { return DeviceRegistry::get().context(driver); }
+
+ze_device_properties_t get_device_properties(ze_device_handle_t device) {
+  const DeviceInfo* info = DeviceRegistry::get().find(device);
+  return info ? info->properties : lzu::get_device_properties(device);
+}
+
+ze_device_compute_properties_t get_device_compute_properties(ze_device_handle_t device) {
+  const DeviceInfo* info = DeviceRegistry::get().find(device);
+  return info ? info->compute_properties : lzu::get_device_compute_properties(device);
+}
+
+std::vector<ze_command_queue_group_properties_t> get_command_queue_group_properties(ze_device_handle_t device) {
+  const DeviceInfo* info = DeviceRegistry::get().find(device);
+  return info ? info->queue_groups : lzu::get_command_queue_group_properties(device);
+}
+
+}  // namespace cached
+
+}  // namespace lzu
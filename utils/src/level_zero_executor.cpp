@@ -0,0 +1,204 @@
+// Copyright 2020 Intel Corporation
+
+#include "level_zero_executor.hpp"
+
+#include "level_zero_allocator.hpp"
+#include "level_zero_device_registry.hpp"
+#include "level_zero_module_cache.hpp"
+#include "level_zero_profiler.hpp"
+
+namespace lzu {
+
+namespace {
+
+uint32_t group_count_of(const ze_group_count_t& count, uint32_t dimension) {
+  return dimension == 0 ? count.groupCountX : (dimension == 1 ? count.groupCountY : count.groupCountZ);
+}
+
+void set_group_count(ze_group_count_t* count, uint32_t dimension, uint32_t value) {
+  if (dimension == 0) {
+    count->groupCountX = value;
+  } else if (dimension == 1) {
+    count->groupCountY = value;
+  } else {
+    count->groupCountZ = value;
+  }
+}
+
+double kernel_duration_ms(ze_event_handle_t event, const ze_device_properties_t& properties) {
+  ze_kernel_timestamp_result_t timestamp = {};
+  if (zeEventQueryKernelTimestamp(event, &timestamp) != ZE_RESULT_SUCCESS) return 0;
+  TimestampConverter converter(properties);
+  return converter.elapsed_ns(timestamp.global.kernelStart, timestamp.global.kernelEnd) / 1e6;
+}
+
+}  // namespace
+
+MultiDeviceExecutor::MultiDeviceExecutor(
+    const std::vector<std::pair<ze_driver_handle_t, ze_device_handle_t>>& devices) {
+  if (devices.empty()) {
+    throw std::runtime_error("MultiDeviceExecutor: no devices");
+  }
+  for (auto& entry : devices) {
+    auto it = contexts_.find(entry.first);
+    if (it == contexts_.end()) it = contexts_.emplace(entry.first, cached::get_context(entry.first)).first;
+
+    std::unique_ptr<ExecutorDevice> device(new ExecutorDevice());
+    device->driver = entry.first;
+    device->device = entry.second;
+    device->context = it->second;
+    device->properties = cached::get_device_properties(entry.second);
+    device->compute_properties = cached::get_device_compute_properties(entry.second);
+    device->queues.reset(new DeviceQueues(device->context, device->device));
+    device->events.reset(new zeEventPool());
+    device->events->InitEventPool(device->context, 8);
+    // Hardware threads times clock until there is a measurement
+    const ze_device_properties_t& p = device->properties;
+    double threads =
+        static_cast<double>(p.numSlices) * p.numSubslicesPerSlice * p.numEUsPerSubslice * p.numThreadsPerEU;
+    device->weight = std::max(threads, 1.0) * std::max(p.coreClockRate, 1u);
+    devices_.push_back(std::move(device));
+  }
+}
+
+MultiDeviceExecutor::~MultiDeviceExecutor() {
+  for (auto& device : devices_) {
+    try {
+      if (device->kernels) device->kernels->clear();
+      if (device->module) destroy_module(device->module);
+      device->queues.reset();
+      device->events.reset();
+    } catch (std::exception& e) {
+      std::cout << "Failed to release executor device: " << e.what() << std::endl;
+    }
+  }
+  // The contexts belong to the registry, only the blocks cached for them go
+  for (auto& context : contexts_) {
+    try {
+      CachingAllocator::get().empty_cache(context.second);
+    } catch (std::exception& e) {
+      std::cout << "Failed to release executor context: " << e.what() << std::endl;
+    }
+  }
+}
+
+void MultiDeviceExecutor::load_module(const uint8_t* data, size_t bytes, ze_module_format_t format,
+                                      const char* build_flags) {
+  for (auto& device : devices_) {
+    if (device->kernels) device->kernels->clear();
+    if (device->module) destroy_module(device->module);
+    device->module = ModuleCache::get().create_module(device->context, device->device, data, bytes, format,
+                                                      build_flags, nullptr);
+    device->kernels.reset(new KernelRegistry(device->module));
+  }
+}
+
+std::vector<Shard> MultiDeviceExecutor::plan(const std::array<uint32_t, 3>& global_size,
+                                             const std::array<uint32_t, 3>& group_size, uint32_t dimension) const {
+  if (dimension > 2) {
+    throw std::runtime_error("MultiDeviceExecutor: dimension must be 0, 1 or 2");
+  }
+  ze_group_count_t total = {};
+  for (uint32_t d = 0; d < 3; d++) {
+    if (group_size[d] == 0 || global_size[d] % group_size[d] != 0) {
+      throw std::runtime_error("MultiDeviceExecutor: global size must be a multiple of the group size");
+    }
+    set_group_count(&total, d, global_size[d] / group_size[d]);
+  }
+
+  double total_weight = 0;
+  for (auto& device : devices_) total_weight += device->weight;
+
+  // One group per device when there are enough, so every device keeps being measured, the rest in whole groups by
+  // weight. The rounding remainder goes to the last device.
+  const uint32_t devices = static_cast<uint32_t>(devices_.size());
+  const uint32_t groups = group_count_of(total, dimension);
+  const uint32_t reserved = groups >= devices ? 1 : 0;
+  const uint32_t shared = groups - reserved * devices;
+  std::vector<Shard> shards;
+  uint32_t assigned = 0;
+  for (uint32_t i = 0; i < devices; i++) {
+    uint32_t count = groups - assigned;
+    if (i + 1 < devices) {
+      const uint32_t share = static_cast<uint32_t>(shared * (devices_[i]->weight / total_weight) + 0.5);
+      count = std::min(count - reserved * (devices - 1 - i), reserved + share);
+    }
+    if (count == 0) continue;
+
+    Shard shard;
+    shard.device_index = i;
+    shard.dimension = dimension;
+    shard.group_count = total;
+    set_group_count(&shard.group_count, dimension, count);
+    for (uint32_t d = 0; d < 3; d++) {
+      shard.offset[d] = (d == dimension) ? assigned * group_size[d] : 0;
+      shard.size[d] = group_count_of(shard.group_count, d) * group_size[d];
+    }
+    const ze_device_compute_properties_t& limits = devices_[i]->compute_properties;
+    const ze_group_count_t& count_xyz = shard.group_count;
+    if (count_xyz.groupCountX > limits.maxGroupCountX || count_xyz.groupCountY > limits.maxGroupCountY ||
+        count_xyz.groupCountZ > limits.maxGroupCountZ) {
+      throw std::runtime_error("MultiDeviceExecutor: shard exceeds the group count limit of device " +
+                               std::to_string(i));
+    }
+    shards.push_back(shard);
+    assigned += count;
+  }
+  return shards;
+}
+
+std::vector<Shard> MultiDeviceExecutor::run(const std::string& kernel_name, const std::array<uint32_t, 3>& global_size,
+                                            const std::array<uint32_t, 3>& group_size, const PrepareFunction& prepare,
+                                            const FinishFunction& finish, uint32_t dimension) {
+  std::vector<Shard> shards = plan(global_size, group_size, dimension);
+  std::vector<ze_event_handle_t> launch_events(shards.size(), nullptr);
+
+  for (size_t i = 0; i < shards.size(); i++) {
+    ExecutorDevice& device = *devices_[shards[i].device_index];
+    if (!device.kernels) {
+      throw std::runtime_error("MultiDeviceExecutor: load_module() was not called");
+    }
+    KernelLaunch& kernel = device.kernels->launch(kernel_name);
+    ze_command_list_handle_t command_list = device.queues->compute_list();
+    device.events->create_event(&launch_events[i]);
+
+    if (prepare) prepare(shards[i], device, kernel);
+    // Uploads appended by prepare have to land before the kernel starts
+    append_barrier(command_list, nullptr, 0, nullptr);
+    kernel.set_group_size(group_size[0], group_size[1], group_size[2]);
+    kernel.append(command_list, &shards[i].group_count, launch_events[i], 0, nullptr);
+    if (finish) finish(shards[i], device, launch_events[i]);
+  }
+
+  // Submit everywhere before waiting anywhere so the devices run concurrently
+  for (auto& shard : shards) devices_[shard.device_index]->queues->close();
+  for (auto& shard : shards) devices_[shard.device_index]->queues->execute();
+  for (auto& shard : shards) devices_[shard.device_index]->queues->synchronize();
+
+  for (size_t i = 0; i < shards.size(); i++) {
+    ExecutorDevice& device = *devices_[shards[i].device_index];
+    shards[i].kernel_ms = kernel_duration_ms(launch_events[i], device.properties);
+    device.events->destroy_event(launch_events[i]);
+    device.queues->reset();
+  }
+  rebalance(shards);
+  return shards;
+}
+
+void MultiDeviceExecutor::rebalance(const std::vector<Shard>& shards) {
+  for (auto& shard : shards) {
+    if (shard.kernel_ms <= 0) return;
+  }
+  // Weights from the heuristic and from measurements are not comparable, the first measurement needs every device.
+  // Afterwards devices without a shard, only possible with fewer groups than devices, keep their weight.
+  if (!measured_ && shards.size() != devices_.size()) return;
+  for (auto& shard : shards) {
+    double items = static_cast<double>(shard.size[0]) * shard.size[1] * shard.size[2];
+    double throughput = items / shard.kernel_ms;  // Work-items per millisecond
+    ExecutorDevice& device = *devices_[shard.device_index];
+    device.weight = measured_ ? (1 - rebalance_rate_) * device.weight + rebalance_rate_ * throughput : throughput;
+  }
+  measured_ = true;
+}
+
+}  // namespace lzu
@@ -0,0 +1,309 @@
+// Copyright 2020 Intel Corporation
+
+#include "level_zero_host_kernels.hpp"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <map>
+#include <mutex>
+
+#include "level_zero_thread_pool.hpp"
+#ifdef LZU_SOFTWARE_DRIVER
+#include "level_zero_software_driver.hpp"
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define LZU_HOST_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+namespace lzu {
+
+namespace {
+
+enum class Isa { Scalar, Avx2, Avx512 };
+
+// Best instruction set of the CPU, lowered to LZU_HOST_ISA when that names a smaller one
+Isa detect_isa() {
+  Isa isa = Isa::Scalar;
+#ifdef LZU_HOST_KERNELS_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    isa = Isa::Avx512;
+  } else if (__builtin_cpu_supports("avx2")) {
+    isa = Isa::Avx2;
+  }
+#endif
+  const char* requested = getenv("LZU_HOST_ISA");
+  if (requested && strcmp(requested, "scalar") == 0) isa = Isa::Scalar;
+  if (requested && strcmp(requested, "avx2") == 0) isa = std::min(isa, Isa::Avx2);
+  return isa;
+}
+
+Isa active_isa() {
+  static const Isa isa = detect_isa();
+  return isa;
+}
+
+void copy_scalar(uint8_t* dst, const uint8_t* src, size_t bytes) {
+  for (size_t i = 0; i < bytes; i++) dst[i] = src[i];
+}
+
+void add_scalar(int64_t* out, const int64_t* a, const int64_t* b, size_t count) {
+  for (size_t i = 0; i < count; i++) out[i] = a[i] + b[i];
+}
+
+#ifdef LZU_HOST_KERNELS_X86
+__attribute__((target("avx2"))) void copy_avx2(uint8_t* dst, const uint8_t* src, size_t bytes) {
+  size_t i = 0;
+  for (; i + 128 <= bytes; i += 128) {
+    __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 32));
+    __m256i v2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 64));
+    __m256i v3 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 96));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), v0);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 32), v1);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 64), v2);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 96), v3);
+  }
+  for (; i + 32 <= bytes; i += 32) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i)));
+  }
+  copy_scalar(dst + i, src + i, bytes - i);
+}
+
+__attribute__((target("avx2"))) void add_avx2(int64_t* out, const int64_t* a, const int64_t* b, size_t count) {
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+    __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_add_epi64(va, vb));
+  }
+  add_scalar(out + i, a + i, b + i, count - i);
+}
+
+__attribute__((target("avx512f"))) void copy_avx512(uint8_t* dst, const uint8_t* src, size_t bytes) {
+  size_t i = 0;
+  for (; i + 256 <= bytes; i += 256) {
+    __m512i v0 = _mm512_loadu_si512(src + i);
+    __m512i v1 = _mm512_loadu_si512(src + i + 64);
+    __m512i v2 = _mm512_loadu_si512(src + i + 128);
+    __m512i v3 = _mm512_loadu_si512(src + i + 192);
+    _mm512_storeu_si512(dst + i, v0);
+    _mm512_storeu_si512(dst + i + 64, v1);
+    _mm512_storeu_si512(dst + i + 128, v2);
+    _mm512_storeu_si512(dst + i + 192, v3);
+  }
+  for (; i + 64 <= bytes; i += 64) _mm512_storeu_si512(dst + i, _mm512_loadu_si512(src + i));
+  copy_scalar(dst + i, src + i, bytes - i);
+}
+
+__attribute__((target("avx512f"))) void add_avx512(int64_t* out, const int64_t* a, const int64_t* b, size_t count) {
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    _mm512_storeu_si512(out + i, _mm512_add_epi64(_mm512_loadu_si512(a + i), _mm512_loadu_si512(b + i)));
+  }
+  add_scalar(out + i, a + i, b + i, count - i);
+}
+#endif
+
+// Copies within one buffer, or between buffers that do not overlap, as every kernel of copy_module.cl assumes
+void copy_bytes(void* dst, const void* src, size_t bytes) {
+  uint8_t* d = static_cast<uint8_t*>(dst);
+  const uint8_t* s = static_cast<const uint8_t*>(src);
+  switch (active_isa()) {
+#ifdef LZU_HOST_KERNELS_X86
+    case Isa::Avx512:
+      copy_avx512(d, s, bytes);
+      return;
+    case Isa::Avx2:
+      copy_avx2(d, s, bytes);
+      return;
+#endif
+    default:
+      copy_scalar(d, s, bytes);
+  }
+}
+
+void add_i64(int64_t* out, const int64_t* a, const int64_t* b, size_t count) {
+  switch (active_isa()) {
+#ifdef LZU_HOST_KERNELS_X86
+    case Isa::Avx512:
+      add_avx512(out, a, b, count);
+      return;
+    case Isa::Avx2:
+      add_avx2(out, a, b, count);
+      return;
+#endif
+    default:
+      add_scalar(out, a, b, count);
+  }
+}
+
+// Parts below this many bytes stay on one thread
+const uint64_t kGrainBytes = 64 * 1024;
+
+uint64_t groups_of(const HostLaunch& invocation) {
+  return static_cast<uint64_t>(invocation.group_count.groupCountX) * invocation.group_count.groupCountY *
+         invocation.group_count.groupCountZ;
+}
+
+// Grid-stride copy of bytes. Work-group g of groups takes the g-th contiguous slice, whole elements of unit bytes,
+// so a launch splits over the pool the way it is split over the device and every launch size copies everything.
+void launch_copy(uint64_t groups, void* dst, const void* src, uint64_t bytes, uint64_t unit) {
+  if (bytes == 0) return;
+  groups = std::max<uint64_t>(groups, 1);
+  const uint64_t elements = bytes / unit;
+  const uint64_t slice = (elements + groups - 1) / groups * unit;
+  const uint64_t grain = slice ? (kGrainBytes + slice - 1) / slice : 1;
+  auto part = [=](size_t first, size_t last) {
+    const uint64_t begin = std::min(bytes, first * slice);
+    const uint64_t end = last == groups ? bytes : std::min(bytes, last * slice);
+    if (end > begin) copy_bytes(static_cast<uint8_t*>(dst) + begin, static_cast<const uint8_t*>(src) + begin,
+                                end - begin);
+  };
+  ThreadPool::get().parallel_for(groups, part, grain);
+}
+
+// copy_data(int* input, int* output, int offset, int size)
+void copy_data(const HostLaunch& invocation) {
+  const int32_t offset = invocation.argument<int32_t>(2);
+  const int32_t count = invocation.argument<int32_t>(3) - offset;
+  if (count <= 0) return;
+  int32_t* output = invocation.argument<int32_t*>(1);
+  launch_copy(groups_of(invocation), output + offset, invocation.argument<const int32_t*>(0),
+              static_cast<uint64_t>(count) * 4, 4);
+}
+
+// copy_data_indirect(struct {uint* data;}* inputs, outputs, int offset, int size): one buffer per work-item of
+// dimension 0, the work-groups of dimension 1 split each buffer.
+void copy_data_indirect(const HostLaunch& invocation) {
+  uint32_t* const* inputs = invocation.argument<uint32_t* const*>(0);
+  uint32_t* const* outputs = invocation.argument<uint32_t* const*>(1);
+  const int32_t offset = invocation.argument<int32_t>(2);
+  const int32_t count = invocation.argument<int32_t>(3) - offset;
+  const uint64_t buffers = static_cast<uint64_t>(invocation.group_count.groupCountX) * invocation.group_size[0];
+  if (count <= 0 || buffers == 0) return;
+
+  const uint64_t bytes = static_cast<uint64_t>(count) * 4;
+  const uint64_t lanes = std::max<uint32_t>(invocation.group_count.groupCountY, 1);
+  const uint64_t slice = (static_cast<uint64_t>(count) + lanes - 1) / lanes * 4;
+  const uint64_t grain = (kGrainBytes + slice - 1) / slice;
+  auto part = [=](size_t first, size_t last) {
+    for (uint64_t unit = first; unit < last; unit++) {
+      const uint64_t buffer = unit / lanes;
+      const uint64_t begin = std::min(bytes, unit % lanes * slice);
+      const uint64_t end = std::min(bytes, begin + slice);
+      if (end > begin) copy_bytes(reinterpret_cast<uint8_t*>(outputs[buffer] + offset) + begin,
+                                  reinterpret_cast<const uint8_t*>(inputs[buffer]) + begin, end - begin);
+    }
+  };
+  ThreadPool::get().parallel_for(buffers * lanes, part, grain);
+}
+
+// copy_batch(struct copy_descriptor* copies): one descriptor per work-item of dimension 0
+void copy_batch(const HostLaunch& invocation) {
+  struct Descriptor {
+    uint8_t* dst;
+    const uint8_t* src;
+    uint64_t bytes;
+  };
+  const Descriptor* copies = invocation.argument<const Descriptor*>(0);
+  const uint64_t count = static_cast<uint64_t>(invocation.group_count.groupCountX) * invocation.group_size[0];
+  uint64_t total = 0;
+  for (uint64_t i = 0; i < count; i++) total += copies[i].bytes;
+  const uint64_t grain = count * kGrainBytes / std::max<uint64_t>(total, 1);
+  auto part = [=](size_t first, size_t last) {
+    for (uint64_t i = first; i < last; i++) copy_bytes(copies[i].dst, copies[i].src, copies[i].bytes);
+  };
+  ThreadPool::get().parallel_for(count, part, grain);
+}
+
+// copy_u8 .. copy_u64(src, dst, ulong count) and the byte copies (src, dst, ulong bytes)
+HostKernel typed_copy(uint64_t unit) {
+  return [unit](const HostLaunch& invocation) {
+    launch_copy(groups_of(invocation), invocation.argument<void*>(1), invocation.argument<const void*>(0),
+                invocation.argument<uint64_t>(2) * unit, unit);
+  };
+}
+
+// main_kernel of spirv_0: out[i] = a[i] + b[i] over 9 longs, indexed by the local id alone, so every work-group
+// writes the same elements and one of them is the whole result.
+void main_kernel(const HostLaunch& invocation) {
+  const int64_t* a = invocation.argument<const int64_t*>(0);
+  const int64_t* b = invocation.argument<const int64_t*>(1);
+  int64_t* out = invocation.argument<int64_t*>(2);
+  const uint64_t local_items = static_cast<uint64_t>(invocation.group_size[1]) * invocation.group_size[2];
+  if (groups_of(invocation) == 0 || local_items == 0) return;
+  // Local ids y and z address out[3 * y + z], a contiguous run when group_size covers whole rows
+  const uint32_t rows = std::min<uint32_t>(invocation.group_size[1], 3);
+  const uint32_t columns = std::min<uint32_t>(invocation.group_size[2], 3);
+  if (columns == 3) {
+    add_i64(out, a, b, rows * 3);
+  } else {
+    for (uint32_t y = 0; y < rows; y++) add_i64(out + 3 * y, a + 3 * y, b + 3 * y, columns);
+  }
+}
+
+const std::map<std::string, HostKernel>& host_kernels() {
+  static const std::map<std::string, HostKernel> kernels = {
+      {"copy_data", copy_data},
+      {"copy_data_indirect", copy_data_indirect},
+      {"copy_batch", copy_batch},
+      {"copy_u8", typed_copy(1)},
+      {"copy_u16", typed_copy(2)},
+      {"copy_u32", typed_copy(4)},
+      {"copy_u64", typed_copy(8)},
+      {"copy_unaligned", typed_copy(1)},
+      {"copy_x16", typed_copy(1)},
+      {"copy_x32", typed_copy(1)},
+      {"copy_block", typed_copy(1)},
+      // Whatever its unroll constant, copy_unrolled copies count elements
+      {"copy_unrolled", typed_copy(4)},
+      {"main_kernel", main_kernel},
+  };
+  return kernels;
+}
+
+}  // namespace
+
+HostKernel find_host_kernel(const std::string& name) {
+  auto it = host_kernels().find(name);
+  return it == host_kernels().end() ? HostKernel() : it->second;
+}
+
+const char* host_kernel_isa() {
+  switch (active_isa()) {
+    case Isa::Avx512:
+      return "avx512";
+    case Isa::Avx2:
+      return "avx2";
+    default:
+      return "scalar";
+  }
+}
+
+void register_software_kernels() {
+#ifdef LZU_SOFTWARE_DRIVER
+  static std::once_flag once;
+  std::call_once(once, [] {
+    const char* enabled = getenv("LZU_SOFTWARE_KERNELS");
+    if (enabled && atoi(enabled) == 0) return;
+    for (auto& entry : host_kernels()) {
+      HostKernel kernel = entry.second;
+      software::register_kernel(entry.first, [kernel](const software::KernelInvocation& invocation) {
+        HostLaunch launch;
+        launch.arguments = invocation.arguments;
+        launch.group_size = invocation.group_size;
+        launch.group_count = invocation.group_count;
+        kernel(launch);
+      });
+    }
+  });
+#endif
+}
+
+}  // namespace lzu
@@ -0,0 +1,111 @@
+// Copyright 2020 Intel Corporation
+
+#include "level_zero_kernel.hpp"
+
+namespace lzu {
+
+// KernelLaunch
+KernelLaunch::KernelLaunch(ze_kernel_handle_t kernel) : kernel_(kernel) {}
+
+void KernelLaunch::set_argument(uint32_t index, size_t size, const void* value) {
+  if (index >= arguments_.size()) {
+    arguments_.resize(index + 1);
+  }
+  Argument& argument = arguments_[index];
+  if (value && argument.valid && argument.value.size() == size && memcmp(argument.value.data(), value, size) == 0) {
+    stats_.argument_skips++;
+    return;
+  }
+
+  set_argument_value(kernel_, index, size, value);
+  stats_.argument_calls++;
+  if (value) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(value);
+    argument.value.assign(bytes, bytes + size);
+    argument.valid = true;
+  } else {
+    argument.valid = false;
+  }
+}
+
+void KernelLaunch::set_group_size(uint32_t x, uint32_t y, uint32_t z) {
+  if (group_size_[0] == x && group_size_[1] == y && group_size_[2] == z) {
+    stats_.group_size_skips++;
+    return;
+  }
+  lzu::set_group_size(kernel_, x, y, z);
+  stats_.group_size_calls++;
+  group_size_ = {{x, y, z}};
+}
+
+void KernelLaunch::append(ze_command_list_handle_t command_list, const ze_group_count_t* group_count,
+                          ze_event_handle_t signal_event, uint32_t num_wait_events, ze_event_handle_t* wait_events) {
+  append_launch_function(command_list, kernel_, group_count, signal_event, num_wait_events, wait_events);
+  stats_.launches++;
+}
+
+void KernelLaunch::invalidate() {
+  arguments_.clear();
+  group_size_ = {{0, 0, 0}};
+}
+
+// KernelRegistry
+KernelRegistry::KernelRegistry(ze_module_handle_t module, ze_kernel_flags_t flags) : module_(module), flags_(flags) {}
+
+KernelRegistry::~KernelRegistry() {
+  try {
+    clear();
+  } catch (std::exception& e) {
+    std::cout << "Failed to destroy kernels: " << e.what() << std::endl;
+  }
+}
+
+ze_kernel_handle_t KernelRegistry::get(const std::string& name) { return launch(name).kernel(); }
+
+KernelLaunch& KernelRegistry::launch(const std::string& name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = kernels_.find(name);
+  if (it == kernels_.end()) {
+    ze_kernel_handle_t kernel = create_function(module_, flags_, name);
+    it = kernels_.emplace(name, std::unique_ptr<KernelLaunch>(new KernelLaunch(kernel))).first;
+  }
+  return *it->second;
+}
+
+KernelLaunch* KernelRegistry::find(const std::string& name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = kernels_.find(name);
+  if (it == kernels_.end()) {
+    ze_kernel_desc_t kernel_desc = {ZE_STRUCTURE_TYPE_KERNEL_DESC, nullptr, flags_, name.c_str()};
+    ze_kernel_handle_t kernel = nullptr;
+    if (zeKernelCreate(module_, &kernel_desc, &kernel) != ZE_RESULT_SUCCESS) {
+      return nullptr;
+    }
+    it = kernels_.emplace(name, std::unique_ptr<KernelLaunch>(new KernelLaunch(kernel))).first;
+  }
+  return it->second.get();
+}
+
+void KernelRegistry::clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto& entry : kernels_) {
+    destroy_function(entry.second->kernel());
+  }
+  kernels_.clear();
+}
+
+KernelLaunchStats KernelRegistry::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  KernelLaunchStats total;
+  for (auto& entry : kernels_) {
+    const KernelLaunchStats& stats = entry.second->stats();
+    total.argument_calls += stats.argument_calls;
+    total.argument_skips += stats.argument_skips;
+    total.group_size_calls += stats.group_size_calls;
+    total.group_size_skips += stats.group_size_skips;
+    total.launches += stats.launches;
+  }
+  return total;
+}
+
+}  // namespace lzu
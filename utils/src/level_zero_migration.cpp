@@ -0,0 +1,116 @@
+// Copyright 2020 Intel Corporation
+
+#include "level_zero_migration.hpp"
+
+namespace lzu {
+
+MigrationPolicy::MigrationPolicy(ze_device_handle_t device) : device_(device) {}
+
+const uint8_t* MigrationPolicy::find(const void* ptr) const {
+  const uint8_t* address = static_cast<const uint8_t*>(ptr);
+  auto it = buffers_.upper_bound(address);
+  if (it == buffers_.begin()) return nullptr;
+  --it;
+  return address < it->first + it->second.size ? it->first : nullptr;
+}
+
+void MigrationPolicy::track(ze_command_list_handle_t command_list, const void* ptr, size_t size,
+                            const BufferAdvice& advice, const std::string& name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const uint8_t* base = static_cast<const uint8_t*>(ptr);
+  auto next = buffers_.lower_bound(base);
+  if (find(ptr) || (next != buffers_.end() && next->first < base + size)) {
+    throw std::runtime_error("MigrationPolicy: buffer overlaps a tracked one");
+  }
+
+  Buffer& buffer = buffers_[base];
+  buffer.size = size;
+  buffer.name = name;
+  buffer.advice = advice;
+  if (advice.read_mostly) {
+    append_memory_advise(command_list, device_, ptr, size, ZE_MEMORY_ADVICE_SET_READ_MOSTLY);
+    buffer.stats.advice++;
+  }
+  if (advice.prefer_device) {
+    append_memory_advise(command_list, device_, ptr, size, ZE_MEMORY_ADVICE_SET_PREFERRED_LOCATION);
+    buffer.stats.advice++;
+  }
+}
+
+void MigrationPolicy::untrack(ze_command_list_handle_t command_list, const void* ptr) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = buffers_.find(static_cast<const uint8_t*>(ptr));
+  if (it == buffers_.end()) return;
+  const Buffer& buffer = it->second;
+  if (buffer.advice.read_mostly) {
+    append_memory_advise(command_list, device_, ptr, buffer.size, ZE_MEMORY_ADVICE_CLEAR_READ_MOSTLY);
+  }
+  if (buffer.advice.prefer_device) {
+    append_memory_advise(command_list, device_, ptr, buffer.size, ZE_MEMORY_ADVICE_CLEAR_PREFERRED_LOCATION);
+  }
+  buffers_.erase(it);
+}
+
+void MigrationPolicy::prefetch(ze_command_list_handle_t command_list, const std::vector<Access>& buffers) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto& access : buffers) {
+    const uint8_t* base = find(access.ptr);
+    if (base == nullptr) continue;
+    Buffer* buffer = &buffers_[base];
+    buffer->stats.launches++;
+    if (access.access == BufferAccess::Write) {
+      // Written pages move to the device as the kernel stores to them, there is nothing to read ahead
+      buffer->on_device = true;
+      continue;
+    }
+    if (buffer->on_device) {
+      buffer->stats.resident_skips++;
+      continue;
+    }
+    append_memory_prefetch(command_list, base, buffer->size);
+    buffer->on_device = true;
+    buffer->stats.prefetches++;
+    buffer->stats.prefetched_bytes += buffer->size;
+  }
+}
+
+void MigrationPolicy::launch(ze_command_list_handle_t command_list, KernelLaunch& kernel,
+                             const ze_group_count_t& group_count, const std::vector<Access>& buffers,
+                             ze_event_handle_t signal_event, uint32_t num_wait_events, ze_event_handle_t* wait_events) {
+  prefetch(command_list, buffers);
+  kernel.append(command_list, &group_count, signal_event, num_wait_events, wait_events);
+}
+
+void MigrationPolicy::host_access(const void* ptr, BufferAccess access) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const uint8_t* base = find(ptr);
+  if (base == nullptr) return;
+  Buffer* buffer = &buffers_[base];
+  if (!buffer->on_device) return;
+  // Read-mostly pages are duplicated for host reads and stay valid on the device
+  if (access == BufferAccess::Read && buffer->advice.read_mostly) return;
+  buffer->on_device = false;
+  buffer->stats.host_migrations++;
+}
+
+MigrationStats MigrationPolicy::get_stats(const void* ptr) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const uint8_t* base = find(ptr);
+  return base ? buffers_.at(base).stats : MigrationStats();
+}
+
+void MigrationPolicy::print(std::ostream& out) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  out << "Shared memory migration (" << buffers_.size() << " buffers):" << std::endl;
+  for (auto& entry : buffers_) {
+    const Buffer& buffer = entry.second;
+    const MigrationStats& stats = buffer.stats;
+    out << "  " << (buffer.name.empty() ? "unnamed" : buffer.name) << " (" << buffer.size << " bytes"
+        << (buffer.advice.read_mostly ? ", read mostly" : "") << (buffer.advice.prefer_device ? ", prefers device" : "")
+        << "): " << stats.launches << " launches, " << stats.prefetches << " prefetches (" << stats.prefetched_bytes
+        << " bytes), " << stats.resident_skips << " already resident, " << stats.host_migrations
+        << " host migrations" << std::endl;
+  }
+}
+
+}  // namespace lzu
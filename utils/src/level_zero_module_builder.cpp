@@ -0,0 +1,144 @@
+// Copyright 2020 Intel Corporation
+
+#include "level_zero_module_builder.hpp"
+
+#include <chrono>
+
+namespace lzu {
+
+ModuleBuildError::ModuleBuildError(const std::string& name, const std::string& reason, const std::string& build_log)
+    : std::runtime_error("Failed to build module " + name + ": " + reason + (build_log.empty() ? "" : "\n") +
+                         build_log),
+      module_name_(name),
+      build_log_(build_log) {}
+
+std::string take_module_build_log(ze_module_build_log_handle_t build_log, bool failed) {
+  std::string log;
+  if (build_log == nullptr) return log;
+  try {
+    if (failed) log = get_module_build_log(build_log);
+    destroy_module_build_log(build_log);
+  } catch (std::exception&) {
+    // The build result stands without its log
+  }
+  return log;
+}
+
+ModuleBuilder::ModuleBuilder(ze_context_handle_t context, ThreadPool* pool, ModuleCache* cache)
+    : context_(context), pool_(pool), cache_(cache) {}
+
+ModuleBuilder::~ModuleBuilder() {
+  // Builds in flight reference this builder
+  for (auto& entry : entries_) entry.second.module.wait();
+  for (auto& entry : entries_) {
+    try {
+      entry.second.kernels.reset();
+      destroy_module(entry.second.module.get());
+    } catch (ModuleBuildError&) {
+      // Nothing was created
+    } catch (std::exception& e) {
+      std::cout << "Failed to destroy module " << entry.first << ": " << e.what() << std::endl;
+    }
+  }
+}
+
+ze_module_handle_t ModuleBuilder::build(const ModuleBuildRequest& request, const std::string& name) {
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  ze_module_build_log_handle_t build_log = nullptr;
+  ze_module_handle_t module = nullptr;
+  std::string error;
+  try {
+    BinaryView file;
+    const uint8_t* data = request.data;
+    size_t bytes = request.bytes;
+    if (data == nullptr) {
+      file = map_binary_file(request.path);
+      if (file.empty()) throw std::runtime_error("cannot read " + request.path);
+      data = file.data();
+      bytes = file.size();
+    }
+    const char* flags = request.build_flags.c_str();
+    module = cache_ ? cache_->create_module(context_, request.device, data, bytes, request.format, flags, &build_log)
+                    : create_module(context_, request.device, data, bytes, request.format, flags, &build_log);
+  } catch (std::exception& e) {
+    error = e.what();
+  }
+
+  const std::string log = take_module_build_log(build_log, module == nullptr);
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (module) {
+      stats_.built++;
+    } else {
+      stats_.failed++;
+    }
+    stats_.build_ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  }
+  if (module == nullptr) throw ModuleBuildError(name, error, log);
+  return module;
+}
+
+std::shared_future<ze_module_handle_t> ModuleBuilder::submit(const ModuleBuildRequest& request) {
+  const std::string name = request.name.empty() ? request.path : request.name;
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (entries_.count(name)) throw std::runtime_error("Module " + name + " was already submitted");
+  std::shared_future<ze_module_handle_t> module =
+      pool_->submit([this, request, name] { return build(request, name); }).share();
+  entries_[name].module = module;
+  stats_.submitted++;
+  return module;
+}
+
+std::vector<std::shared_future<ze_module_handle_t>> ModuleBuilder::submit(
+    const std::vector<ModuleBuildRequest>& requests) {
+  std::vector<std::shared_future<ze_module_handle_t>> modules;
+  modules.reserve(requests.size());
+  for (auto& request : requests) modules.push_back(submit(request));
+  return modules;
+}
+
+std::shared_future<ze_module_handle_t> ModuleBuilder::find(const std::string& name) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = entries_.find(name);
+  if (it == entries_.end()) throw std::runtime_error("Module " + name + " was not submitted");
+  return it->second.module;
+}
+
+ze_module_handle_t ModuleBuilder::module(const std::string& name) { return find(name).get(); }
+
+KernelRegistry& ModuleBuilder::kernels(const std::string& name) {
+  ze_module_handle_t built = module(name);
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::unique_ptr<KernelRegistry>& registry = entries_[name].kernels;
+  if (!registry) registry.reset(new KernelRegistry(built));
+  return *registry;
+}
+
+bool ModuleBuilder::ready(const std::string& name) const {
+  return find(name).wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+std::vector<ModuleBuildError> ModuleBuilder::wait_all() {
+  std::vector<std::shared_future<ze_module_handle_t>> modules;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& entry : entries_) modules.push_back(entry.second.module);
+  }
+  std::vector<ModuleBuildError> failures;
+  for (auto& module : modules) {
+    try {
+      module.get();
+    } catch (ModuleBuildError& e) {
+      failures.push_back(e);
+    }
+  }
+  return failures;
+}
+
+ModuleBuildStats ModuleBuilder::get_stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+}  // namespace lzu
@@ -0,0 +1,297 @@
+// Copyright 2020 Intel Corporation
+
+#include "level_zero_module_cache.hpp"
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "level_zero_cache_files.hpp"
+
+namespace lzu {
+
+namespace {
+
+const char kEntryMagic[8] = {'L', 'Z', 'U', 'M', 'C', '0', '0', '1'};
+const char kEntrySuffix[] = ".bin";
+// Magic, key and payload size
+const size_t kEntryHeaderSize = sizeof(kEntryMagic) + 32 + sizeof(uint64_t);
+
+// Two independently seeded 64 bit FNV-1a streams, concatenated into a 128 bit key
+class KeyHasher {
+ public:
+  void update(const void* data, size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) {
+      a_ = (a_ ^ bytes[i]) * 0x100000001b3ULL;
+      b_ = (b_ ^ bytes[i]) * 0x100000001b3ULL;
+      b_ ^= b_ >> 29;
+    }
+  }
+
+  template <typename T>
+  void update_value(const T& value) {
+    update(&value, sizeof(T));
+  }
+
+  void update_string(const std::string& value) {
+    update_value(value.size());
+    update(value.data(), value.size());
+  }
+
+  std::string hex() const {
+    char buffer[33];
+    snprintf(buffer, sizeof(buffer), "%016llx%016llx", static_cast<unsigned long long>(a_),
+             static_cast<unsigned long long>(b_));
+    return buffer;
+  }
+
+ private:
+  uint64_t a_ = 0xcbf29ce484222325ULL;
+  uint64_t b_ = 0x9e3779b97f4a7c15ULL;
+};
+
+bool ends_with(const std::string& value, const std::string& suffix) {
+  return value.size() >= suffix.size() && value.compare(value.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+}  // namespace
+
+// SpecializationConstants
+void SpecializationConstants::set(uint32_t id, const void* value, size_t size) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(value);
+  for (size_t i = 0; i < ids_.size(); i++) {
+    if (ids_[i] == id) {
+      values_[i].assign(bytes, bytes + size);
+      return;
+    }
+  }
+  ids_.push_back(id);
+  values_.emplace_back(bytes, bytes + size);
+}
+
+const ze_module_constants_t* SpecializationConstants::get() const {
+  value_pointers_.clear();
+  for (auto& value : values_) value_pointers_.push_back(value.data());
+  constants_.numConstants = static_cast<uint32_t>(ids_.size());
+  constants_.pConstantIds = ids_.data();
+  constants_.pConstantValues = value_pointers_.data();
+  return &constants_;
+}
+
+// ModuleCache
+ModuleCache::ModuleCache(const ModuleCacheOptions& options) : options_(options) {
+  if (options_.directory.empty()) {
+    options_.directory = default_cache_path("LZU_MODULE_CACHE_DIR", "modules");
+  }
+  if (options_.enabled && !make_directories(options_.directory)) {
+    std::cout << "Module cache disabled, failed to create " << options_.directory << " error " << strerror(errno)
+              << std::endl;
+    options_.enabled = false;
+  }
+  // Entries of processes that died while storing them are never renamed into place, nor evicted
+  if (options_.enabled) remove_orphaned_temporary_files(options_.directory);
+}
+
+ModuleCache& ModuleCache::get() {
+  static ModuleCache cache([] {
+    ModuleCacheOptions options;
+    const char* disable = getenv("LZU_DISABLE_MODULE_CACHE");
+    if (disable && strcmp(disable, "0") != 0) {
+      options.enabled = false;
+    }
+    return options;
+  }());
+  return cache;
+}
+
+std::string ModuleCache::make_key(ze_device_handle_t device_handle, const uint8_t* data, size_t bytes,
+                                  const char* build_flags, const SpecializationConstants* constants) {
+  const std::string device = device_key(device_handle);
+  if (device.empty()) return std::string();
+  KeyHasher hasher;
+  hasher.update_string(std::string(kEntryMagic, sizeof(kEntryMagic)));
+  hasher.update_string(device);
+  hasher.update_string(build_flags ? build_flags : "");
+  hasher.update_value(bytes);
+  hasher.update(data, bytes);
+  if (constants) {
+    hasher.update_value(constants->ids().size());
+    for (size_t i = 0; i < constants->ids().size(); i++) {
+      hasher.update_value(constants->ids()[i]);
+      hasher.update_value(constants->values()[i].size());
+      hasher.update(constants->values()[i].data(), constants->values()[i].size());
+    }
+  }
+  return hasher.hex();
+}
+
+std::string ModuleCache::entry_path(const std::string& key) const {
+  return options_.directory + "/" + key + kEntrySuffix;
+}
+
+bool ModuleCache::load(const std::string& key, BinaryView* entry) {
+  std::string path = entry_path(key);
+  if (access(path.c_str(), R_OK) != 0) return false;
+
+  *entry = map_binary_file(path);
+  uint64_t size = 0;
+  if (entry->size() >= kEntryHeaderSize) {
+    memcpy(&size, entry->data() + sizeof(kEntryMagic) + 32, sizeof(size));
+  }
+  if (entry->size() >= kEntryHeaderSize && memcmp(entry->data(), kEntryMagic, sizeof(kEntryMagic)) == 0 &&
+      key.compare(0, 32, reinterpret_cast<const char*>(entry->data()) + sizeof(kEntryMagic), 32) == 0 &&
+      size == entry->size() - kEntryHeaderSize) {
+    // Mark as recently used for eviction
+    utimes(path.c_str(), nullptr);
+    return true;
+  }
+
+  *entry = BinaryView();
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats_.errors++;
+  unlink(path.c_str());
+  return false;
+}
+
+void ModuleCache::store(const std::string& key, const std::vector<uint8_t>& binary) {
+  uint64_t size = binary.size();
+  // Readers either see the complete entry or none at all
+  const bool written = write_file_atomically(entry_path(key), [&](std::ostream& stream) {
+    stream.write(kEntryMagic, sizeof(kEntryMagic));
+    stream.write(key.data(), 32);
+    stream.write(reinterpret_cast<const char*>(&size), sizeof(size));
+    stream.write(reinterpret_cast<const char*>(binary.data()), binary.size());
+  });
+  if (!written) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.errors++;
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats_.stores++;
+  evict();
+}
+
+void ModuleCache::evict() {
+  struct Entry {
+    std::string path;
+    size_t size;
+    struct timespec used;
+  };
+  std::vector<Entry> entries;
+  size_t total = 0;
+
+  DIR* dir = opendir(options_.directory.c_str());
+  if (dir == nullptr) return;
+  while (struct dirent* entry = readdir(dir)) {
+    std::string name = entry->d_name;
+    if (!ends_with(name, kEntrySuffix)) continue;
+    std::string path = options_.directory + "/" + name;
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) continue;
+    entries.push_back({path, static_cast<size_t>(info.st_size), info.st_mtim});
+    total += info.st_size;
+  }
+  closedir(dir);
+  if (total <= options_.max_bytes) return;
+
+  std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+    if (a.used.tv_sec != b.used.tv_sec) return a.used.tv_sec < b.used.tv_sec;
+    return a.used.tv_nsec < b.used.tv_nsec;
+  });
+  for (auto& entry : entries) {
+    if (total <= options_.max_bytes) break;
+    if (unlink(entry.path.c_str()) == 0) {
+      total -= entry.size;
+      stats_.evictions++;
+    }
+  }
+}
+
+ze_module_handle_t ModuleCache::create_module(ze_context_handle_t context, ze_device_handle_t device,
+                                              const uint8_t* data, size_t bytes, const ze_module_format_t format,
+                                              const char* build_flags, ze_module_build_log_handle_t* p_build_log,
+                                              const SpecializationConstants* constants) {
+  const ze_module_constants_t* module_constants = constants ? constants->get() : nullptr;
+  if (!options_.enabled || format != ZE_MODULE_FORMAT_IL_SPIRV) {
+    return lzu::create_module(context, device, data, bytes, format, build_flags, p_build_log, module_constants);
+  }
+
+  std::string key = make_key(device, data, bytes, build_flags, constants);
+  if (key.empty()) {
+    return lzu::create_module(context, device, data, bytes, format, build_flags, p_build_log, module_constants);
+  }
+  BinaryView entry;
+  if (load(key, &entry)) {
+    // The driver may leave the log unset on failure, so only a log of the native build is destroyed below
+    if (p_build_log) *p_build_log = nullptr;
+    try {
+      ze_module_handle_t module =
+          lzu::create_module(context, device, entry.data() + kEntryHeaderSize, entry.size() - kEntryHeaderSize,
+                             ZE_MODULE_FORMAT_NATIVE, build_flags, p_build_log);
+      std::lock_guard<std::mutex> lock(mutex_);
+      stats_.hits++;
+      return module;
+    } catch (std::runtime_error&) {
+      // The driver rejected the stored binary, rebuild from IL and overwrite it. The rebuild hands out its own log.
+      if (p_build_log && *p_build_log) {
+        try {
+          destroy_module_build_log(*p_build_log);
+        } catch (std::exception& e) {
+          std::cout << "Failed to destroy module build log: " << e.what() << std::endl;
+        }
+        *p_build_log = nullptr;
+      }
+      std::lock_guard<std::mutex> lock(mutex_);
+      stats_.errors++;
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.misses++;
+  }
+  ze_module_handle_t module =
+      lzu::create_module(context, device, data, bytes, format, build_flags, p_build_log, module_constants);
+  std::vector<uint8_t> native = get_module_native_binary(module);
+  if (!native.empty()) {
+    store(key, native);
+  }
+  return module;
+}
+
+void ModuleCache::clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  DIR* dir = opendir(options_.directory.c_str());
+  if (dir == nullptr) return;
+  while (struct dirent* entry = readdir(dir)) {
+    std::string name = entry->d_name;
+    if (ends_with(name, kEntrySuffix)) {
+      unlink((options_.directory + "/" + name).c_str());
+    }
+  }
+  closedir(dir);
+}
+
+ModuleCacheStats ModuleCache::get_stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+namespace cached {
+
+ze_module_handle_t create_module(ze_context_handle_t context, ze_device_handle_t device, const uint8_t* data,
+                                 size_t bytes, const ze_module_format_t format, const char* build_flags,
+                                 ze_module_build_log_handle_t* p_build_log) {
+  return ModuleCache::get().create_module(context, device, data, bytes, format, build_flags, p_build_log);
+}
+
+}  // namespace cached
+
+}  // namespace lzu
@@ -0,0 +1,153 @@
+// Copyright 2020 Intel Corporation
+
+#include "level_zero_module_variants.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+namespace lzu {
+
+ModuleVariant::ModuleVariant(ze_module_handle_t module) : module_(module), kernels_(module) {}
+
+ModuleVariant::~ModuleVariant() {
+  try {
+    // Kernels go before their module
+    kernels_.clear();
+    destroy_module(module_);
+  } catch (std::exception& e) {
+    std::cout << "Failed to destroy module variant: " << e.what() << std::endl;
+  }
+}
+
+ModuleVariants::ModuleVariants(ze_context_handle_t context, ze_device_handle_t device, const uint8_t* binary,
+                               size_t bytes, const std::string& build_flags, size_t max_variants, ModuleCache* cache)
+    : context_(context),
+      device_(device),
+      binary_(binary),
+      bytes_(bytes),
+      build_flags_(build_flags),
+      max_variants_(std::max<size_t>(max_variants, 1)),
+      cache_(cache) {}
+
+std::string ModuleVariants::make_key(const SpecializationConstants& constants) {
+  std::vector<size_t> order(constants.ids().size());
+  for (size_t i = 0; i < order.size(); i++) order[i] = i;
+  std::sort(order.begin(), order.end(),
+            [&constants](size_t a, size_t b) { return constants.ids()[a] < constants.ids()[b]; });
+
+  std::string key;
+  for (size_t i : order) {
+    const uint32_t id = constants.ids()[i];
+    const uint64_t size = constants.values()[i].size();
+    key.append(reinterpret_cast<const char*>(&id), sizeof(id));
+    key.append(reinterpret_cast<const char*>(&size), sizeof(size));
+    key.append(reinterpret_cast<const char*>(constants.values()[i].data()), constants.values()[i].size());
+  }
+  return key;
+}
+
+std::shared_ptr<ModuleVariant> ModuleVariants::build(const SpecializationConstants& constants) {
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  // get() rewrites the pointers it returns, a private copy keeps concurrent builds apart
+  SpecializationConstants specialization = constants;
+  const SpecializationConstants* used = specialization.empty() ? nullptr : &specialization;
+  ze_module_build_log_handle_t build_log = nullptr;
+  ze_module_handle_t module = nullptr;
+  std::string error;
+  try {
+    module = cache_ ? cache_->create_module(context_, device_, binary_, bytes_, ZE_MODULE_FORMAT_IL_SPIRV,
+                                            build_flags_.c_str(), &build_log, used)
+                    : create_module(context_, device_, binary_, bytes_, ZE_MODULE_FORMAT_IL_SPIRV,
+                                    build_flags_.c_str(), &build_log, used ? used->get() : nullptr);
+  } catch (std::exception& e) {
+    error = e.what();
+  }
+
+  const std::string log = take_module_build_log(build_log, module == nullptr);
+  if (module == nullptr) {
+    throw ModuleBuildError("variant with " + std::to_string(constants.ids().size()) + " constants", error, log);
+  }
+
+  std::shared_ptr<ModuleVariant> variant = std::make_shared<ModuleVariant>(module);
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats_.builds++;
+  stats_.build_ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  return variant;
+}
+
+std::shared_ptr<ModuleVariant> ModuleVariants::get(const SpecializationConstants& constants) {
+  const std::string key = make_key(constants);
+  std::promise<std::shared_ptr<ModuleVariant>> promise;
+  Pending pending;
+  uint64_t serial = 0;
+  std::vector<Pending> released;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = variants_.find(key);
+    if (it != variants_.end()) {
+      lru_.splice(lru_.begin(), lru_, it->second.position);
+      stats_.hits++;
+      pending = it->second.variant;
+    } else {
+      pending = promise.get_future().share();
+      lru_.push_front(key);
+      serial = ++next_serial_;
+      variants_[key] = Entry{pending, lru_.begin(), serial};
+      evict(&released);
+    }
+  }
+  released.clear();
+  // Another caller builds it, or built it already
+  if (serial == 0) return pending.get();
+
+  try {
+    promise.set_value(build(constants));
+  } catch (...) {
+    promise.set_exception(std::current_exception());
+    // Forget the failure so the next request tries again
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.failures++;
+    auto it = variants_.find(key);
+    if (it != variants_.end() && it->second.serial == serial) {
+      lru_.erase(it->second.position);
+      variants_.erase(it);
+    }
+  }
+  return pending.get();
+}
+
+void ModuleVariants::evict(std::vector<Pending>* released) {
+  // Variants still building are skipped, their builders return them regardless
+  auto position = lru_.end();
+  while (variants_.size() > max_variants_ && position != lru_.begin()) {
+    --position;
+    auto it = variants_.find(*position);
+    if (it->second.variant.wait_for(std::chrono::seconds(0)) != std::future_status::ready) continue;
+    released->push_back(it->second.variant);
+    position = lru_.erase(position);
+    variants_.erase(it);
+    stats_.evictions++;
+  }
+}
+
+void ModuleVariants::clear() {
+  // Destroyed outside the lock, releasing a variant destroys its module
+  std::map<std::string, Entry> variants;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    variants.swap(variants_);
+    lru_.clear();
+  }
+}
+
+size_t ModuleVariants::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return variants_.size();
+}
+
+ModuleVariantStats ModuleVariants::get_stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+}  // namespace lzu
@@ -0,0 +1,410 @@
+// Copyright 2020 Intel Corporation
+
+#include "level_zero_offload.hpp"
+
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+
+#include "level_zero_cache_files.hpp"
+#include "level_zero_queues.hpp"
+
+namespace lzu {
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const char kProfileHeader[] = "# lzu offload profile v2";
+
+const uint32_t kCalibrationRuns = 20;
+const size_t kLargestCopy = kOffloadCopySizes.back();
+
+// Smallest part of an operation worth handing to another host thread
+const size_t kHostGrain = 256 << 10;
+
+// Weight of the newest host run time of a kernel
+const double kKernelRate = 0.25;
+
+// Kernels predicted at most this much slower on the host are run there once every kExploreInterval device launches
+const double kExploreSlowdown = 2;
+const uint32_t kExploreInterval = 32;
+
+double elapsed_ns(Clock::time_point start) {
+  return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+// Everything but device allocations, pageable memory included
+bool host_accessible(ze_context_handle_t context, const void* ptr) {
+  ze_memory_allocation_properties_t properties = {ZE_STRUCTURE_TYPE_MEMORY_ALLOCATION_PROPERTIES};
+  if (zeMemGetAllocProperties(context, ptr, &properties, nullptr) != ZE_RESULT_SUCCESS) return false;
+  return properties.type != ZE_MEMORY_TYPE_DEVICE;
+}
+
+void check(ze_result_t result, const char* function) {
+  if (result != ZE_RESULT_SUCCESS) {
+    throw std::runtime_error(std::string(function) + " failed with " + to_string(result));
+  }
+}
+
+}  // namespace
+
+const char* to_string(OffloadKind kind) {
+  switch (kind) {
+    case OffloadKind::Copy:
+      return "copy";
+    case OffloadKind::Kernel:
+      return "kernel";
+    default:
+      return "unknown";
+  }
+}
+
+const char* to_string(OffloadTarget target) { return target == OffloadTarget::Host ? "host" : "device"; }
+
+bool OffloadProfile::valid() const {
+  if (device_key.empty()) return false;
+  for (size_t i = 0; i < kOffloadCopySizes.size(); i++) {
+    if (!(device_bytes_per_ns[i] > 0) || !(host_bytes_per_ns[i] > 0)) return false;
+  }
+  return true;
+}
+
+namespace {
+
+// Piecewise linear through the times measured at kOffloadCopySizes
+double transfer_ns(const std::array<double, 4>& bytes_per_ns, uint64_t bytes) {
+  const size_t last = kOffloadCopySizes.size() - 1;
+  if (bytes <= kOffloadCopySizes[0]) return bytes / bytes_per_ns[0];
+  if (bytes >= kOffloadCopySizes[last]) return bytes / bytes_per_ns[last];
+  size_t i = 0;
+  while (bytes > kOffloadCopySizes[i + 1]) i++;
+  const double lower_ns = kOffloadCopySizes[i] / bytes_per_ns[i];
+  const double upper_ns = kOffloadCopySizes[i + 1] / bytes_per_ns[i + 1];
+  return lower_ns + (upper_ns - lower_ns) * (bytes - kOffloadCopySizes[i]) /
+                        static_cast<double>(kOffloadCopySizes[i + 1] - kOffloadCopySizes[i]);
+}
+
+}  // namespace
+
+double OffloadProfile::device_transfer_ns(uint64_t bytes) const { return transfer_ns(device_bytes_per_ns, bytes); }
+
+double OffloadProfile::host_transfer_ns(uint64_t bytes) const { return transfer_ns(host_bytes_per_ns, bytes); }
+
+std::string default_offload_profile_path() { return default_cache_path("LZU_OFFLOAD_PROFILE", "offload.profile"); }
+
+bool load_offload_profile(const std::string& path, const std::string& device_key, OffloadProfile* profile) {
+  if (device_key.empty()) return false;
+  std::ifstream stream(path);
+  std::string line;
+  // Profiles of another version may mean something else by the same fields
+  if (!std::getline(stream, line) || line != kProfileHeader) return false;
+  while (std::getline(stream, line)) {
+    if (line.empty() || line[0] == '#') continue;
+    std::istringstream fields(line);
+    OffloadProfile entry;
+    if (!(fields >> entry.device_key >> entry.launch_ns >> entry.copy_ns >> entry.event_ns >> entry.host_dispatch_ns)) {
+      continue;
+    }
+    for (double& value : entry.device_bytes_per_ns) fields >> value;
+    for (double& value : entry.host_bytes_per_ns) fields >> value;
+    if (fields && entry.device_key == device_key && entry.valid()) {
+      *profile = entry;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool save_offload_profile(const std::string& path, const OffloadProfile& profile) {
+  if (!profile.valid()) return false;
+  // Profiles of other devices stay
+  std::vector<std::string> lines;
+  {
+    std::ifstream stream(path);
+    std::string line;
+    if (std::getline(stream, line) && line == kProfileHeader) {
+      while (std::getline(stream, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        if (line.compare(0, profile.device_key.size() + 1, profile.device_key + " ") == 0) continue;
+        lines.push_back(line);
+      }
+    }
+  }
+  std::ostringstream entry;
+  entry << std::setprecision(9) << profile.device_key << " " << profile.launch_ns << " " << profile.copy_ns << " "
+        << profile.event_ns << " " << profile.host_dispatch_ns;
+  for (double value : profile.device_bytes_per_ns) entry << " " << value;
+  for (double value : profile.host_bytes_per_ns) entry << " " << value;
+  lines.push_back(entry.str());
+
+  return make_parent_directories(path) && write_file_atomically(path, [&](std::ostream& stream) {
+           stream << kProfileHeader << "\n";
+           for (auto& line : lines) stream << line << "\n";
+         });
+}
+
+OffloadProfile calibrate_offload(ze_context_handle_t context, ze_device_handle_t device, ThreadPool* pool,
+                                 KernelLaunch* kernel) {
+  OffloadProfile profile;
+  profile.device_key = device_key(device);
+
+  const uint32_t ordinal = discover_queue_groups(device).compute_ordinal;
+  ze_command_queue_handle_t queue = create_command_queue(context, device, 0, ZE_COMMAND_QUEUE_MODE_DEFAULT,
+                                                         ZE_COMMAND_QUEUE_PRIORITY_NORMAL, ordinal, 0);
+  ze_command_list_handle_t list = nullptr;
+  void* host = nullptr;
+  void* device_memory = nullptr;
+  // The pool destroys its own events
+  zeEventPool events;
+  auto release = [&]() {
+    if (device_memory) free_memory(context, device_memory);
+    if (host) free_memory(context, host);
+    if (list) destroy_command_list(list);
+    destroy_command_queue(queue);
+  };
+  try {
+    list = create_command_list(context, device, 0, ordinal);
+    events.InitEventPool(context, 1, ZE_EVENT_POOL_FLAG_HOST_VISIBLE);
+    ze_event_handle_t event = nullptr;
+    events.create_event(&event);
+    host = allocate_host_memory(kLargestCopy, 64, context);
+    // Untouched pages would all map the zero page and the copies would read from the cache
+    memset(host, 1, kLargestCopy);
+    device_memory = allocate_device_memory(kLargestCopy, 64, 0, 0, device, context);
+
+    // Median host time of append, execute and synchronize, the first run is warmup
+    auto round_trip = [&](const std::function<void(ze_event_handle_t)>& append, ze_event_handle_t signal) {
+      std::vector<double> samples;
+      for (uint32_t i = 0; i <= kCalibrationRuns; i++) {
+        reset_command_list(list);
+        Clock::time_point start = Clock::now();
+        append(signal);
+        close_command_list(list);
+        execute_command_lists(queue, 1, &list, nullptr);
+        if (signal) check(zeEventHostSynchronize(signal, UINT64_MAX), "zeEventHostSynchronize");
+        synchronize(queue, UINT64_MAX);
+        if (i) samples.push_back(elapsed_ns(start));
+        if (signal) check(zeEventHostReset(signal), "zeEventHostReset");
+      }
+      return median(samples);
+    };
+    auto small_copy = [&](ze_event_handle_t signal) {
+      append_memory_copy(list, device_memory, host, 64, signal, 0, nullptr);
+    };
+
+    profile.copy_ns = round_trip(small_copy, nullptr);
+    profile.event_ns = std::max(0.0, round_trip(small_copy, event) - profile.copy_ns);
+    // One size is not enough, bandwidth drops once a copy no longer fits in the caches
+    for (size_t i = 0; i < kOffloadCopySizes.size(); i++) {
+      const size_t size = kOffloadCopySizes[i];
+      auto copy = [&](ze_event_handle_t) { append_memory_copy(list, device_memory, host, size, nullptr, 0, nullptr); };
+      const double size_ns = round_trip(copy, nullptr);
+      profile.device_bytes_per_ns[i] = size / std::max(size_ns - profile.copy_ns, 1.0);
+    }
+    if (kernel) {
+      const ze_group_count_t one_group = {1, 1, 1};
+      profile.launch_ns =
+          round_trip([&](ze_event_handle_t) { kernel->append(list, &one_group, nullptr, 0, nullptr); }, nullptr);
+    } else {
+      profile.launch_ns = profile.copy_ns;
+    }
+
+    events.destroy_event(event);
+  } catch (...) {
+    release();
+    throw;
+  }
+  release();
+
+  std::vector<uint8_t> src(kLargestCopy, 1);
+  std::vector<uint8_t> dst(kLargestCopy, 0);
+  std::vector<double> dispatch;
+  for (uint32_t i = 0; i <= kCalibrationRuns; i++) {
+    Clock::time_point start = Clock::now();
+    pool->parallel_for(pool->size() + 1, [](size_t, size_t) {});
+    if (i) dispatch.push_back(elapsed_ns(start));
+  }
+  profile.host_dispatch_ns = median(dispatch);
+  for (size_t i = 0; i < kOffloadCopySizes.size(); i++) {
+    const size_t size = kOffloadCopySizes[i];
+    std::vector<double> copy;
+    for (uint32_t run = 0; run <= kCalibrationRuns; run++) {
+      Clock::time_point start = Clock::now();
+      pool->parallel_for(size, [&](size_t begin, size_t end) { memcpy(&dst[begin], &src[begin], end - begin); },
+                         kHostGrain);
+      if (run) copy.push_back(elapsed_ns(start));
+    }
+    profile.host_bytes_per_ns[i] = size / std::max(median(copy) - profile.host_dispatch_ns, 1.0);
+  }
+  return profile;
+}
+
+OffloadPolicy::OffloadPolicy(ze_context_handle_t context, ze_device_handle_t device, const std::string& path,
+                             ThreadPool* pool)
+    : context_(context), device_(device), pool_(pool) {
+  const std::string file = path.empty() ? default_offload_profile_path() : path;
+  if (!load_offload_profile(file, device_key(device_), &profile_)) {
+    profile_ = calibrate_offload(context_, device_, pool_);
+    // Without a writable profile file the next process calibrates again, nothing else is lost
+    save_offload_profile(file, profile_);
+  }
+}
+
+OffloadPolicy::OffloadPolicy(ze_context_handle_t context, ze_device_handle_t device, const OffloadProfile& profile,
+                             ThreadPool* pool)
+    : context_(context), device_(device), pool_(pool), profile_(profile) {}
+
+double OffloadPolicy::host_cost(OffloadKind kind, uint64_t bytes, const std::string& name) const {
+  // Operations of up to one grain run on the calling thread without waking the pool
+  const double dispatch_ns = bytes > kHostGrain ? profile_.host_dispatch_ns : 0;
+  if (kind == OffloadKind::Kernel) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = kernel_times_.find(name);
+    // Until a kernel has run on the host it is assumed to be as fast as a copy of its data
+    if (it != kernel_times_.end() && it->second.measured) return dispatch_ns + bytes * it->second.ns_per_byte;
+  }
+  return dispatch_ns + profile_.host_transfer_ns(bytes);
+}
+
+double OffloadPolicy::device_cost(OffloadKind kind, uint64_t bytes, bool with_event) const {
+  const double fixed_ns = kind == OffloadKind::Copy ? profile_.copy_ns : profile_.launch_ns;
+  return fixed_ns + profile_.device_transfer_ns(bytes) + (with_event ? profile_.event_ns : 0);
+}
+
+OffloadTarget OffloadPolicy::decide(OffloadKind kind, uint64_t bytes, bool with_event, const std::string& name) const {
+  return host_cost(kind, bytes, name) < device_cost(kind, bytes, with_event) ? OffloadTarget::Host
+                                                                             : OffloadTarget::Device;
+}
+
+void OffloadPolicy::wait_on_host(uint32_t num_wait_events, ze_event_handle_t* wait_events) {
+  for (uint32_t i = 0; i < num_wait_events; i++) {
+    check(zeEventHostSynchronize(wait_events[i], UINT64_MAX), "zeEventHostSynchronize");
+  }
+}
+
+bool OffloadPolicy::appended_to(ze_command_list_handle_t command_list, bool append) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (append) return !appended_lists_.insert(command_list).second;
+  return appended_lists_.count(command_list) != 0;
+}
+
+void OffloadPolicy::reset(ze_command_list_handle_t command_list) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  appended_lists_.erase(command_list);
+}
+
+OffloadTarget OffloadPolicy::copy(ze_command_list_handle_t command_list, void* dst, const void* src, size_t bytes,
+                                  ze_event_handle_t signal_event, uint32_t num_wait_events,
+                                  ze_event_handle_t* wait_events) {
+  const double host_ns = host_cost(OffloadKind::Copy, bytes);
+  const double device_ns = device_cost(OffloadKind::Copy, bytes, signal_event != nullptr);
+  // Running on the host would overtake the copies and launches already appended to the list
+  const bool forced =
+      appended_to(command_list, false) || !host_accessible(context_, dst) || !host_accessible(context_, src);
+  if (forced || device_ns <= host_ns) {
+    append_memory_copy(command_list, dst, src, bytes, signal_event, num_wait_events, wait_events);
+    appended_to(command_list, true);
+    record(OffloadKind::Copy, OffloadTarget::Device, bytes, forced, false, host_ns, device_ns, 0);
+    return OffloadTarget::Device;
+  }
+
+  wait_on_host(num_wait_events, wait_events);
+  Clock::time_point start = Clock::now();
+  uint8_t* d = static_cast<uint8_t*>(dst);
+  const uint8_t* s = static_cast<const uint8_t*>(src);
+  pool_->parallel_for(bytes, [d, s](size_t begin, size_t end) { memcpy(d + begin, s + begin, end - begin); },
+                      kHostGrain);
+  const double measured_ns = elapsed_ns(start);
+  if (signal_event) check(zeEventHostSignal(signal_event), "zeEventHostSignal");
+  record(OffloadKind::Copy, OffloadTarget::Host, bytes, false, false, host_ns, device_ns, measured_ns);
+  return OffloadTarget::Host;
+}
+
+OffloadTarget OffloadPolicy::launch(ze_command_list_handle_t command_list, KernelLaunch& kernel,
+                                    const std::string& name, const ze_group_count_t& group_count, size_t items,
+                                    uint64_t bytes, const HostKernel& host, ze_event_handle_t signal_event,
+                                    uint32_t num_wait_events, ze_event_handle_t* wait_events) {
+  const bool forced = !host || appended_to(command_list, false);
+  const double host_ns = forced ? 0 : host_cost(OffloadKind::Kernel, bytes, name);
+  const double device_ns = device_cost(OffloadKind::Kernel, bytes, signal_event != nullptr);
+  // The host time of a kernel is only learned by running it there, close calls are tried now and then
+  bool explore = false;
+  if (!forced && device_ns <= host_ns && host_ns <= kExploreSlowdown * device_ns) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    HostKernelTime& time = kernel_times_[name];
+    explore = !time.measured || ++time.device_launches >= kExploreInterval;
+  }
+  if (forced || (device_ns <= host_ns && !explore)) {
+    kernel.append(command_list, &group_count, signal_event, num_wait_events, wait_events);
+    appended_to(command_list, true);
+    record(OffloadKind::Kernel, OffloadTarget::Device, bytes, forced, false, host_ns, device_ns, 0);
+    return OffloadTarget::Device;
+  }
+
+  wait_on_host(num_wait_events, wait_events);
+  // Parts of about one grain of data each
+  const size_t grain = bytes > kHostGrain ? std::max<size_t>(1, items * kHostGrain / bytes) : items;
+  Clock::time_point start = Clock::now();
+  pool_->parallel_for(items, host, grain);
+  const double measured_ns = elapsed_ns(start);
+  if (signal_event) check(zeEventHostSignal(signal_event), "zeEventHostSignal");
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    HostKernelTime& time = kernel_times_[name];
+    time.device_launches = 0;
+    if (bytes) {
+      const double dispatch_ns = bytes > kHostGrain ? profile_.host_dispatch_ns : 0;
+      const double ns_per_byte = std::max(measured_ns - dispatch_ns, 0.0) / bytes;
+      if (time.measured) {
+        time.ns_per_byte += kKernelRate * (ns_per_byte - time.ns_per_byte);
+      } else {
+        time.ns_per_byte = ns_per_byte;
+        time.measured = true;
+      }
+    }
+  }
+  record(OffloadKind::Kernel, OffloadTarget::Host, bytes, false, explore, host_ns, device_ns, measured_ns);
+  return OffloadTarget::Host;
+}
+
+void OffloadPolicy::record(OffloadKind kind, OffloadTarget target, uint64_t bytes, bool forced, bool explored,
+                           double predicted_host_ns, double predicted_device_ns, double host_ns) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  OffloadCounts& counts = stats_.by_kind[static_cast<size_t>(kind)];
+  if (forced) counts.forced++;
+  if (explored) counts.explored++;
+  if (target == OffloadTarget::Host) {
+    counts.host++;
+    counts.host_bytes += bytes;
+    counts.host_ns += host_ns;
+    counts.predicted_host_ns += predicted_host_ns;
+    counts.predicted_saved_ns += predicted_device_ns - predicted_host_ns;
+  } else {
+    counts.device++;
+    counts.device_bytes += bytes;
+  }
+}
+
+OffloadStats OffloadPolicy::get_stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+void OffloadPolicy::print(std::ostream& out) const {
+  OffloadStats stats = get_stats();
+  out << "Offload decisions (device launch " << profile_.launch_ns << " ns, copy " << profile_.copy_ns
+      << " ns, host dispatch " << profile_.host_dispatch_ns << " ns):" << std::endl;
+  for (size_t i = 0; i < stats.by_kind.size(); i++) {
+    const OffloadCounts& counts = stats.by_kind[i];
+    out << "  " << to_string(static_cast<OffloadKind>(i)) << ": host " << counts.host << " (" << counts.host_bytes
+        << " bytes, predicted " << counts.predicted_host_ns << " ns, measured " << counts.host_ns << " ns, saved "
+        << counts.predicted_saved_ns << " ns, explored " << counts.explored << "), device " << counts.device << " ("
+        << counts.device_bytes << " bytes, forced " << counts.forced << ")" << std::endl;
+  }
+}
+
+}  // namespace lzu
@@ -0,0 +1,215 @@
+// Copyright 2020 Intel Corporation
+
+#include "level_zero_profiler.hpp"
+
+#include <iomanip>
+
+#include "level_zero_device_registry.hpp"
+
+namespace lzu {
+
+TimestampConverter::TimestampConverter(const ze_device_properties_t& properties) {
+  uint32_t bits = properties.kernelTimestampValidBits;
+  mask_ = (bits == 0 || bits >= 64) ? UINT64_MAX : ((uint64_t(1) << bits) - 1);
+  // Level Zero 1.0 reports nanoseconds per tick. Newer drivers returning the 1.2 properties report cycles per second
+  // instead, which is always far above any plausible tick length in nanoseconds.
+  double resolution = static_cast<double>(properties.timerResolution);
+  if (resolution <= 0) {
+    ns_per_tick_ = 1;
+  } else if (resolution > 1e6) {
+    ns_per_tick_ = 1e9 / resolution;
+  } else {
+    ns_per_tick_ = resolution;
+  }
+}
+
+int64_t TimestampConverter::offset_ticks(uint64_t reference, uint64_t ticks) const {
+  uint64_t forward = (ticks - reference) & mask_;
+  // Beyond half the counter range the timestamp is taken to be before the reference
+  if (forward > mask_ / 2) return -static_cast<int64_t>(((reference - ticks) & mask_));
+  return static_cast<int64_t>(forward);
+}
+
+const char* to_string(OpKind kind) {
+  switch (kind) {
+    case OpKind::Kernel:
+      return "kernel";
+    case OpKind::Copy:
+      return "copy";
+    case OpKind::Barrier:
+      return "barrier";
+    case OpKind::Other:
+      return "other";
+  }
+  return "unknown";
+}
+
+Profiler::Profiler(ze_device_handle_t device) : converter_(cached::get_device_properties(device)) {}
+
+void Profiler::record(ze_event_handle_t event, const std::string& name, OpKind kind, const std::string& track) {
+  ProfiledOp op;
+  op.name = name;
+  op.kind = kind;
+  op.track = track;
+  op.event = event;
+  ops_.push_back(op);
+}
+
+void Profiler::collect() {
+  std::vector<ze_kernel_timestamp_result_t> timestamps(ops_.size());
+  bool have_reference = false;
+  uint64_t reference = 0;
+  for (size_t i = 0; i < ops_.size(); i++) {
+    ops_[i].valid = ops_[i].event != nullptr &&
+                    zeEventQueryKernelTimestamp(ops_[i].event, &timestamps[i]) == ZE_RESULT_SUCCESS;
+    if (ops_[i].valid && !have_reference) {
+      reference = timestamps[i].global.kernelStart;
+      have_reference = true;
+    }
+  }
+
+  // Place every op relative to the first one, then shift so the earliest start is zero
+  double earliest = 0;
+  for (size_t i = 0; i < ops_.size(); i++) {
+    if (!ops_[i].valid) continue;
+    const ze_kernel_timestamp_data_t& global = timestamps[i].global;
+    ops_[i].start_ns = converter_.to_ns(static_cast<double>(converter_.offset_ticks(reference, global.kernelStart)));
+    ops_[i].end_ns = ops_[i].start_ns + converter_.elapsed_ns(global.kernelStart, global.kernelEnd);
+    earliest = std::min(earliest, ops_[i].start_ns);
+  }
+  for (auto& op : ops_) {
+    if (!op.valid) continue;
+    op.start_ns -= earliest;
+    op.end_ns -= earliest;
+  }
+}
+
+// Nearest rank on sorted values
+static double percentile(const std::vector<double>& sorted, double p) {
+  if (sorted.empty()) return 0;
+  size_t rank = static_cast<size_t>(p / 100 * sorted.size() + 0.999999);
+  return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+}
+
+ProfileReport Profiler::report() const {
+  ProfileReport report;
+  std::map<OpKind, std::vector<double>> durations;
+  std::vector<std::pair<double, double>> intervals;
+  for (auto& op : ops_) {
+    if (!op.valid) continue;
+    durations[op.kind].push_back(op.duration_ns());
+    intervals.emplace_back(op.start_ns, op.end_ns);
+  }
+
+  for (auto& entry : durations) {
+    std::vector<double>& values = entry.second;
+    std::sort(values.begin(), values.end());
+    KindSummary summary;
+    summary.kind = entry.first;
+    summary.count = static_cast<uint32_t>(values.size());
+    for (auto value : values) summary.total_ns += value;
+    summary.min_ns = values.front();
+    summary.p50_ns = percentile(values, 50);
+    summary.p90_ns = percentile(values, 90);
+    summary.p99_ns = percentile(values, 99);
+    summary.max_ns = values.back();
+    report.kinds.push_back(summary);
+  }
+
+  // Merge overlapping intervals, whatever is left between them is time the device had nothing running
+  if (intervals.empty()) return report;
+  std::sort(intervals.begin(), intervals.end());
+  double begin = intervals.front().first;
+  double busy_end = intervals.front().second;
+  double busy_start = begin;
+  for (size_t i = 1; i < intervals.size(); i++) {
+    if (intervals[i].first > busy_end) {
+      double gap = intervals[i].first - busy_end;
+      report.busy_ns += busy_end - busy_start;
+      report.idle_gaps++;
+      report.max_idle_gap_ns = std::max(report.max_idle_gap_ns, gap);
+      busy_start = intervals[i].first;
+    }
+    busy_end = std::max(busy_end, intervals[i].second);
+  }
+  report.busy_ns += busy_end - busy_start;
+  report.span_ns = busy_end - begin;
+  report.idle_ns = report.span_ns - report.busy_ns;
+  return report;
+}
+
+void Profiler::print(std::ostream& out) const {
+  ProfileReport r = report();
+  auto ms = [](double ns) { return ns / 1e6; };
+  std::ios::fmtflags flags = out.flags();
+  out << std::fixed << std::setprecision(4);
+  for (auto& kind : r.kinds) {
+    out << to_string(kind.kind) << ": count " << kind.count << ", total " << ms(kind.total_ns) << "ms, min "
+        << ms(kind.min_ns) << "ms, p50 " << ms(kind.p50_ns) << "ms, p90 " << ms(kind.p90_ns) << "ms, p99 "
+        << ms(kind.p99_ns) << "ms, max " << ms(kind.max_ns) << "ms" << std::endl;
+  }
+  out << "Device span " << ms(r.span_ns) << "ms, busy " << ms(r.busy_ns) << "ms, idle " << ms(r.idle_ns) << "ms in "
+      << r.idle_gaps << " gaps, largest " << ms(r.max_idle_gap_ns) << "ms" << std::endl;
+  out.flags(flags);
+}
+
+static std::string json_escape(const std::string& value) {
+  std::string escaped;
+  for (char c : value) {
+    switch (c) {
+      case '"':
+        escaped += "\\\"";
+        break;
+      case '\\':
+        escaped += "\\\\";
+        break;
+      case '\n':
+        escaped += "\\n";
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          char buffer[8];
+          snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+          escaped += buffer;
+        } else {
+          escaped += c;
+        }
+    }
+  }
+  return escaped;
+}
+
+std::string Profiler::chrome_trace() const {
+  std::map<std::string, uint32_t> tracks;
+  for (auto& op : ops_) tracks.emplace(op.track, static_cast<uint32_t>(tracks.size()));
+
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(3);
+  out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  bool first = true;
+  for (auto& track : tracks) {
+    out << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << track.second
+        << ",\"args\":{\"name\":\"" << json_escape(track.first) << "\"}}";
+    first = false;
+  }
+  // Trace times are in microseconds
+  for (auto& op : ops_) {
+    if (!op.valid) continue;
+    out << (first ? "" : ",") << "\n{\"name\":\"" << json_escape(op.name) << "\",\"cat\":\"" << to_string(op.kind)
+        << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << tracks[op.track] << ",\"ts\":" << op.start_ns / 1e3
+        << ",\"dur\":" << op.duration_ns() / 1e3 << "}";
+    first = false;
+  }
+  out << "\n]}\n";
+  return out.str();
+}
+
+void Profiler::write_chrome_trace(const std::string& path) const {
+  std::ofstream file(path, std::ios::out | std::ios::trunc);
+  if (!file) {
+    throw std::runtime_error("Profiler: can not write trace file " + path);
+  }
+  file << chrome_trace();
+}
+
+}  // namespace lzu
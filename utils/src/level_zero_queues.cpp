@@ -0,0 +1,62 @@
+// Copyright 2020 Intel Corporation
+
+#include "level_zero_queues.hpp"
+
+namespace lzu {
+
+QueueGroups discover_queue_groups(ze_device_handle_t device) {
+  QueueGroups groups;
+  uint32_t compute = find_command_queue_group(device, ZE_COMMAND_QUEUE_GROUP_PROPERTY_FLAG_COMPUTE);
+  groups.compute_ordinal = (compute == UINT32_MAX) ? 0 : compute;
+  uint32_t copy = find_command_queue_group(device, ZE_COMMAND_QUEUE_GROUP_PROPERTY_FLAG_COPY,
+                                           ZE_COMMAND_QUEUE_GROUP_PROPERTY_FLAG_COMPUTE);
+  groups.has_copy_engine = copy != UINT32_MAX;
+  groups.copy_ordinal = groups.has_copy_engine ? copy : groups.compute_ordinal;
+  return groups;
+}
+
+DeviceQueues::DeviceQueues(ze_context_handle_t context, ze_device_handle_t device, bool use_copy_engine)
+    : groups_(discover_queue_groups(device)) {
+  compute_queue_ = create_command_queue(context, device, /*flags*/ 0, ZE_COMMAND_QUEUE_MODE_DEFAULT,
+                                        ZE_COMMAND_QUEUE_PRIORITY_NORMAL, groups_.compute_ordinal, /*index*/ 0);
+  compute_list_ = create_command_list(context, device, /*flags*/ 0, groups_.compute_ordinal);
+  if (use_copy_engine && groups_.has_copy_engine) {
+    copy_queue_ = create_command_queue(context, device, /*flags*/ 0, ZE_COMMAND_QUEUE_MODE_DEFAULT,
+                                       ZE_COMMAND_QUEUE_PRIORITY_NORMAL, groups_.copy_ordinal, /*index*/ 0);
+    copy_list_ = create_command_list(context, device, /*flags*/ 0, groups_.copy_ordinal);
+  }
+}
+
+DeviceQueues::~DeviceQueues() {
+  try {
+    if (copy_list_) destroy_command_list(copy_list_);
+    if (copy_queue_) destroy_command_queue(copy_queue_);
+    destroy_command_list(compute_list_);
+    destroy_command_queue(compute_queue_);
+  } catch (std::exception& e) {
+    std::cout << "Failed to destroy device queues: " << e.what() << std::endl;
+  }
+}
+
+void DeviceQueues::close() {
+  if (copy_list_) close_command_list(copy_list_);
+  close_command_list(compute_list_);
+}
+
+void DeviceQueues::execute(ze_fence_handle_t compute_fence) {
+  // Uploads first so the copy engine can start while the compute list is being submitted
+  if (copy_list_) execute_command_lists(copy_queue_, 1, &copy_list_, nullptr);
+  execute_command_lists(compute_queue_, 1, &compute_list_, compute_fence);
+}
+
+void DeviceQueues::synchronize(uint64_t timeout) {
+  if (copy_queue_) lzu::synchronize(copy_queue_, timeout);
+  lzu::synchronize(compute_queue_, timeout);
+}
+
+void DeviceQueues::reset() {
+  if (copy_list_) reset_command_list(copy_list_);
+  reset_command_list(compute_list_);
+}
+
+}  // namespace lzu
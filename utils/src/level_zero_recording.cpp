@@ -0,0 +1,218 @@
+// Copyright 2020 Intel Corporation
+
+#include "level_zero_recording.hpp"
+
+namespace lzu {
+
+CommandRecording::CommandRecording(ze_context_handle_t context, ze_device_handle_t device, uint32_t ordinal,
+                                   size_t max_instances)
+    : context_(context), device_(device), ordinal_(ordinal), max_instances_(std::max<size_t>(1, max_instances)) {
+  event_pool_.InitEventPool(context, 32);
+}
+
+CommandRecording::~CommandRecording() {
+  try {
+    for (auto& instance : instances_) destroy(instance.get());
+  } catch (std::exception& e) {
+    std::cout << "Failed to destroy recorded command list: " << e.what() << std::endl;
+  }
+}
+
+CommandRecording::Slot CommandRecording::add_slot(size_t size) {
+  if (!instances_.empty()) {
+    throw std::runtime_error("CommandRecording: slots must be added before the first replay");
+  }
+  slot_offsets_.push_back(values_.size());
+  slot_sizes_.push_back(size);
+  values_.resize(values_.size() + size, '\0');
+  return static_cast<Slot>(slot_sizes_.size() - 1);
+}
+
+void CommandRecording::check_slot(Slot slot, size_t size) const {
+  if (slot >= slot_sizes_.size() || slot_sizes_[slot] != size) {
+    throw std::runtime_error("CommandRecording: invalid slot " + std::to_string(slot));
+  }
+}
+
+void* CommandRecording::pointer(Slot slot) const {
+  check_slot(slot, sizeof(void*));
+  void* value = nullptr;
+  memcpy(&value, &values_[slot_offsets_[slot]], sizeof(value));
+  return value;
+}
+
+void CommandRecording::set(Slot slot, const void* value, size_t size) {
+  check_slot(slot, size);
+  memcpy(&values_[slot_offsets_[slot]], value, size);
+}
+
+CommandRecording::Op CommandRecording::add_operation(Operation operation) {
+  if (!instances_.empty()) {
+    throw std::runtime_error("CommandRecording: operations must be recorded before the first replay");
+  }
+  for (auto dependency : operation.dependencies) {
+    if (dependency >= operations_.size()) {
+      throw std::runtime_error("CommandRecording: dependency on an unknown operation");
+    }
+  }
+  operations_.push_back(std::move(operation));
+  return static_cast<Op>(operations_.size() - 1);
+}
+
+CommandRecording::Op CommandRecording::record_copy(Slot dst, Slot src, size_t size,
+                                                   const std::vector<Op>& dependencies) {
+  check_slot(dst, sizeof(void*));
+  check_slot(src, sizeof(void*));
+  Operation operation;
+  operation.kind = OpKind::Copy;
+  operation.dependencies = dependencies;
+  operation.dst = dst;
+  operation.src = src;
+  operation.size = size;
+  return add_operation(std::move(operation));
+}
+
+CommandRecording::Op CommandRecording::record_launch(KernelLaunch& kernel, const std::vector<Slot>& arguments,
+                                                     const std::array<uint32_t, 3>& group_size,
+                                                     const ze_group_count_t& group_count,
+                                                     const std::vector<Op>& dependencies) {
+  for (auto slot : arguments) {
+    if (slot >= slot_sizes_.size()) {
+      throw std::runtime_error("CommandRecording: invalid slot " + std::to_string(slot));
+    }
+  }
+  Operation operation;
+  operation.kind = OpKind::Launch;
+  operation.dependencies = dependencies;
+  operation.kernel = &kernel;
+  operation.arguments = arguments;
+  operation.group_size = group_size;
+  operation.group_count = group_count;
+  return add_operation(std::move(operation));
+}
+
+CommandRecording::Op CommandRecording::record_barrier(const std::vector<Op>& dependencies) {
+  Operation operation;
+  operation.kind = OpKind::Barrier;
+  operation.dependencies = dependencies;
+  return add_operation(std::move(operation));
+}
+
+std::unique_ptr<CommandRecording::Instance> CommandRecording::instantiate() {
+  std::unique_ptr<Instance> instance(new Instance());
+  instance->key = values_;
+  instance->events.resize(operations_.size());
+  for (auto& event : instance->events) event_pool_.create_event(&event);
+  event_pool_.create_event(&instance->done);
+
+  ze_command_list_handle_t command_list = create_command_list(context_, device_, 0, ordinal_);
+  instance->command_list = command_list;
+
+  // Reset whatever the previous run of this list signaled before anything else runs
+  for (auto event : instance->events) append_event_reset(command_list, event);
+  append_event_reset(command_list, instance->done);
+  append_barrier(command_list, nullptr, 0, nullptr);
+
+  std::vector<ze_event_handle_t> waits;
+  for (size_t i = 0; i < operations_.size(); i++) {
+    const Operation& operation = operations_[i];
+    waits.clear();
+    for (auto dependency : operation.dependencies) waits.push_back(instance->events[dependency]);
+    ze_event_handle_t* wait_events = waits.empty() ? nullptr : waits.data();
+    uint32_t num_wait_events = static_cast<uint32_t>(waits.size());
+
+    switch (operation.kind) {
+      case OpKind::Copy:
+        append_memory_copy(command_list, pointer(operation.dst), pointer(operation.src), operation.size,
+                           instance->events[i], num_wait_events, wait_events);
+        break;
+      case OpKind::Launch:
+        for (uint32_t argument = 0; argument < operation.arguments.size(); argument++) {
+          Slot slot = operation.arguments[argument];
+          operation.kernel->set_argument(argument, slot_sizes_[slot], &values_[slot_offsets_[slot]]);
+        }
+        operation.kernel->set_group_size(operation.group_size[0], operation.group_size[1], operation.group_size[2]);
+        operation.kernel->append(command_list, &operation.group_count, instance->events[i], num_wait_events,
+                                 wait_events);
+        break;
+      case OpKind::Barrier:
+        append_barrier(command_list, instance->events[i], num_wait_events, wait_events);
+        break;
+    }
+  }
+  append_barrier(command_list, instance->done, 0, nullptr);
+  close_command_list(command_list);
+  stats_.instantiations++;
+  return instance;
+}
+
+void CommandRecording::wait(Instance* instance) {
+  if (!instance->executing) return;
+  if (instance->fenced) {
+    if (zeFenceQueryStatus(instance->fence) == ZE_RESULT_NOT_READY) stats_.waits++;
+    synchronize(instance->fence, UINT64_MAX);
+  } else {
+    if (zeEventQueryStatus(instance->done) == ZE_RESULT_NOT_READY) stats_.waits++;
+    ze_result_t result = zeEventHostSynchronize(instance->done, UINT64_MAX);
+    if (result != ZE_RESULT_SUCCESS) {
+      throw std::runtime_error("zeEventHostSynchronize failed with " + to_string(result));
+    }
+  }
+  instance->executing = false;
+}
+
+void CommandRecording::destroy(Instance* instance) {
+  // The list may still be executing from an earlier replay
+  wait(instance);
+  if (instance->fence) destroy_fence(instance->fence);
+  destroy_command_list(instance->command_list);
+  for (auto event : instance->events) event_pool_.destroy_event(event);
+  event_pool_.destroy_event(instance->done);
+}
+
+void CommandRecording::replay(ze_command_queue_handle_t command_queue, ze_fence_handle_t fence) {
+  auto it = instances_.begin();
+  while (it != instances_.end() && (*it)->key != values_) ++it;
+
+  if (it == instances_.end()) {
+    if (instances_.size() >= max_instances_) {
+      destroy(instances_.back().get());
+      instances_.pop_back();
+      stats_.evictions++;
+    }
+    instances_.push_front(instantiate());
+  } else if (it != instances_.begin()) {
+    instances_.splice(instances_.begin(), instances_, it);
+  }
+
+  Instance* instance = instances_.front().get();
+  // Executing a list again while its previous run still executes is undefined
+  wait(instance);
+  if (!fence) {
+    if (instance->fence && instance->last_queue != command_queue) {
+      destroy_fence(instance->fence);
+      instance->fence = nullptr;
+    }
+    if (instance->fence) {
+      reset_fence(instance->fence);
+    } else {
+      instance->fence = create_fence(command_queue);
+    }
+  }
+  execute_command_lists(command_queue, 1, &instance->command_list, fence ? fence : instance->fence);
+  instance->last_queue = command_queue;
+  instance->fenced = !fence;
+  instance->executing = true;
+  stats_.replays++;
+}
+
+ze_event_handle_t CommandRecording::completion_event() const {
+  return instances_.empty() ? nullptr : instances_.front()->done;
+}
+
+ze_event_handle_t CommandRecording::event(Op op) const {
+  if (instances_.empty() || op >= operations_.size()) return nullptr;
+  return instances_.front()->events[op];
+}
+
+}  // namespace lzu
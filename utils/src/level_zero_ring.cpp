@@ -0,0 +1,104 @@
+// Copyright 2020 Intel Corporation
+
+#include "level_zero_ring.hpp"
+
+#include <chrono>
+
+namespace lzu {
+
+SubmissionRing::SubmissionRing(ze_context_handle_t context, ze_device_handle_t device, uint32_t ordinal,
+                               uint32_t depth)
+    : slots_(std::max(depth, 1u)) {
+  queue_ = create_command_queue(context, device, 0, ZE_COMMAND_QUEUE_MODE_ASYNCHRONOUS,
+                                ZE_COMMAND_QUEUE_PRIORITY_NORMAL, ordinal, 0);
+  for (auto& slot : slots_) {
+    slot.list = create_command_list(context, device, 0, ordinal);
+    slot.fence = create_fence(queue_);
+  }
+}
+
+SubmissionRing::~SubmissionRing() {
+  try {
+    wait_all();
+    for (auto& slot : slots_) {
+      destroy_fence(slot.fence);
+      destroy_command_list(slot.list);
+    }
+    destroy_command_queue(queue_);
+  } catch (std::exception& e) {
+    std::cout << "Failed to destroy submission ring: " << e.what() << std::endl;
+  }
+}
+
+void SubmissionRing::retire(Slot* slot, bool count_stall) {
+  if (slot->sequence == 0) return;
+  ze_result_t result = zeFenceQueryStatus(slot->fence);
+  if (result == ZE_RESULT_NOT_READY) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    result = zeFenceHostSynchronize(slot->fence, UINT64_MAX);
+    if (count_stall) {
+      stats_.stalls++;
+      stats_.stall_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+  }
+  if (result != ZE_RESULT_SUCCESS) {
+    throw std::runtime_error("SubmissionRing: fence wait failed with " + to_string(result));
+  }
+  reset_fence(slot->fence);
+  reset_command_list(slot->list);
+  slot->sequence = 0;
+}
+
+ze_command_list_handle_t SubmissionRing::acquire() {
+  Slot& slot = slots_[next_sequence_ % slots_.size()];
+  if (!acquired_) {
+    retire(&slot, true);
+    acquired_ = true;
+  }
+  return slot.list;
+}
+
+uint64_t SubmissionRing::submit() {
+  acquire();
+  Slot& slot = slots_[next_sequence_ % slots_.size()];
+  close_command_list(slot.list);
+  execute_command_lists(queue_, 1, &slot.list, slot.fence);
+  slot.sequence = next_sequence_++;
+  acquired_ = false;
+
+  // Lists still executing, the new one included
+  uint32_t occupancy = 0;
+  for (auto& other : slots_) {
+    if (other.sequence != 0 && zeFenceQueryStatus(other.fence) == ZE_RESULT_NOT_READY) occupancy++;
+  }
+  stats_.submissions++;
+  stats_.occupancy_sum += occupancy;
+  stats_.max_occupancy = std::max(stats_.max_occupancy, occupancy);
+  return slot.sequence;
+}
+
+bool SubmissionRing::is_complete(uint64_t sequence) {
+  if (sequence == 0 || sequence >= next_sequence_) return false;
+  const Slot& slot = slots_[sequence % slots_.size()];
+  // The slot moved on, retire() saw this sequence's fence signal first
+  if (slot.sequence != sequence) return true;
+  return zeFenceQueryStatus(slot.fence) == ZE_RESULT_SUCCESS;
+}
+
+void SubmissionRing::wait(uint64_t sequence) {
+  if (sequence == 0 || sequence >= next_sequence_) return;
+  const Slot& slot = slots_[sequence % slots_.size()];
+  if (slot.sequence != sequence) return;
+  ze_result_t result = zeFenceHostSynchronize(slot.fence, UINT64_MAX);
+  if (result != ZE_RESULT_SUCCESS) {
+    throw std::runtime_error("SubmissionRing: fence wait failed with " + to_string(result));
+  }
+}
+
+void SubmissionRing::wait_all() {
+  for (auto& slot : slots_) {
+    if (slot.sequence != 0) wait(slot.sequence);
+  }
+}
+
+}  // namespace lzu
@@ -0,0 +1,221 @@
+// Copyright 2020 Intel Corporation
+
+#include "level_zero_stream.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <memory>
+
+#include "level_zero_allocator.hpp"
+
+namespace lzu {
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double elapsed_ms(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+void host_reset(ze_event_handle_t event) {
+  ze_result_t result = zeEventHostReset(event);
+  if (result != ZE_RESULT_SUCCESS) {
+    throw std::runtime_error("zeEventHostReset failed with " + to_string(result));
+  }
+}
+
+}  // namespace
+
+StreamingPipeline::StreamingPipeline(ze_context_handle_t context, ze_device_handle_t device,
+                                     const StreamOptions& options)
+    : context_(context), device_(device), options_(options) {
+  if (options_.chunk_bytes == 0) throw std::runtime_error("StreamingPipeline: chunk_bytes must not be 0");
+  if (options_.output_chunk_bytes == 0) options_.output_chunk_bytes = options_.chunk_bytes;
+  // One staging set cannot overlap anything, and the readback of chunk i is only submitted after chunk i+1
+  options_.buffers = std::max(options_.buffers, 2u);
+
+  QueueGroups groups = discover_queue_groups(device_);
+  compute_queue_ = create_command_queue(context_, device_, 0, ZE_COMMAND_QUEUE_MODE_ASYNCHRONOUS,
+                                        ZE_COMMAND_QUEUE_PRIORITY_NORMAL, groups.compute_ordinal, 0);
+  copy_queue_ = compute_queue_;
+  uint32_t copy_ordinal = groups.compute_ordinal;
+  if (options_.use_copy_engine && groups.has_copy_engine) {
+    copy_queue_ = create_command_queue(context_, device_, 0, ZE_COMMAND_QUEUE_MODE_ASYNCHRONOUS,
+                                       ZE_COMMAND_QUEUE_PRIORITY_NORMAL, groups.copy_ordinal, 0);
+    copy_ordinal = groups.copy_ordinal;
+  }
+
+  events_.InitEventPool(context_, 3 * options_.buffers, ZE_EVENT_POOL_FLAG_HOST_VISIBLE);
+  staging_.resize(options_.buffers);
+  for (auto& staging : staging_) {
+    staging.host_in = cached::allocate_host_memory(options_.chunk_bytes, 64, context_);
+    staging.device_in = cached::allocate_device_memory(options_.chunk_bytes, 64, 0, 0, device_, context_);
+    staging.device_out = cached::allocate_device_memory(options_.output_chunk_bytes, 64, 0, 0, device_, context_);
+    staging.host_out = cached::allocate_host_memory(options_.output_chunk_bytes, 64, context_);
+    staging.upload = create_command_list(context_, device_, 0, copy_ordinal);
+    staging.compute = create_command_list(context_, device_, 0, groups.compute_ordinal);
+    staging.readback = create_command_list(context_, device_, 0, copy_ordinal);
+    // uploaded and computed are waited on by the other engine, read by the host
+    events_.create_event(&staging.uploaded, ZE_EVENT_SCOPE_FLAG_DEVICE, ZE_EVENT_SCOPE_FLAG_DEVICE);
+    events_.create_event(&staging.computed, ZE_EVENT_SCOPE_FLAG_DEVICE, ZE_EVENT_SCOPE_FLAG_DEVICE);
+    events_.create_event(&staging.read, ZE_EVENT_SCOPE_FLAG_HOST, ZE_EVENT_SCOPE_FLAG_HOST);
+  }
+}
+
+StreamingPipeline::~StreamingPipeline() {
+  try {
+    synchronize(compute_queue_, UINT64_MAX);
+    if (copy_queue_ != compute_queue_) synchronize(copy_queue_, UINT64_MAX);
+    for (auto& staging : staging_) {
+      events_.destroy_event(staging.uploaded);
+      events_.destroy_event(staging.computed);
+      events_.destroy_event(staging.read);
+      destroy_command_list(staging.upload);
+      destroy_command_list(staging.compute);
+      destroy_command_list(staging.readback);
+      cached::free_memory(context_, staging.host_in);
+      cached::free_memory(context_, staging.device_in);
+      cached::free_memory(context_, staging.device_out);
+      cached::free_memory(context_, staging.host_out);
+    }
+    if (copy_queue_ != compute_queue_) destroy_command_queue(copy_queue_);
+    destroy_command_queue(compute_queue_);
+  } catch (std::exception& e) {
+    std::cout << "Failed to destroy streaming pipeline: " << e.what() << std::endl;
+  }
+}
+
+StreamStats StreamingPipeline::run(const StreamSource& source, const ChunkKernel& kernel, const StreamSink& sink) {
+  StreamStats stats;
+  Clock::time_point start = Clock::now();
+  const uint32_t buffers = options_.buffers;
+  uint64_t chunk = 0;
+  Staging* previous = nullptr;  // Kernel submitted, readback not yet
+
+  try {
+    for (;; chunk++) {
+      Staging& staging = staging_[chunk % buffers];
+      if (staging.busy) drain(&staging, sink, &stats);
+
+      Clock::time_point source_start = Clock::now();
+      size_t bytes = source(staging.host_in, options_.chunk_bytes);
+      stats.source_ms += elapsed_ms(source_start);
+      if (bytes == 0) break;
+      if (bytes > options_.chunk_bytes) throw std::runtime_error("StreamingPipeline: source overran the chunk");
+
+      append_memory_copy(staging.upload, staging.device_in, staging.host_in, bytes, staging.uploaded, 0, nullptr);
+      close_command_list(staging.upload);
+      execute_command_lists(copy_queue_, 1, &staging.upload, nullptr);
+
+      append_wait_on_events(staging.compute, 1, &staging.uploaded);
+      staging.output_bytes = kernel(staging.compute, staging.device_in, staging.device_out, bytes);
+      if (staging.output_bytes > options_.output_chunk_bytes) {
+        throw std::runtime_error("StreamingPipeline: kernel output exceeds output_chunk_bytes");
+      }
+      append_barrier(staging.compute, staging.computed, 0, nullptr);
+      close_command_list(staging.compute);
+      execute_command_lists(compute_queue_, 1, &staging.compute, nullptr);
+      staging.busy = true;
+
+      // Queued behind this upload on the copy engine, so the next upload does not wait for the previous kernel
+      if (previous) submit_readback(previous);
+      previous = &staging;
+      stats.chunks++;
+      stats.bytes_in += bytes;
+    }
+    if (previous) submit_readback(previous);
+    for (uint32_t i = 0; i < buffers; i++) {
+      Staging& staging = staging_[(chunk + i) % buffers];
+      if (staging.busy) drain(&staging, sink, &stats);
+    }
+  } catch (...) {
+    // Nothing may still be reading or writing the staging buffers when the caller unwinds
+    zeCommandQueueSynchronize(compute_queue_, UINT64_MAX);
+    if (copy_queue_ != compute_queue_) zeCommandQueueSynchronize(copy_queue_, UINT64_MAX);
+    for (auto& staging : staging_) {
+      zeCommandListReset(staging.upload);
+      zeCommandListReset(staging.compute);
+      zeCommandListReset(staging.readback);
+      zeEventHostReset(staging.uploaded);
+      zeEventHostReset(staging.computed);
+      zeEventHostReset(staging.read);
+      staging.busy = false;
+    }
+    throw;
+  }
+  stats.total_ms = elapsed_ms(start);
+  return stats;
+}
+
+void StreamingPipeline::submit_readback(Staging* staging) {
+  if (staging->output_bytes) {
+    append_memory_copy(staging->readback, staging->host_out, staging->device_out, staging->output_bytes, staging->read,
+                       1, &staging->computed);
+  } else {
+    append_barrier(staging->readback, staging->read, 1, &staging->computed);
+  }
+  close_command_list(staging->readback);
+  execute_command_lists(copy_queue_, 1, &staging->readback, nullptr);
+}
+
+void StreamingPipeline::drain(Staging* staging, const StreamSink& sink, StreamStats* stats) {
+  ze_result_t result = zeEventQueryStatus(staging->read);
+  if (result == ZE_RESULT_NOT_READY) {
+    Clock::time_point stall_start = Clock::now();
+    result = zeEventHostSynchronize(staging->read, UINT64_MAX);
+    stats->stall_ms += elapsed_ms(stall_start);
+  }
+  if (result != ZE_RESULT_SUCCESS) {
+    throw std::runtime_error("StreamingPipeline: readback failed with " + to_string(result));
+  }
+
+  Clock::time_point sink_start = Clock::now();
+  if (sink) sink(staging->host_out, staging->output_bytes);
+  stats->sink_ms += elapsed_ms(sink_start);
+  stats->bytes_out += staging->output_bytes;
+
+  // The readback waited for the kernel, which waited for the upload, so the whole set is idle
+  reset_command_list(staging->upload);
+  reset_command_list(staging->compute);
+  reset_command_list(staging->readback);
+  host_reset(staging->uploaded);
+  host_reset(staging->computed);
+  host_reset(staging->read);
+  staging->busy = false;
+}
+
+StreamSource istream_source(std::istream* in) {
+  return [in](void* data, size_t capacity) -> size_t {
+    in->read(static_cast<char*>(data), static_cast<std::streamsize>(capacity));
+    if (in->bad()) throw std::runtime_error("istream_source: read failed");
+    return static_cast<size_t>(in->gcount());
+  };
+}
+
+StreamSink ostream_sink(std::ostream* out) {
+  return [out](const void* data, size_t bytes) {
+    out->write(static_cast<const char*>(data), static_cast<std::streamsize>(bytes));
+    if (!*out) throw std::runtime_error("ostream_sink: write failed");
+  };
+}
+
+StreamSource memory_source(const void* data, size_t bytes) {
+  std::shared_ptr<size_t> offset = std::make_shared<size_t>(0);
+  const uint8_t* begin = static_cast<const uint8_t*>(data);
+  return [begin, bytes, offset](void* chunk, size_t capacity) -> size_t {
+    size_t count = std::min(capacity, bytes - *offset);
+    if (count) memcpy(chunk, begin + *offset, count);
+    *offset += count;
+    return count;
+  };
+}
+
+StreamSink memory_sink(std::vector<uint8_t>* out) {
+  return [out](const void* data, size_t bytes) {
+    const uint8_t* begin = static_cast<const uint8_t*>(data);
+    out->insert(out->end(), begin, begin + bytes);
+  };
+}
+
+}  // namespace lzu
@@ -0,0 +1,238 @@
+// Copyright 2020 Intel Corporation
+
+#include "level_zero_submission.hpp"
+
+#include <atomic>
+#include <deque>
+#include <unordered_map>
+
+namespace lzu {
+
+namespace {
+
+// How long the submitter thread waits on a fence before it looks for new submissions again
+const uint64_t kFencePollNs = 50000;
+
+uint32_t thread_slot() {
+  static std::atomic<uint32_t> next(0);
+  thread_local uint32_t slot = next++;
+  return slot;
+}
+
+// Open command list of the calling thread, per submitter
+std::unordered_map<uint64_t, ze_command_list_handle_t>& thread_lists() {
+  thread_local std::unordered_map<uint64_t, ze_command_list_handle_t> lists;
+  return lists;
+}
+
+std::atomic<uint64_t> next_submitter_id(1);
+
+}  // namespace
+
+// ShardedEventPool
+ShardedEventPool::ShardedEventPool(ze_context_handle_t context, uint32_t shards, uint32_t count_per_shard,
+                                   ze_event_pool_flags_t flags) {
+  if (shards == 0) shards = std::max(1u, std::thread::hardware_concurrency());
+  for (uint32_t i = 0; i < shards; i++) {
+    shards_.emplace_back(new Shard());
+    shards_.back()->pool.InitEventPool(context, std::max(count_per_shard, 1u), flags);
+  }
+}
+
+ShardedEventPool::Event ShardedEventPool::create_event(ze_event_scope_flags_t signal, ze_event_scope_flags_t wait) {
+  Event event;
+  event.shard = thread_slot() % shard_count();
+  Shard& shard = *shards_[event.shard];
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  shard.pool.create_event(&event.handle, signal, wait);
+  return event;
+}
+
+void ShardedEventPool::destroy_event(const Event& event) {
+  Shard& shard = *shards_.at(event.shard);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  shard.pool.destroy_event(event.handle);
+}
+
+uint32_t ShardedEventPool::in_use() const {
+  uint32_t total = 0;
+  for (auto& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    total += shard->pool.in_use();
+  }
+  return total;
+}
+
+// ConcurrentSubmitter
+ConcurrentSubmitter::ConcurrentSubmitter(ze_context_handle_t context, ze_device_handle_t device, uint32_t ordinal,
+                                         uint32_t max_batch, uint32_t max_in_flight)
+    : context_(context),
+      device_(device),
+      ordinal_(ordinal),
+      max_batch_(std::max(max_batch, 1u)),
+      max_in_flight_(std::max(max_in_flight, 1u)),
+      id_(next_submitter_id++) {
+  queue_ = create_command_queue(context_, device_, 0, ZE_COMMAND_QUEUE_MODE_ASYNCHRONOUS,
+                                ZE_COMMAND_QUEUE_PRIORITY_NORMAL, ordinal_, 0);
+  thread_ = std::thread(&ConcurrentSubmitter::run, this);
+}
+
+ConcurrentSubmitter::~ConcurrentSubmitter() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  work_cv_.notify_one();
+  thread_.join();
+  try {
+    for (auto list : all_lists_) destroy_command_list(list);
+    for (auto fence : all_fences_) destroy_fence(fence);
+    destroy_command_queue(queue_);
+  } catch (std::exception& e) {
+    std::cout << "Failed to destroy submitter: " << e.what() << std::endl;
+  }
+}
+
+ze_command_list_handle_t ConcurrentSubmitter::command_list() {
+  auto& lists = thread_lists();
+  auto it = lists.find(id_);
+  if (it != lists.end()) return it->second;
+
+  ze_command_list_handle_t list = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!free_lists_.empty()) {
+      list = free_lists_.back();
+      free_lists_.pop_back();
+    }
+  }
+  if (list == nullptr) {
+    list = create_command_list(context_, device_, 0, ordinal_);
+    std::lock_guard<std::mutex> lock(mutex_);
+    all_lists_.push_back(list);
+    stats_.lists_created++;
+  }
+  lists[id_] = list;
+  return list;
+}
+
+uint64_t ConcurrentSubmitter::submit() {
+  ze_command_list_handle_t list = command_list();
+  thread_lists().erase(id_);
+  close_command_list(list);
+
+  uint64_t ticket;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (failed_) {
+      free_lists_.push_back(list);
+      throw std::runtime_error("Submitter failed: " + error_);
+    }
+    pending_.push_back(list);
+    ticket = ++submitted_;
+    stats_.submissions++;
+  }
+  work_cv_.notify_one();
+  return ticket;
+}
+
+void ConcurrentSubmitter::wait(uint64_t ticket) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_cv_.wait(lock, [this, ticket] { return failed_ || completed_ >= ticket; });
+  if (failed_) {
+    throw std::runtime_error("Submitter failed: " + error_);
+  }
+}
+
+void ConcurrentSubmitter::flush() {
+  uint64_t ticket;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ticket = submitted_;
+  }
+  wait(ticket);
+}
+
+SubmitterStats ConcurrentSubmitter::get_stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+ze_fence_handle_t ConcurrentSubmitter::take_fence() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!free_fences_.empty()) {
+      ze_fence_handle_t fence = free_fences_.back();
+      free_fences_.pop_back();
+      return fence;
+    }
+  }
+  ze_fence_handle_t fence = create_fence(queue_);
+  std::lock_guard<std::mutex> lock(mutex_);
+  all_fences_.push_back(fence);
+  return fence;
+}
+
+void ConcurrentSubmitter::complete(Batch* batch) {
+  for (auto list : batch->lists) reset_command_list(list);
+  reset_fence(batch->fence);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_lists_.insert(free_lists_.end(), batch->lists.begin(), batch->lists.end());
+    free_fences_.push_back(batch->fence);
+    completed_ = batch->last_ticket;
+  }
+  done_cv_.notify_all();
+}
+
+void ConcurrentSubmitter::run() {
+  std::deque<Batch> in_flight;
+  try {
+    for (;;) {
+      Batch batch;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (in_flight.empty()) {
+          work_cv_.wait(lock, [this] { return stop_ || !pending_.empty(); });
+          if (pending_.empty()) return;
+        }
+        if (!pending_.empty() && in_flight.size() < max_in_flight_) {
+          // Everything queued so far goes into one execute call
+          size_t count = std::min<size_t>(pending_.size(), max_batch_);
+          batch.lists.assign(pending_.begin(), pending_.begin() + count);
+          pending_.erase(pending_.begin(), pending_.begin() + count);
+          taken_ += count;
+          batch.last_ticket = taken_;
+          stats_.batches++;
+          stats_.largest_batch = std::max(stats_.largest_batch, static_cast<uint32_t>(count));
+        }
+      }
+
+      if (!batch.lists.empty()) {
+        batch.fence = take_fence();
+        execute_command_lists(queue_, static_cast<uint32_t>(batch.lists.size()), batch.lists.data(), batch.fence);
+        in_flight.push_back(std::move(batch));
+        continue;
+      }
+
+      // Nothing to dispatch, retire the oldest batch or come back for new submissions after a short wait
+      ze_result_t result = zeFenceHostSynchronize(in_flight.front().fence, kFencePollNs);
+      if (result == ZE_RESULT_NOT_READY) continue;
+      if (result != ZE_RESULT_SUCCESS) {
+        throw std::runtime_error("zeFenceHostSynchronize failed with " + to_string(result));
+      }
+      complete(&in_flight.front());
+      in_flight.pop_front();
+    }
+  } catch (std::exception& e) {
+    // Let the device finish what it has, then fail every waiter
+    zeCommandQueueSynchronize(queue_, UINT64_MAX);
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& batch : in_flight) free_lists_.insert(free_lists_.end(), batch.lists.begin(), batch.lists.end());
+    error_ = e.what();
+    failed_ = true;
+  }
+  done_cv_.notify_all();
+}
+
+}  // namespace lzu
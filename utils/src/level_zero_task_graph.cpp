@@ -0,0 +1,241 @@
+// Copyright 2020 Intel Corporation
+
+#include "level_zero_task_graph.hpp"
+
+#include <algorithm>
+#include <set>
+
+namespace lzu {
+
+TaskGraph::TaskGraph(zeEventPool* event_pool) : event_pool_(event_pool) {}
+
+TaskGraph::~TaskGraph() {
+  for (auto& node : nodes_) {
+    if (node.event == nullptr) continue;
+    try {
+      event_pool_->destroy_event(node.event);
+    } catch (std::exception& e) {
+      std::cout << "Failed to release task graph event: " << e.what() << std::endl;
+    }
+  }
+}
+
+TaskGraph::Node TaskGraph::add_node(NodeInfo info) {
+  if (scheduled_) {
+    throw std::runtime_error("TaskGraph: nodes can not be added after schedule()");
+  }
+  nodes_.push_back(std::move(info));
+  return static_cast<Node>(nodes_.size() - 1);
+}
+
+TaskGraph::Node TaskGraph::add_copy(void* dst, const void* src, size_t size, Engine engine) {
+  NodeInfo info;
+  info.kind = Kind::Copy;
+  info.engine = engine;
+  info.dst = dst;
+  info.src = src;
+  info.size = size;
+  info.reads.push_back(span(Range(src, size)));
+  info.writes.push_back(span(Range(dst, size)));
+  return add_node(std::move(info));
+}
+
+TaskGraph::Node TaskGraph::add_launch(KernelLaunch& kernel, const std::array<uint32_t, 3>& group_size,
+                                      const ze_group_count_t& group_count, const std::vector<Argument>& arguments,
+                                      const std::vector<Range>& reads, const std::vector<Range>& writes) {
+  NodeInfo info;
+  info.kind = Kind::Launch;
+  info.kernel = &kernel;
+  info.group_size = group_size;
+  info.group_count = group_count;
+  info.arguments = arguments;
+  for (auto& range : reads) info.reads.push_back(span(range));
+  for (auto& range : writes) info.writes.push_back(span(range));
+  return add_node(std::move(info));
+}
+
+TaskGraph::Node TaskGraph::add_barrier() {
+  NodeInfo info;
+  info.kind = Kind::Barrier;
+  return add_node(std::move(info));
+}
+
+TaskGraph::Span TaskGraph::span(const Range& range) const {
+  uintptr_t begin = reinterpret_cast<uintptr_t>(range.ptr);
+  if (range.size > 0) return Span{begin, begin + range.size};
+  void* base = nullptr;
+  size_t size = 0;
+  ze_context_handle_t context = event_pool_->context_;
+  if (context && zeMemGetAddressRange(context, range.ptr, &base, &size) == ZE_RESULT_SUCCESS && base && size > 0) {
+    begin = reinterpret_cast<uintptr_t>(base);
+    return Span{begin, begin + size};
+  }
+  return Span{begin, begin + 1};
+}
+
+void TaskGraph::require_event(Node node) {
+  if (scheduled_) {
+    throw std::runtime_error("TaskGraph: events must be required before schedule()");
+  }
+  nodes_.at(node).needs_event = true;
+  nodes_.at(node).scope |= ZE_EVENT_SCOPE_FLAG_HOST;
+}
+
+void TaskGraph::infer_dependencies() {
+  const Node kNone = UINT32_MAX;
+  struct Access {
+    Span span;
+    Node node;
+  };
+  auto overlaps = [](const Span& a, const Span& b) { return a.begin < b.end && b.begin < a.end; };
+  // Accesses since the last barrier that no later write has covered yet
+  std::vector<Access> writers;
+  std::vector<Access> readers;
+  Node last_barrier = kNone;
+  std::vector<Node> since_barrier;
+
+  for (Node n = 0; n < nodes_.size(); n++) {
+    NodeInfo& node = nodes_[n];
+    std::set<Node> dependencies;
+    if (last_barrier != kNone) dependencies.insert(last_barrier);
+
+    if (node.kind == Kind::Barrier) {
+      dependencies.insert(since_barrier.begin(), since_barrier.end());
+      writers.clear();
+      readers.clear();
+      since_barrier.clear();
+      last_barrier = n;
+    } else {
+      // Read after write
+      for (auto& read : node.reads) {
+        for (auto& writer : writers) {
+          if (overlaps(read, writer.span)) dependencies.insert(writer.node);
+        }
+      }
+      // Write after write and write after read
+      for (auto& write : node.writes) {
+        for (auto& writer : writers) {
+          if (overlaps(write, writer.span)) dependencies.insert(writer.node);
+        }
+        for (auto& reader : readers) {
+          if (overlaps(write, reader.span)) dependencies.insert(reader.node);
+        }
+      }
+      // Accesses inside a range this node writes are ordered before it, later nodes only need to see this node
+      for (auto& write : node.writes) {
+        auto covered = [&write](const Access& access) {
+          return write.begin <= access.span.begin && access.span.end <= write.end;
+        };
+        writers.erase(std::remove_if(writers.begin(), writers.end(), covered), writers.end());
+        readers.erase(std::remove_if(readers.begin(), readers.end(), covered), readers.end());
+      }
+      for (auto& read : node.reads) readers.push_back(Access{read, n});
+      for (auto& write : node.writes) writers.push_back(Access{write, n});
+      since_barrier.push_back(n);
+    }
+
+    dependencies.erase(n);
+    node.dependencies.assign(dependencies.begin(), dependencies.end());
+    stats_.inferred_edges += static_cast<uint32_t>(node.dependencies.size());
+  }
+}
+
+void TaskGraph::reduce_dependencies() {
+  // ancestors[n] is the set of nodes n transitively depends on, as a bitset
+  const size_t words = (nodes_.size() + 63) / 64;
+  std::vector<std::vector<uint64_t>> ancestors(nodes_.size(), std::vector<uint64_t>(words, 0));
+
+  for (Node n = 0; n < nodes_.size(); n++) {
+    NodeInfo& node = nodes_[n];
+    std::vector<uint64_t>& reach = ancestors[n];
+    std::vector<Node> kept;
+    // Later dependencies first: they are the ones most likely to imply the earlier ones
+    std::sort(node.dependencies.begin(), node.dependencies.end(), std::greater<Node>());
+    for (auto dependency : node.dependencies) {
+      if (reach[dependency / 64] & (uint64_t(1) << (dependency % 64))) {
+        stats_.transitive_edges++;
+        continue;
+      }
+      kept.push_back(dependency);
+      reach[dependency / 64] |= uint64_t(1) << (dependency % 64);
+      for (size_t w = 0; w < words; w++) reach[w] |= ancestors[dependency][w];
+      node.level = std::max(node.level, nodes_[dependency].level + 1);
+    }
+    std::sort(kept.begin(), kept.end());
+    node.dependencies.swap(kept);
+  }
+}
+
+void TaskGraph::schedule() {
+  if (scheduled_) return;
+  infer_dependencies();
+  reduce_dependencies();
+
+  // Which list a copy lands on is only known in emit(), copies for the copy engine are taken to be on another one
+  auto copy_engine = [](const NodeInfo& node) { return node.kind == Kind::Copy && node.engine == Engine::Copy; };
+  stats_.nodes = static_cast<uint32_t>(nodes_.size());
+  for (auto& node : nodes_) {
+    for (auto dependency : node.dependencies) {
+      nodes_[dependency].needs_event = true;
+      if (copy_engine(nodes_[dependency]) != copy_engine(node)) nodes_[dependency].scope |= ZE_EVENT_SCOPE_FLAG_DEVICE;
+    }
+    stats_.edges += static_cast<uint32_t>(node.dependencies.size());
+    stats_.levels = std::max(stats_.levels, node.level + 1);
+  }
+  for (auto& node : nodes_) {
+    if (!node.needs_event) continue;
+    event_pool_->create_event(&node.event, node.scope, node.scope);
+    stats_.events++;
+  }
+  scheduled_ = true;
+}
+
+void TaskGraph::emit(ze_command_list_handle_t compute_list, ze_command_list_handle_t copy_list) {
+  schedule();
+
+  std::vector<Node> order(nodes_.size());
+  for (Node n = 0; n < nodes_.size(); n++) order[n] = n;
+  std::stable_sort(order.begin(), order.end(), [this](Node a, Node b) { return nodes_[a].level < nodes_[b].level; });
+
+  auto list_of = [&](const NodeInfo& node) {
+    return (node.kind == Kind::Copy && node.engine == Engine::Copy && copy_list) ? copy_list : compute_list;
+  };
+
+  std::vector<ze_event_handle_t> waits;
+  for (auto n : order) {
+    NodeInfo& node = nodes_[n];
+    ze_command_list_handle_t command_list = list_of(node);
+    waits.clear();
+    for (auto dependency : node.dependencies) {
+      waits.push_back(nodes_[dependency].event);
+      if (list_of(nodes_[dependency]) != command_list) stats_.cross_engine_edges++;
+    }
+    ze_event_handle_t* wait_events = waits.empty() ? nullptr : waits.data();
+    uint32_t num_wait_events = static_cast<uint32_t>(waits.size());
+
+    switch (node.kind) {
+      case Kind::Copy:
+        append_memory_copy(command_list, node.dst, node.src, node.size, node.event, num_wait_events, wait_events);
+        break;
+      case Kind::Launch:
+        for (uint32_t i = 0; i < node.arguments.size(); i++) {
+          node.kernel->set_argument(i, node.arguments[i].value.size(), node.arguments[i].value.data());
+        }
+        node.kernel->set_group_size(node.group_size[0], node.group_size[1], node.group_size[2]);
+        node.kernel->append(command_list, &node.group_count, node.event, num_wait_events, wait_events);
+        break;
+      case Kind::Barrier:
+        append_barrier(command_list, node.event, num_wait_events, wait_events);
+        stats_.barriers++;
+        break;
+    }
+  }
+}
+
+ze_event_handle_t TaskGraph::event(Node node) const { return nodes_.at(node).event; }
+
+const std::vector<TaskGraph::Node>& TaskGraph::dependencies(Node node) const { return nodes_.at(node).dependencies; }
+
+uint32_t TaskGraph::level(Node node) const { return nodes_.at(node).level; }
+
+}  // namespace lzu
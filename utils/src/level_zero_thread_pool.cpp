@@ -0,0 +1,113 @@
+// Copyright 2020 Intel Corporation
+
+#include "level_zero_thread_pool.hpp"
+
+#include <stdlib.h>
+
+#include <algorithm>
+
+namespace lzu {
+
+ThreadPool::ThreadPool(uint32_t threads) {
+  if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+  for (uint32_t i = 0; i < threads; i++) threads_.emplace_back(&ThreadPool::run, this);
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  for (auto& thread : threads_) thread.join();
+}
+
+ThreadPool& ThreadPool::get() {
+  static ThreadPool pool([] {
+    const char* threads = getenv("LZU_HOST_THREADS");
+    return threads ? static_cast<uint32_t>(std::max(0, atoi(threads))) : 0u;
+  }());
+  return pool;
+}
+
+void ThreadPool::enqueue(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tasks_.push_back(std::move(task));
+  }
+  cv_.notify_one();
+}
+
+bool ThreadPool::run_one() {
+  std::function<void()> task;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (tasks_.empty()) return false;
+    task = std::move(tasks_.front());
+    tasks_.pop_front();
+  }
+  task();
+  return true;
+}
+
+void ThreadPool::run() {
+  for (;;) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+      // Queued tasks still run on shutdown, their futures would never be ready otherwise
+      if (tasks_.empty()) return;
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+    task();
+  }
+}
+
+void ThreadPool::parallel_for(size_t count, const std::function<void(size_t begin, size_t end)>& function,
+                              size_t grain) {
+  if (count == 0) return;
+  grain = std::max<size_t>(grain, 1);
+  const size_t parts = std::min<size_t>((count + grain - 1) / grain, threads_.size() + 1);
+  if (parts == 1) {
+    function(0, count);
+    return;
+  }
+
+  struct State {
+    std::mutex mutex;
+    std::condition_variable done;
+    size_t remaining;
+    std::exception_ptr error;
+  };
+  std::shared_ptr<State> state = std::make_shared<State>();
+  state->remaining = parts;
+  auto run_part = [state, &function, count, parts](size_t part) {
+    try {
+      function(count * part / parts, count * (part + 1) / parts);
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      if (!state->error) state->error = std::current_exception();
+    }
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (--state->remaining == 0) state->done.notify_one();
+  };
+
+  for (size_t part = 1; part < parts; part++) enqueue([run_part, part] { run_part(part); });
+  run_part(0);
+  // Help with whatever is queued instead of blocking a thread the other parts may need. Once the queue is empty every
+  // part has been picked up, so the wait below only covers parts other threads are still running.
+  for (;;) {
+    {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      if (state->remaining == 0) break;
+    }
+    if (!run_one()) break;
+  }
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->done.wait(lock, [&state] { return state->remaining == 0; });
+  if (state->error) std::rethrow_exception(state->error);
+}
+
+}  // namespace lzu
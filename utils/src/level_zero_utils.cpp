@@ -2,6 +2,11 @@
 
 #include "level_zero_utils.hpp"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 namespace lzu {
 
 #define LEVEL_ZERO_ASSERT(x)                                 \
@@ -74,6 +79,13 @@ std::vector<ze_driver_handle_t> get_all_driver_handles() {
   return driver_handles;
 }
 
+ze_driver_properties_t get_driver_properties(ze_driver_handle_t driver) {
+  ze_driver_properties_t properties = {ZE_STRUCTURE_TYPE_DRIVER_PROPERTIES};
+
+  LEVEL_ZERO_EXPECT_EQ(ZE_RESULT_SUCCESS, zeDriverGetProperties(driver, &properties));
+  return properties;
+}
+
 // Device
 uint32_t get_device_count(ze_driver_handle_t driver) {
   uint32_t count = 0;
@@ -106,6 +118,36 @@ ze_device_properties_t get_device_properties(ze_device_handle_t device) {
   return properties;
 }
 
+ze_device_compute_properties_t get_device_compute_properties(ze_device_handle_t device) {
+  ze_device_compute_properties_t properties = {ZE_STRUCTURE_TYPE_DEVICE_COMPUTE_PROPERTIES};
+
+  LEVEL_ZERO_EXPECT_EQ(ZE_RESULT_SUCCESS, zeDeviceGetComputeProperties(device, &properties));
+  return properties;
+}
+
+std::vector<ze_command_queue_group_properties_t> get_command_queue_group_properties(ze_device_handle_t device) {
+  uint32_t count = 0;
+  LEVEL_ZERO_EXPECT_EQ(ZE_RESULT_SUCCESS, zeDeviceGetCommandQueueGroupProperties(device, &count, nullptr));
+
+  ze_command_queue_group_properties_t group = {};
+  group.stype = ZE_STRUCTURE_TYPE_COMMAND_QUEUE_GROUP_PROPERTIES;
+  std::vector<ze_command_queue_group_properties_t> groups(count, group);
+  LEVEL_ZERO_EXPECT_EQ(ZE_RESULT_SUCCESS, zeDeviceGetCommandQueueGroupProperties(device, &count, groups.data()));
+  groups.resize(count);
+  return groups;
+}
+
+uint32_t find_command_queue_group(ze_device_handle_t device, ze_command_queue_group_property_flags_t required,
+                                  ze_command_queue_group_property_flags_t excluded) {
+  std::vector<ze_command_queue_group_properties_t> groups = get_command_queue_group_properties(device);
+  for (uint32_t i = 0; i < groups.size(); i++) {
+    if ((groups[i].flags & required) == required && (groups[i].flags & excluded) == 0 && groups[i].numQueues > 0) {
+      return i;
+    }
+  }
+  return UINT32_MAX;
+}
+
 // memory
 void* allocate_host_memory(const size_t size, const size_t alignment, const ze_context_handle_t context) {
   ze_host_mem_alloc_desc_t host_desc = {};
@@ -140,8 +182,7 @@ void* allocate_device_memory(const size_t size, const size_t alignment, const ze
 
 void* allocate_shared_memory(const size_t size, const size_t alignment, const ze_device_mem_alloc_flags_t dev_flags,
                              const ze_host_mem_alloc_flags_t host_flags, ze_device_handle_t device,
-                             ze_context_handle_t context) {
-  uint32_t ordinal = 0;
+                             ze_context_handle_t context, const uint32_t ordinal) {
   void* memory = nullptr;
   ze_device_mem_alloc_desc_t device_desc = {};
   device_desc.stype = ZE_STRUCTURE_TYPE_DEVICE_MEM_ALLOC_DESC;
@@ -171,34 +212,71 @@ void append_memory_copy(ze_command_list_handle_t cl, void* dstptr, const void* s
                                                                         num_wait_events, wait_events));
 }
 
+void append_memory_prefetch(ze_command_list_handle_t cl, const void* ptr, size_t size) {
+  LEVEL_ZERO_EXPECT_EQ(ZE_RESULT_SUCCESS, zeCommandListAppendMemoryPrefetch(cl, ptr, size));
+}
+
+void append_memory_advise(ze_command_list_handle_t cl, ze_device_handle_t device, const void* ptr, size_t size,
+                          ze_memory_advice_t advice) {
+  LEVEL_ZERO_EXPECT_EQ(ZE_RESULT_SUCCESS, zeCommandListAppendMemAdvise(cl, device, ptr, size, advice));
+}
+
 // Module
-ze_module_handle_t create_module(ze_context_handle_t context, ze_device_handle_t device, uint8_t* data, size_t bytes,
-                                 const ze_module_format_t format, const char* build_flags,
-                                 ze_module_build_log_handle_t* p_build_log) {
+ze_module_handle_t create_module(ze_context_handle_t context, ze_device_handle_t device, const uint8_t* data,
+                                 size_t bytes, const ze_module_format_t format, const char* build_flags,
+                                 ze_module_build_log_handle_t* p_build_log, const ze_module_constants_t* constants) {
   ze_module_desc_t module_description = {};
   module_description.stype = ZE_STRUCTURE_TYPE_MODULE_DESC;
   ze_module_handle_t module;
   ze_module_constants_t module_constants = {};
-  const std::vector<uint8_t> binary_file(data, data + bytes);
 
   LEVEL_ZERO_EXPECT_TRUE((format == ZE_MODULE_FORMAT_IL_SPIRV) || (format == ZE_MODULE_FORMAT_NATIVE));
 
   module_description.pNext = nullptr;
   module_description.format = format;
-  module_description.inputSize = static_cast<uint32_t>(binary_file.size());
-  module_description.pInputModule = binary_file.data();
+  module_description.inputSize = bytes;
+  module_description.pInputModule = data;
   module_description.pBuildFlags = build_flags;
-  module_description.pConstants = &module_constants;
+  module_description.pConstants = constants ? constants : &module_constants;
 
   LEVEL_ZERO_EXPECT_EQ(ZE_RESULT_SUCCESS, zeModuleCreate(context, device, &module_description, &module, p_build_log));
 
   return module;
 }
 
+std::vector<uint8_t> get_module_native_binary(ze_module_handle_t module) {
+  size_t size = 0;
+  LEVEL_ZERO_EXPECT_EQ(ZE_RESULT_SUCCESS, zeModuleGetNativeBinary(module, &size, nullptr));
+  std::vector<uint8_t> binary(size);
+  LEVEL_ZERO_EXPECT_EQ(ZE_RESULT_SUCCESS, zeModuleGetNativeBinary(module, &size, binary.data()));
+  binary.resize(size);
+  return binary;
+}
+
+std::string get_module_build_log(ze_module_build_log_handle_t build_log) {
+  size_t size = 0;
+  LEVEL_ZERO_EXPECT_EQ(ZE_RESULT_SUCCESS, zeModuleBuildLogGetString(build_log, &size, nullptr));
+  std::string log(size, '\0');
+  if (size > 0) LEVEL_ZERO_EXPECT_EQ(ZE_RESULT_SUCCESS, zeModuleBuildLogGetString(build_log, &size, &log[0]));
+  // size counts the terminating null
+  log.resize(strnlen(log.c_str(), log.size()));
+  return log;
+}
+
+void destroy_module_build_log(ze_module_build_log_handle_t build_log) {
+  LEVEL_ZERO_EXPECT_EQ(ZE_RESULT_SUCCESS, zeModuleBuildLogDestroy(build_log));
+}
+
+ze_module_handle_t create_module(ze_context_handle_t context, ze_device_handle_t device, const BinaryView& binary,
+                                 const ze_module_format_t format, const char* build_flags,
+                                 ze_module_build_log_handle_t* p_build_log, const ze_module_constants_t* constants) {
+  return create_module(context, device, binary.data(), binary.size(), format, build_flags, p_build_log, constants);
+}
+
 void destroy_module(ze_module_handle_t module) { LEVEL_ZERO_EXPECT_EQ(ZE_RESULT_SUCCESS, zeModuleDestroy(module)); }
 
 // Kernel
-ze_kernel_handle_t create_function(ze_module_handle_t module, ze_kernel_flags_t flag, std::string func_name) {
+ze_kernel_handle_t create_function(ze_module_handle_t module, ze_kernel_flags_t flag, const std::string& func_name) {
   ze_kernel_handle_t kernel;
   ze_kernel_desc_t kernel_description = {};
   kernel_description.stype = ZE_STRUCTURE_TYPE_KERNEL_DESC;
@@ -269,8 +347,6 @@ ze_command_queue_handle_t create_command_queue(ze_context_handle_t context, ze_d
   descriptor.flags = flags;
   descriptor.mode = mode;
   descriptor.priority = priority;
-  ze_device_properties_t properties;
-  LEVEL_ZERO_EXPECT_EQ(ZE_RESULT_SUCCESS, zeDeviceGetProperties(device, &properties));
 
   descriptor.ordinal = ordinal;
   descriptor.index = index;
@@ -289,12 +365,37 @@ void destroy_command_queue(ze_command_queue_handle_t cq) {
   LEVEL_ZERO_EXPECT_EQ(ZE_RESULT_SUCCESS, zeCommandQueueDestroy(cq));
 }
 
+// Fence
+ze_fence_handle_t create_fence(ze_command_queue_handle_t cq) {
+  ze_fence_desc_t descriptor = {};
+  descriptor.stype = ZE_STRUCTURE_TYPE_FENCE_DESC;
+  ze_fence_handle_t fence = nullptr;
+  LEVEL_ZERO_EXPECT_EQ(ZE_RESULT_SUCCESS, zeFenceCreate(cq, &descriptor, &fence));
+  return fence;
+}
+
+void reset_fence(ze_fence_handle_t fence) { LEVEL_ZERO_EXPECT_EQ(ZE_RESULT_SUCCESS, zeFenceReset(fence)); }
+
+void synchronize(ze_fence_handle_t fence, uint64_t timeout) {
+  LEVEL_ZERO_EXPECT_EQ(ZE_RESULT_SUCCESS, zeFenceHostSynchronize(fence, timeout));
+}
+
+void destroy_fence(ze_fence_handle_t fence) { LEVEL_ZERO_EXPECT_EQ(ZE_RESULT_SUCCESS, zeFenceDestroy(fence)); }
+
 // Event
 zeEventPool::zeEventPool() {}
 
 zeEventPool::~zeEventPool() {
-  if (event_pool_) {
-    ze_result_t result = zeEventPoolDestroy(event_pool_);
+  for (auto& slot : slots_) {
+    if (slot.event) {
+      ze_result_t result = zeEventDestroy(slot.event);
+      if (ZE_RESULT_SUCCESS != result) {
+        std::cout << "Failed to destroy event " + to_string(result) << std::endl;
+      }
+    }
+  }
+  for (auto slab : slabs_) {
+    ze_result_t result = zeEventPoolDestroy(slab);
     if (ZE_RESULT_SUCCESS != result) {
       std::cout << "Failed to destroy event pool " + to_string(result) << std::endl;
     }
@@ -305,50 +406,154 @@ void zeEventPool::InitEventPool(ze_context_handle_t context, uint32_t count, ze_
   LEVEL_ZERO_EXPECT_NE(nullptr, context);
   context_ = context;
   if (event_pool_ == nullptr) {
-    ze_event_pool_desc_t descriptor = {};
-    descriptor.stype = ZE_STRUCTURE_TYPE_EVENT_POOL_DESC;
-
-    descriptor.pNext = nullptr;
-    descriptor.flags = flags;
-    descriptor.count = count;
+    LEVEL_ZERO_EXPECT_GT(count, 0u);
+    flags_ = flags;
+    add_slab(count);
+    event_pool_ = slabs_.front();
+  }
+}
 
-    LEVEL_ZERO_EXPECT_EQ(ZE_RESULT_SUCCESS, zeEventPoolCreate(context, &descriptor, 0, nullptr, &event_pool_));
-    LEVEL_ZERO_EXPECT_NE(nullptr, event_pool_);
+void zeEventPool::add_slab(uint32_t count) {
+  ze_event_pool_desc_t descriptor = {};
+  descriptor.stype = ZE_STRUCTURE_TYPE_EVENT_POOL_DESC;
 
-    pool_indexes_available_.resize(count, true);
+  descriptor.pNext = nullptr;
+  descriptor.flags = flags_;
+  descriptor.count = count;
+
+  ze_event_pool_handle_t slab = nullptr;
+  LEVEL_ZERO_EXPECT_EQ(ZE_RESULT_SUCCESS, zeEventPoolCreate(context_, &descriptor, 0, nullptr, &slab));
+  LEVEL_ZERO_EXPECT_NE(nullptr, slab);
+  slabs_.push_back(slab);
+
+  uint32_t first = static_cast<uint32_t>(slots_.size());
+  slots_.resize(first + count);
+  free_slots_.reserve(slots_.size());
+  // Push in reverse so that lower indexes are handed out first
+  for (uint32_t i = count; i > 0; i--) {
+    EventSlot& slot = slots_[first + i - 1];
+    slot.slab = slab;
+    slot.index = i - 1;
+    free_slots_.push_back(first + i - 1);
   }
 }
 
 void zeEventPool::create_event(ze_event_handle_t* event, ze_event_scope_flags_t signal, ze_event_scope_flags_t wait) {
   // Make sure the event pool is initialized to at least defaults:
   InitEventPool(context_, 32);
-  ze_event_desc_t desc = {};
-  memset(&desc, 0, sizeof(desc));
-  desc.stype = ZE_STRUCTURE_TYPE_EVENT_DESC;
-  desc.pNext = nullptr;
-  desc.signal = signal;
-  desc.wait = wait;
   *event = nullptr;
-  desc.index = -1;
-  for (uint32_t i = 0; i < pool_indexes_available_.size(); i++) {
-    if (pool_indexes_available_[i]) {
-      desc.index = i;
-      break;
-    }
+  if (free_slots_.empty()) {
+    add_slab(capacity());
+  }
+  uint32_t slot_index = free_slots_.back();
+  free_slots_.pop_back();
+  EventSlot& slot = slots_[slot_index];
+
+  if (slot.event && (slot.signal != signal || slot.wait != wait)) {
+    // Scope flags are fixed at creation, so a recycled event with other scopes has to be recreated
+    erase_lookup(slot.event);
+    LEVEL_ZERO_EXPECT_EQ(ZE_RESULT_SUCCESS, zeEventDestroy(slot.event));
+    slot.event = nullptr;
   }
-  LEVEL_ZERO_EXPECT_EQ(ZE_RESULT_SUCCESS, zeEventCreate(event_pool_, &desc, event));
-  LEVEL_ZERO_EXPECT_NE(nullptr, *event);
-  handle_to_index_map_[*event] = desc.index;
-  pool_indexes_available_[desc.index] = false;
+
+  if (slot.event) {
+    events_recycled_++;
+  } else {
+    ze_event_desc_t desc = {};
+    memset(&desc, 0, sizeof(desc));
+    desc.stype = ZE_STRUCTURE_TYPE_EVENT_DESC;
+    desc.pNext = nullptr;
+    desc.signal = signal;
+    desc.wait = wait;
+    desc.index = slot.index;
+    LEVEL_ZERO_EXPECT_EQ(ZE_RESULT_SUCCESS, zeEventCreate(slot.slab, &desc, &slot.event));
+    LEVEL_ZERO_EXPECT_NE(nullptr, slot.event);
+    slot.signal = signal;
+    slot.wait = wait;
+    insert_lookup(slot.event, slot_index);
+    events_created_++;
+  }
+  slot.in_use = true;
+  *event = slot.event;
 }
 
 void zeEventPool::destroy_event(ze_event_handle_t event) {
-  std::map<ze_event_handle_t, uint32_t>::iterator it = handle_to_index_map_.find(event);
+  uint32_t slot_index = find_slot(event);
+
+  LEVEL_ZERO_EXPECT_NE(slot_index, UINT32_MAX);
+  EventSlot& slot = slots_[slot_index];
+  LEVEL_ZERO_EXPECT_TRUE(slot.in_use);
+  LEVEL_ZERO_EXPECT_EQ(ZE_RESULT_SUCCESS, zeEventHostReset(event));
+  slot.in_use = false;
+  free_slots_.push_back(slot_index);
+}
+
+static inline size_t hash_event_handle(ze_event_handle_t event) {
+  uint64_t key = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(event));
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  return static_cast<size_t>(key);
+}
+
+// Buckets hold (event, slot). Empty ones are (nullptr, 0) and end a probe, erased ones are (nullptr, kErasedSlot) and
+// let it continue.
+static const uint32_t kErasedSlot = UINT32_MAX;
+
+static inline bool empty_bucket(const std::pair<ze_event_handle_t, uint32_t>& bucket) {
+  return bucket.first == nullptr && bucket.second != kErasedSlot;
+}
+
+uint32_t zeEventPool::find_slot(ze_event_handle_t event) const {
+  if (lookup_.empty() || event == nullptr) return UINT32_MAX;
+  size_t mask = lookup_.size() - 1;
+  for (size_t i = hash_event_handle(event) & mask;; i = (i + 1) & mask) {
+    if (lookup_[i].first == event) return lookup_[i].second;
+    if (empty_bucket(lookup_[i])) return UINT32_MAX;
+  }
+}
 
-  LEVEL_ZERO_EXPECT_NE(it, handle_to_index_map_.end());
-  pool_indexes_available_[(*it).second] = true;
-  handle_to_index_map_.erase(it);
-  LEVEL_ZERO_EXPECT_EQ(ZE_RESULT_SUCCESS, zeEventDestroy(event));
+void zeEventPool::insert_lookup(ze_event_handle_t event, uint32_t slot) {
+  // Keep the load factor, erased buckets included, under one half
+  if ((lookup_size_ + 1) * 2 > lookup_.size()) {
+    rehash_lookup(std::max<size_t>(64, lookup_.size() * 2));
+  }
+  size_t mask = lookup_.size() - 1;
+  size_t i = hash_event_handle(event) & mask;
+  size_t erased = SIZE_MAX;
+  while (!empty_bucket(lookup_[i]) && lookup_[i].first != event) {
+    if (erased == SIZE_MAX && lookup_[i].first == nullptr) erased = i;
+    i = (i + 1) & mask;
+  }
+  if (lookup_[i].first != event) {
+    if (erased != SIZE_MAX) {
+      i = erased;
+    } else {
+      lookup_size_++;
+    }
+  }
+  lookup_[i] = std::make_pair(event, slot);
+}
+
+void zeEventPool::erase_lookup(ze_event_handle_t event) {
+  if (lookup_.empty()) return;
+  size_t mask = lookup_.size() - 1;
+  for (size_t i = hash_event_handle(event) & mask; !empty_bucket(lookup_[i]); i = (i + 1) & mask) {
+    if (lookup_[i].first == event) {
+      lookup_[i] = std::make_pair(static_cast<ze_event_handle_t>(nullptr), kErasedSlot);
+      return;
+    }
+  }
+}
+
+void zeEventPool::rehash_lookup(size_t buckets) {
+  std::vector<std::pair<ze_event_handle_t, uint32_t>> old;
+  old.swap(lookup_);
+  lookup_.assign(buckets, std::make_pair(static_cast<ze_event_handle_t>(nullptr), 0u));
+  lookup_size_ = 0;
+  for (auto& entry : old) {
+    if (entry.first) insert_lookup(entry.first, entry.second);
+  }
 }
 
 void append_barrier(ze_command_list_handle_t cl, ze_event_handle_t hSignalEvent, uint32_t numWaitEvents,
@@ -356,6 +561,18 @@ void append_barrier(ze_command_list_handle_t cl, ze_event_handle_t hSignalEvent,
   LEVEL_ZERO_EXPECT_EQ(ZE_RESULT_SUCCESS, zeCommandListAppendBarrier(cl, hSignalEvent, numWaitEvents, phWaitEvents));
 }
 
+void append_signal_event(ze_command_list_handle_t cl, ze_event_handle_t event) {
+  LEVEL_ZERO_EXPECT_EQ(ZE_RESULT_SUCCESS, zeCommandListAppendSignalEvent(cl, event));
+}
+
+void append_wait_on_events(ze_command_list_handle_t cl, uint32_t numEvents, ze_event_handle_t* phEvents) {
+  LEVEL_ZERO_EXPECT_EQ(ZE_RESULT_SUCCESS, zeCommandListAppendWaitOnEvents(cl, numEvents, phEvents));
+}
+
+void append_event_reset(ze_command_list_handle_t cl, ze_event_handle_t event) {
+  LEVEL_ZERO_EXPECT_EQ(ZE_RESULT_SUCCESS, zeCommandListAppendEventReset(cl, event));
+}
+
 // Group
 void set_group_size(ze_kernel_handle_t hFunction, uint32_t groupSizeX, uint32_t groupSizeY, uint32_t groupSizeZ) {
   LEVEL_ZERO_EXPECT_EQ(ZE_RESULT_SUCCESS, zeKernelSetGroupSize(hFunction, groupSizeX, groupSizeY, groupSizeZ));
@@ -368,26 +585,81 @@ void suggest_group_size(ze_kernel_handle_t hFunction, uint32_t globalSizeX, uint
 }
 
 // Helper
-std::vector<uint8_t> load_binary_file(const std::string& file_path) {
-  std::ifstream stream(file_path, std::ios::in | std::ios::binary);
+BinaryView::BinaryView(std::vector<uint8_t> buffer) : buffer_(std::move(buffer)) {
+  data_ = buffer_.data();
+  size_ = buffer_.size();
+}
+
+BinaryView::BinaryView(BinaryView&& other) { *this = std::move(other); }
+
+BinaryView& BinaryView::operator=(BinaryView&& other) {
+  if (this != &other) {
+    reset();
+    buffer_ = std::move(other.buffer_);
+    mapping_ = other.mapping_;
+    data_ = mapping_ ? other.data_ : buffer_.data();
+    size_ = other.size_;
+    other.data_ = nullptr;
+    other.size_ = 0;
+    other.mapping_ = nullptr;
+  }
+  return *this;
+}
+
+BinaryView::~BinaryView() { reset(); }
 
-  std::vector<uint8_t> binary_file;
-  if (!stream.good()) {
+void BinaryView::reset() {
+  if (mapping_) {
+    munmap(mapping_, size_);
+  }
+  mapping_ = nullptr;
+  data_ = nullptr;
+  size_ = 0;
+  buffer_.clear();
+}
+
+BinaryView map_binary_file(const std::string& file_path) {
+  BinaryView view;
+  int fd = open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
     std::cout << "Failed to load binary file: " << file_path << " error " << strerror(errno) << std::endl;
-    return binary_file;
+    return view;
   }
 
-  size_t length = 0;
-  stream.seekg(0, stream.end);
-  length = static_cast<size_t>(stream.tellg());
-  stream.seekg(0, stream.beg);
-  std::cout << "Binary file length: " << length << std::endl;
+  struct stat info;
+  if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+    void* mapping = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping != MAP_FAILED) {
+      close(fd);
+      madvise(mapping, static_cast<size_t>(info.st_size), MADV_WILLNEED);
+      view.mapping_ = mapping;
+      view.data_ = static_cast<const uint8_t*>(mapping);
+      view.size_ = static_cast<size_t>(info.st_size);
+      return view;
+    }
+  }
 
-  binary_file.resize(length);
-  stream.read(reinterpret_cast<char*>(binary_file.data()), length);
-  std::cout << "Binary file loaded" << std::endl;
+  // Not mappable, stream it instead
+  std::vector<uint8_t> buffer;
+  uint8_t chunk[64 * 1024];
+  for (;;) {
+    ssize_t count = read(fd, chunk, sizeof(chunk));
+    if (count < 0 && errno == EINTR) continue;
+    if (count < 0) {
+      std::cout << "Failed to read binary file: " << file_path << " error " << strerror(errno) << std::endl;
+      buffer.clear();
+      break;
+    }
+    if (count == 0) break;
+    buffer.insert(buffer.end(), chunk, chunk + count);
+  }
+  close(fd);
+  return BinaryView(std::move(buffer));
+}
 
-  return binary_file;
+std::vector<uint8_t> load_binary_file(const std::string& file_path) {
+  BinaryView view = map_binary_file(file_path);
+  return std::vector<uint8_t>(view.data(), view.data() + view.size());
 }
 
 std::string to_string(const ze_result_t result) {